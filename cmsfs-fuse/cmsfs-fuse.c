@@ -24,7 +24,6 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <search.h>
-#include <iconv.h>
 #include <ctype.h>
 #include <math.h>
 #ifdef HAVE_SETXATTR
@@ -303,10 +302,10 @@ static unsigned int hex_to_dec(unsigned int num)
 	return res & 0xffffffff;
 }
 
-static void setup_iconv(iconv_t *conv, const char *from, const char *to)
+static void setup_conv(struct util_ebcdic *conv, const char *from,
+		       const char *to)
 {
-	*conv = iconv_open(to, from);
-	if (*conv == ((iconv_t) -1))
+	if (util_ebcdic_open(conv, to, from))
 		DIE("Could not initialize conversion table %s->%s.\n",
 			from, to);
 }
@@ -2547,14 +2546,14 @@ static void get_block_data_from_record(struct record *rec, off_t offset,
 	}
 }
 
-static int convert_text(iconv_t conv, char *buf, int size)
+static int convert_text(struct util_ebcdic *conv, char *buf, int size)
 {
 	size_t out_count = size;
 	size_t in_count = size;
 	char *data_ptr = buf;
 	int rc;
 
-	rc = iconv(conv, &data_ptr, &in_count, &data_ptr, &out_count);
+	rc = util_ebcdic_conv(conv, &data_ptr, &in_count, &data_ptr, &out_count);
 	if ((rc == -1) || (in_count != 0)) {
 		DEBUG("Code page translation EBCDIC-ASCII failed\n");
 		return -EIO;
@@ -2622,7 +2621,7 @@ static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 		}
 
 		if (f->translate) {
-			rc = convert_text(cmsfs.iconv_from, buf, chunk);
+			rc = convert_text(&cmsfs.conv_from, buf, chunk);
 			if (rc < 0)
 				return rc;
 		}
@@ -4219,7 +4218,7 @@ static int cmsfs_write(const char *path, const char *buf, size_t size,
 	}
 
 	/* translate */
-	rc = convert_text(cmsfs.iconv_to, f->wcache, f->wcache_used);
+	rc = convert_text(&cmsfs.conv_to, f->wcache, f->wcache_used);
 	if (rc < 0)
 		return rc;
 
@@ -4281,7 +4280,7 @@ static int flush_wcache(struct file *f)
 	int rc;
 
 	/* translate */
-	rc = convert_text(cmsfs.iconv_to, f->wcache, f->wcache_used);
+	rc = convert_text(&cmsfs.conv_to, f->wcache, f->wcache_used);
 	if (rc < 0)
 		return rc;
 
@@ -4626,10 +4625,10 @@ int main(int argc, char *argv[])
 		if (cmsfs.codepage_to == NULL)
 			cmsfs.codepage_to = CODEPAGE_LINUX;
 
-		setup_iconv(&cmsfs.iconv_from, cmsfs.codepage_from,
-			    cmsfs.codepage_to);
-		setup_iconv(&cmsfs.iconv_to, cmsfs.codepage_to,
-			    cmsfs.codepage_from);
+		setup_conv(&cmsfs.conv_from, cmsfs.codepage_from,
+			   cmsfs.codepage_to);
+		setup_conv(&cmsfs.conv_to, cmsfs.codepage_to,
+			   cmsfs.codepage_from);
 	}
 
 	rc = cmsfs_fuse_main(&args, &cmsfs_oper);
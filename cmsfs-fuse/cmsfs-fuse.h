@@ -11,7 +11,6 @@
 
 #define _GNU_SOURCE
 #include <search.h>
-#include <iconv.h>
 #include "util.h"
 
 #define COMP "cmsfs-fuse: "
@@ -68,11 +67,11 @@ struct cmsfs {
 	int		files;
 	/* conversion mode */
 	enum cmsfs_mode	mode;
-	/* iconv codepage options */
+	/* codepage options */
 	const char	*codepage_from;
 	const char	*codepage_to;
-	iconv_t		iconv_from;
-	iconv_t		iconv_to;
+	struct util_ebcdic conv_from;
+	struct util_ebcdic conv_to;
 
 	/* disk stats */
 	int		total_blocks;
@@ -112,9 +112,18 @@ $(rootdir)/libutil/util_part.o:
 $(rootdir)/libutil/util_list.o:
 	make -C $(rootdir)/libutil/ util_list.o
 
+$(rootdir)/libutil/util_sha256.o:
+	make -C $(rootdir)/libutil/ util_sha256.o
+
 $(rootdir)/libutil/util_proc.o:
 	make -C $(rootdir)/libutil/ util_proc.o
 
+$(rootdir)/libutil/util_ebcdic.o:
+	make -C $(rootdir)/libutil/ util_ebcdic.o
+
+$(rootdir)/libutil/util_vmcp.o:
+	make -C $(rootdir)/libutil/ util_vmcp.o
+
 $(rootdir)/libvtoc/vtoc.o:
 	make -C $(rootdir)/libvtoc/ vtoc.o
 
@@ -0,0 +1,56 @@
+/*
+ * Compact zfcpdump dump format definitions
+ *
+ * The format is written by zfcpdump and read by zgetdump.
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#ifndef DF_COMPACT_H
+#define DF_COMPACT_H
+
+#include "zt_common.h"
+
+#define DF_COMPACT_MAGIC	0x5a464350434d5054ULL	/* ZFCPCMPT */
+#define DF_COMPACT_VERSION	1
+#define DF_COMPACT_PAGE_SIZE	4096
+#define DF_COMPACT_BLK_SIZE	0x100000
+#define DF_COMPACT_BLK_PAGES	(DF_COMPACT_BLK_SIZE / DF_COMPACT_PAGE_SIZE)
+
+#define DF_COMPACT_BLK_ZLIB	0x1	/* Block data is zlib compressed */
+
+/*
+ * Compact dump header
+ *
+ * The compact dump contains a copy of the ELF header and notes of
+ * /proc/vmcore and an index entry for each block of the ELF memory.
+ */
+struct df_compact_hdr {
+	u64	magic;
+	u32	version;
+	u32	blk_size;
+	u64	elf_size;	/* Size of the original ELF dump */
+	u64	elf_hdr_off;	/* Offset of ELF header and notes */
+	u64	elf_hdr_size;
+	u64	idx_off;	/* Offset of block index */
+	u64	blk_cnt;
+	u64	dump_size;
+} __attribute__ ((packed));
+
+/*
+ * Compact dump block index entry
+ *
+ * Only the pages that have a bit set in "page_map" are stored and all
+ * other pages of the block are zero.
+ */
+struct df_compact_blk {
+	u64	off;		/* Offset in the original ELF dump */
+	u64	data_off;	/* Offset of stored data */
+	u32	size;		/* Size in the original ELF dump */
+	u32	data_size;	/* Size of stored data */
+	u32	flags;
+	u32	reserved;
+	u8	page_map[DF_COMPACT_BLK_PAGES / 8];
+} __attribute__ ((packed));
+
+#endif /* DF_COMPACT_H */
@@ -9,7 +9,18 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "util_list.h"
 #include "util_part.h"
+#include "util_sha256.h"
+#include "util_ebcdic.h"
+#include "util_vmcp.h"
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* UTIL_H */
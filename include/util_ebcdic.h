@@ -0,0 +1,36 @@
+/*
+ * util - Utility function library
+ *
+ * EBCDIC and ASCII code page conversion
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#ifndef UTIL_EBCDIC_H
+#define UTIL_EBCDIC_H
+
+#ifndef UTIL_H
+#warning "Please include util.h and not util_ebcdic.h directly!"
+#endif
+
+#include <stddef.h>
+#include <iconv.h>
+
+/*
+ * Code page conversion: Translation table for IBM-037 and IBM-1047 from
+ * and to ISO-8859-1, iconv for all other code pages
+ */
+struct util_ebcdic {
+	const unsigned char	*table;
+	iconv_t			iconv;
+};
+
+int util_ebcdic_open(struct util_ebcdic *conv, const char *to,
+		     const char *from);
+size_t util_ebcdic_conv(struct util_ebcdic *conv, char **in, size_t *in_len,
+			char **out, size_t *out_len);
+void util_ebcdic_close(struct util_ebcdic *conv);
+void util_ebcdic_tr(const unsigned char table[256], const void *in, void *out,
+		    size_t len);
+
+#endif /* UTIL_EBCDIC_H */
@@ -0,0 +1,36 @@
+/*
+ * util - Utility function library
+ *
+ * SHA-256 message digest
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#ifndef UTIL_SHA256_H
+#define UTIL_SHA256_H
+
+#ifndef UTIL_H
+#warning "Please include util.h and not util_sha256.h directly!"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTIL_SHA256_SIZE	32	/* Digest size in bytes */
+#define UTIL_SHA256_HEX_SIZE	65	/* Size of hex string with '\0' */
+
+struct util_sha256 {
+	uint32_t	state[8];
+	uint64_t	len;		/* Number of processed bytes */
+	uint8_t		buf[64];	/* Incomplete block */
+};
+
+void util_sha256_init(struct util_sha256 *ctx);
+void util_sha256_update(struct util_sha256 *ctx, const void *data,
+			size_t len);
+void util_sha256_final(struct util_sha256 *ctx,
+		       uint8_t digest[UTIL_SHA256_SIZE]);
+void util_sha256_hex(const uint8_t digest[UTIL_SHA256_SIZE],
+		     char str[UTIL_SHA256_HEX_SIZE]);
+
+#endif /* UTIL_SHA256_H */
@@ -0,0 +1,36 @@
+/*
+ * util - Utility function library
+ *
+ * z/VM CP command interface
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#ifndef UTIL_VMCP_H
+#define UTIL_VMCP_H
+
+#ifndef UTIL_H
+#warning "Please include util.h and not util_vmcp.h directly!"
+#endif
+
+/*
+ * Session to /dev/vmcp: The device stays open for all commands and the
+ * response buffer only grows
+ */
+struct util_vmcp {
+	int	fd;
+	char	*buf;		/* Response of last command, zero terminated */
+	int	buf_size;	/* Size of response buffer */
+	int	resp_len;	/* Number of bytes in response buffer */
+	int	resp_size;	/* Size of complete response of CP */
+};
+
+int util_vmcp_open(struct util_vmcp *vmcp);
+int util_vmcp_set_buf(struct util_vmcp *vmcp, int size);
+int util_vmcp_cmd(struct util_vmcp *vmcp, const char *cmd, int retry,
+		  int *cprc);
+int util_vmcp_cmd_vec(struct util_vmcp *vmcp, char *const cmd_vec[], int cnt,
+		      int *cprc);
+void util_vmcp_close(struct util_vmcp *vmcp);
+
+#endif /* UTIL_VMCP_H */
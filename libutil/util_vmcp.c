@@ -0,0 +1,142 @@
+/*
+ * util - Utility function library
+ *
+ * z/VM CP command interface
+ *
+ * Issuing a CP command through a new /dev/vmcp session costs an open,
+ * a buffer setup, and a close. A util_vmcp session keeps the device open
+ * and remembers the largest response size, so that commands with large
+ * responses are only issued twice the first time.
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "util.h"
+
+#define VMCP_DEVICE_NODE	"/dev/vmcp"
+#define VMCP_GETCODE		_IOR(0x10, 1, int)
+#define VMCP_SETBUF		_IOW(0x10, 2, int)
+#define VMCP_GETSIZE		_IOR(0x10, 3, int)
+
+/*
+ * Open session
+ *
+ * Before the first command the response buffer has to be set with
+ * util_vmcp_set_buf().
+ *
+ * Return 0 on success, -1 with errno set on Linux errors.
+ */
+int util_vmcp_open(struct util_vmcp *vmcp)
+{
+	memset(vmcp, 0, sizeof(*vmcp));
+	vmcp->fd = open(VMCP_DEVICE_NODE, O_RDWR);
+	return vmcp->fd == -1 ? -1 : 0;
+}
+
+/*
+ * Set size of response buffer to "size" bytes
+ *
+ * Return 0 on success, -1 with errno set on Linux errors.
+ */
+int util_vmcp_set_buf(struct util_vmcp *vmcp, int size)
+{
+	char *buf;
+
+	if (ioctl(vmcp->fd, VMCP_SETBUF, &size) == -1)
+		return -1;
+	buf = realloc(vmcp->buf, size + 1);
+	if (!buf)
+		return -1;
+	vmcp->buf = buf;
+	vmcp->buf_size = size;
+	return 0;
+}
+
+/*
+ * Issue CP command "cmd" and store the CP return code in "cprc"
+ *
+ * The response is available in vmcp->buf until the next command. If the
+ * response does not fit, the buffer is enlarged and the command is issued
+ * again, if "retry" is set. Otherwise the response is truncated and
+ * vmcp->resp_size is larger than vmcp->resp_len.
+ *
+ * Return 0 on success, -1 with errno set on Linux errors.
+ */
+int util_vmcp_cmd(struct util_vmcp *vmcp, const char *cmd, int retry,
+		  int *cprc)
+{
+	int size, count, len, rc;
+
+	while (1) {
+		do {
+			rc = write(vmcp->fd, cmd, strlen(cmd));
+		} while (rc == -1 && errno == EINTR);
+		if (rc == -1)
+			return -1;
+		if (ioctl(vmcp->fd, VMCP_GETCODE, cprc) == -1)
+			return -1;
+		if (ioctl(vmcp->fd, VMCP_GETSIZE, &size) == -1)
+			return -1;
+		if (size <= vmcp->buf_size || !retry)
+			break;
+		if (util_vmcp_set_buf(vmcp, size))
+			return -1;
+	}
+	count = size < vmcp->buf_size ? size : vmcp->buf_size;
+	for (len = 0; len < count; len += rc) {
+		rc = read(vmcp->fd, vmcp->buf + len, count - len);
+		if (rc == -1 && errno == EINTR) {
+			rc = 0;
+			continue;
+		}
+		if (rc == -1)
+			return -1;
+		if (rc == 0)
+			break;
+	}
+	vmcp->buf[len] = 0;
+	vmcp->resp_len = len;
+	vmcp->resp_size = size;
+	return 0;
+}
+
+/*
+ * Issue the "cnt" commands of "cmd_vec" one after the other until a command
+ * fails. The CP return code of the last issued command is stored in "cprc".
+ *
+ * Return the number of successful commands, -1 with errno set on Linux
+ * errors.
+ */
+int util_vmcp_cmd_vec(struct util_vmcp *vmcp, char *const cmd_vec[], int cnt,
+		      int *cprc)
+{
+	int i;
+
+	*cprc = 0;
+	for (i = 0; i < cnt; i++) {
+		if (util_vmcp_cmd(vmcp, cmd_vec[i], 0, cprc))
+			return -1;
+		if (*cprc)
+			break;
+	}
+	return i;
+}
+
+/*
+ * Close session
+ */
+void util_vmcp_close(struct util_vmcp *vmcp)
+{
+	if (vmcp->fd != -1)
+		close(vmcp->fd);
+	free(vmcp->buf);
+	vmcp->fd = -1;
+	vmcp->buf = NULL;
+	vmcp->buf_size = 0;
+}
@@ -9,6 +9,7 @@
  */
 
 #include "vtoc.h"
+#include "util.h"
 
 static unsigned char EBCtoASC[256] =
 {
@@ -174,11 +175,7 @@ static void vtoc_error(enum failure why, char *s1, char *s2)
  */
 char * vtoc_ebcdic_enc (char *source, char *target, int l) 
 {
-        int i;
-
-	for (i = 0; i < l; i++) 
-	        target[i]=ASCtoEBC[(unsigned char)(source[i])];
-
+	util_ebcdic_tr(ASCtoEBC, source, target, l);
 	return target;
 }
 
@@ -188,11 +185,7 @@ char * vtoc_ebcdic_enc (char *source, char *target, int l)
  */
 char * vtoc_ebcdic_dec (char *source, char *target, int l) 
 {
-        int i;
-
-	for (i = 0; i < l; i++) 
-	        target[i]=EBCtoASC[(unsigned char)(source[i])];
-
+	util_ebcdic_tr(EBCtoASC, source, target, l);
 	return target;
 }
 
@@ -2,17 +2,54 @@
  * convert.cpp
  *  dump convert program required by both vmconvert and vmur
  *
- *  Copyright IBM Corp. 2004, 2008.
+ *  Copyright IBM Corp. 2004, 2013.
  *
  *  Author(s): Michael Holzheu
  */
 
 #include "vm_dump.h"
 #include "lkcd_dump.h"
+#include "elf_dump.h"
+#include "kdump_dump.h"
+
+static void
+writeDump64(Dump* vmdump, const RegisterContent64& rc,
+	    const char* outputFileName, ConvertFormat format)
+{
+	switch(format){
+		case CF_ELF:
+		{
+			ELFDump64* elfdump;
+
+			elfdump = new ELFDump64(vmdump, rc);
+			elfdump->writeDump(outputFileName);
+			delete elfdump;
+			break;
+		}
+		case CF_KDUMP:
+		{
+			KdumpDump64* kdump;
+
+			kdump = new KdumpDump64(vmdump, rc);
+			kdump->writeDump(outputFileName);
+			delete kdump;
+			break;
+		}
+		default:
+		{
+			LKCDDump64* lkcddump;
+
+			lkcddump = new LKCDDump64(vmdump, rc);
+			lkcddump->writeDump(outputFileName);
+			delete lkcddump;
+			break;
+		}
+	}
+}
 
 int
 vm_convert(const char* inputFileName, const char* outputFileName,
-	   const char* progName)
+	   const char* progName, ConvertFormat format)
 {
 /* Do the conversion */
 	try {
@@ -20,29 +57,23 @@ vm_convert(const char* inputFileName, const char* outputFileName,
 			case Dump::DT_VM64_BIG:
 			{
 				VMDump64Big* vmdump;
-				LKCDDump64* lkcddump;
 
 				vmdump = new VMDump64Big(inputFileName);
 				vmdump->printInfo();
-				lkcddump = new LKCDDump64(vmdump,
-						vmdump->getRegisterContent());
-				lkcddump->writeDump(outputFileName);
+				writeDump64(vmdump, vmdump->getRegisterContent(),
+					    outputFileName, format);
 				delete vmdump;
-				delete lkcddump;
 				break;
 			}
 			case Dump::DT_VM64:
 			{
 				VMDump64* vmdump;
-				LKCDDump64* lkcddump;
 
 				vmdump = new VMDump64(inputFileName);
 				vmdump->printInfo();
-				lkcddump = new LKCDDump64(vmdump,
-						vmdump->getRegisterContent());
-				lkcddump->writeDump(outputFileName);
+				writeDump64(vmdump, vmdump->getRegisterContent(),
+					    outputFileName, format);
 				delete vmdump;
-				delete lkcddump;
 				break;
 			}
 			case Dump::DT_VM32:
@@ -50,6 +81,10 @@ vm_convert(const char* inputFileName, const char* outputFileName,
 				VMDump32* vmdump;
 				LKCDDump32* lkcddump;
 
+				if (format != CF_LKCD)
+					throw DumpException("The elf and kdump "
+						"formats are only supported "
+						"for 64 bit vmdumps");
 				vmdump = new VMDump32(inputFileName);
 				vmdump->printInfo();
 				lkcddump = new LKCDDump32(vmdump,
@@ -7,6 +7,7 @@
  *  Author(s): Michael Holzheu
  */
 
+#include <fcntl.h>
 #include "dump.h"
 
 int debug   = 0;
@@ -30,6 +31,23 @@ Dump::Dump(const char *filename, const char *mode)
 	}
 }
 
+/* open output dump "fileName", or use stdout if "fileName" is NULL */
+int
+dump_open(const char* fileName)
+{
+	int fd;
+
+	if (fileName == NULL)
+		return STDOUT_FILENO;
+	fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1) {
+		char msg[1024];
+		sprintf(msg, "Open of dump '%s' failed.", fileName);
+		throw(DumpErrnoException(msg));
+	}
+	return fd;
+}
+
 Dump::~Dump(void)
 {
 	if(fh){
@@ -15,6 +15,8 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include "zt_common.h"
 
 extern int debug;
 
@@ -58,6 +60,12 @@ public:
 	
 	virtual void readMem(char* buf, int size) = 0;
 	virtual int  seekMem(uint64_t offset) = 0;
+	/* number of pages at "offset" (max "maxPages") known to be zero */
+	virtual uint64_t getZeroPages(uint64_t UNUSED(offset),
+				      uint64_t UNUSED(maxPages)) const
+	{
+		return 0;
+	}
 	virtual uint64_t getMemSize(void) const = 0;
 	virtual struct timeval getDumpTime(void) const = 0;
 protected:
@@ -75,8 +83,13 @@ private:
 };
 
 extern void s390TodToTimeval(uint64_t todval, struct timeval *xtime);
+extern int dump_open(const char* fileName);
+
+/* output formats of vm_convert() */
+typedef enum {CF_LKCD, CF_ELF, CF_KDUMP} ConvertFormat;
+
 extern int vm_convert(const char* inputFileName, const char* outputFileName,
-		      const char* progName);
+		      const char* progName, ConvertFormat format = CF_LKCD);
 
 static inline void dump_read(void *ptr, size_t size, size_t nmemb,
 			     FILE *stream)
@@ -91,5 +104,11 @@ static inline void dump_seek(FILE *stream, long offset, int whence)
 		throw(DumpErrnoException("fseek failed"));
 }
 
+static inline void dump_write(int fd, const void *buf, size_t size)
+{
+	if (write(fd, buf, size) != (ssize_t) size)
+		throw(DumpErrnoException("write failed"));
+}
+
 #endif /* DUMP_H */
 
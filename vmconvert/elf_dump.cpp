@@ -0,0 +1,248 @@
+/*
+ * elf_dump.cpp
+ *  elf core dump class:
+ *     - ELFDump64
+ *
+ *  Copyright IBM Corp. 2004, 2013.
+ *
+ *  Author(s): Michael Holzheu
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include "elf_dump.h"
+
+ELFDump64::ELFDump64(Dump* dump, const RegisterContent64& r)
+	: registerContent(r), loadVec(NULL), loadCnt(0)
+{
+	referenceDump = dump;
+}
+
+ELFDump64::~ELFDump64(void)
+{
+	delete[] loadVec;
+}
+
+char *
+ELFDump64::initNote(char *buf, Elf64_Word type, const void *desc,
+		    int descSize, const char *name) const
+{
+	Elf64_Nhdr note;
+	int len;
+
+	note.n_namesz = strlen(name) + 1;
+	note.n_descsz = descSize;
+	note.n_type   = type;
+	memcpy(buf, &note, sizeof(note));
+	len = sizeof(note);
+	memcpy(buf + len, name, note.n_namesz);
+	len = (len + note.n_namesz + 3) & ~3;
+	memcpy(buf + len, desc, descSize);
+	len = (len + descSize + 3) & ~3;
+	return buf + len;
+}
+
+int
+ELFDump64::getNotesSize(void) const
+{
+	return ELF_NOTES_BASE_SIZE +
+		registerContent.getNumCpus() * ELF_NOTES_CPU_SIZE;
+}
+
+/*
+ * Add prpsinfo and the register notes of all cpus to the zeroed buffer
+ * "buf" and return the end of the notes
+ */
+char *
+ELFDump64::initNotes(char *buf) const
+{
+	struct _nt_prpsinfo prpsinfo;
+	struct _nt_fpregset fpregset;
+	struct _nt_prstatus prstatus;
+	const RegisterSet64 *rs;
+	uint32_t todpreg = 0;
+	int cpu;
+
+	memset(&prpsinfo, 0, sizeof(prpsinfo));
+	prpsinfo.pr_sname = 'R';
+	strcpy(prpsinfo.pr_fname, "vmlinux");
+	buf = initNote(buf, NT_PRPSINFO, &prpsinfo, sizeof(prpsinfo), "CORE");
+
+	for (cpu = 0; cpu < registerContent.getNumCpus(); cpu++) {
+		rs = &registerContent.regSets[cpu];
+
+		memset(&prstatus, 0, sizeof(prstatus));
+		memcpy(&prstatus.psw, &rs->psw, sizeof(rs->psw));
+		memcpy(&prstatus.gprs, &rs->gprs, sizeof(rs->gprs));
+		memcpy(&prstatus.acrs, &rs->acrs, sizeof(rs->acrs));
+		prstatus.pr_pid = cpu + 1;
+		buf = initNote(buf, NT_PRSTATUS, &prstatus, sizeof(prstatus),
+			       "CORE");
+
+		memset(&fpregset, 0, sizeof(fpregset));
+		fpregset.fpc = rs->fpCr;
+		memcpy(&fpregset.fprs, &rs->fprs, sizeof(rs->fprs));
+		buf = initNote(buf, NT_FPREGSET, &fpregset, sizeof(fpregset),
+			       "CORE");
+
+		/* the vmdump does not contain the TOD programmable register */
+		buf = initNote(buf, NT_S390_TIMER, &rs->cpuTimer,
+			       sizeof(rs->cpuTimer), "LINUX");
+		buf = initNote(buf, NT_S390_TODCMP, &rs->clkCmp,
+			       sizeof(rs->clkCmp), "LINUX");
+		buf = initNote(buf, NT_S390_TODPREG, &todpreg,
+			       sizeof(todpreg), "LINUX");
+		buf = initNote(buf, NT_S390_CTRS, &rs->crs, sizeof(rs->crs),
+			       "LINUX");
+		buf = initNote(buf, NT_S390_PREFIX, &rs->prefix,
+			       sizeof(rs->prefix), "LINUX");
+	}
+	return buf;
+}
+
+/*
+ * Create the loads and return their number. Runs of pages that are known
+ * to be zero with at least "runMin" bytes end a load and are omitted from
+ * the elf file. The loads are only stored, if "fill" is set.
+ */
+int
+ELFDump64::createLoads(uint64_t runMin, int fill)
+{
+	uint64_t memSize = getMemSize(), addr = 0, start = 0, run;
+	int cnt = 0;
+
+	while (addr < memSize) {
+		run = referenceDump->getZeroPages(addr, (memSize - addr) /
+						  ELF_PAGE_SIZE) * ELF_PAGE_SIZE;
+		if (run < runMin) {
+			addr += run ? run : ELF_PAGE_SIZE;
+			continue;
+		}
+		if (fill) {
+			loadVec[cnt].addr   = start;
+			loadVec[cnt].filesz = addr - start;
+			loadVec[cnt].memsz  = addr + run - start;
+		}
+		cnt++;
+		addr += run;
+		start = addr;
+	}
+	if (start < memSize || cnt == 0) {
+		if (fill) {
+			loadVec[cnt].addr   = start;
+			loadVec[cnt].filesz = memSize - start;
+			loadVec[cnt].memsz  = memSize - start;
+		}
+		cnt++;
+	}
+	return cnt;
+}
+
+/*
+ * Only omit larger zero runs, if there would be too many program headers
+ */
+void
+ELFDump64::initLoads(void)
+{
+	uint64_t runMin = ELF_ZERO_RUN_MIN;
+
+	while ((loadCnt = createLoads(runMin, 0)) > ELF_LOAD_CNT_MAX)
+		runMin *= 2;
+	delete[] loadVec;
+	loadVec = new struct _load[loadCnt];
+	createLoads(runMin, 1);
+}
+
+/*
+ * Read the next "size" bytes of the reference dump and write them, if
+ * "doWrite" is set
+ */
+void
+ELFDump64::copyMem(int fd, char *buf, uint64_t size, uint64_t *memLoc,
+		   int doWrite)
+{
+	uint64_t len;
+
+	while (size) {
+		len = size < ELF_COPY_SIZE ? size : ELF_COPY_SIZE;
+		referenceDump->readMem(buf, (len + ELF_PAGE_SIZE - 1) &
+				       ~(ELF_PAGE_SIZE - 1));
+		if (doWrite)
+			dump_write(fd, buf, len);
+		*memLoc += len;
+		size -= len;
+		progressBar.displayProgress(*memLoc/(1024*1024),
+					    getMemSize()/(1024*1024));
+	}
+}
+
+void
+ELFDump64::writeDump(const char* fileName)
+{
+	char *hdr, *notes, *end, *buf;
+	uint64_t off, memLoc = 0;
+	Elf64_Ehdr *ehdr;
+	Elf64_Phdr *phdr;
+	int fd, i;
+
+	initLoads();
+	hdr = new char[sizeof(*ehdr) + (loadCnt + 1) * sizeof(*phdr) +
+		       getNotesSize()];
+	memset(hdr, 0, sizeof(*ehdr) + (loadCnt + 1) * sizeof(*phdr) +
+	       getNotesSize());
+
+	/* elf header */
+
+	ehdr = (Elf64_Ehdr *) hdr;
+	memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+	ehdr->e_ident[EI_CLASS]   = ELFCLASS64;
+	ehdr->e_ident[EI_DATA]    = ELFDATA2MSB;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_ident[EI_OSABI]   = ELFOSABI_SYSV;
+	ehdr->e_type      = ET_CORE;
+	ehdr->e_machine   = EM_S390;
+	ehdr->e_version   = EV_CURRENT;
+	ehdr->e_phoff     = sizeof(*ehdr);
+	ehdr->e_ehsize    = sizeof(*ehdr);
+	ehdr->e_phentsize = sizeof(*phdr);
+	ehdr->e_phnum     = loadCnt + 1;
+
+	/* program headers: notes and loads */
+
+	phdr = (Elf64_Phdr *) (ehdr + 1);
+	notes = (char *) (phdr + loadCnt + 1);
+	end = initNotes(notes);
+	phdr[0].p_type   = PT_NOTE;
+	phdr[0].p_offset = notes - hdr;
+	phdr[0].p_filesz = end - notes;
+	off = end - hdr;
+	for (i = 0; i < loadCnt; i++) {
+		phdr[i + 1].p_type   = PT_LOAD;
+		phdr[i + 1].p_offset = off;
+		phdr[i + 1].p_vaddr  = loadVec[i].addr;
+		phdr[i + 1].p_paddr  = loadVec[i].addr;
+		phdr[i + 1].p_filesz = loadVec[i].filesz;
+		phdr[i + 1].p_memsz  = loadVec[i].memsz;
+		phdr[i + 1].p_flags  = PF_R | PF_W | PF_X;
+		phdr[i + 1].p_align  = ELF_PAGE_SIZE;
+		off += loadVec[i].filesz;
+	}
+
+	fd = dump_open(fileName);
+	dump_write(fd, hdr, end - hdr);
+	delete[] hdr;
+
+	/* write memory */
+
+	buf = new char[ELF_COPY_SIZE];
+	referenceDump->seekMem(0);
+	for (i = 0; i < loadCnt; i++) {
+		copyMem(fd, buf, loadVec[i].filesz, &memLoc, 1);
+		copyMem(fd, buf, loadVec[i].memsz - loadVec[i].filesz,
+			&memLoc, 0);
+	}
+	delete[] buf;
+	fprintf(stderr, "\n");
+	if (fd != STDOUT_FILENO)
+		close(fd);
+}
@@ -0,0 +1,119 @@
+/*
+ * elf_dump.h
+ *  elf core dump class
+ *
+ *  Copyright IBM Corp. 2004, 2013.
+ *
+ *  Author(s): Michael Holzheu
+ */
+
+#ifndef ELF_DUMP_H
+#define ELF_DUMP_H
+
+#include <elf.h>
+#include "dump.h"
+#include "zt_common.h"
+#include "register_content.h"
+
+/* s390 specific note types */
+#ifndef NT_S390_TIMER
+#define NT_S390_TIMER   0x301
+#endif
+#ifndef NT_S390_TODCMP
+#define NT_S390_TODCMP  0x302
+#endif
+#ifndef NT_S390_TODPREG
+#define NT_S390_TODPREG 0x303
+#endif
+#ifndef NT_S390_CTRS
+#define NT_S390_CTRS    0x304
+#endif
+#ifndef NT_S390_PREFIX
+#define NT_S390_PREFIX  0x305
+#endif
+
+#define ELF_PAGE_SIZE       0x1000ULL
+#define ELF_NOTES_BASE_SIZE 0x400    /* size of notes without cpu notes */
+#define ELF_NOTES_CPU_SIZE  0x400    /* size of cpu notes for one cpu */
+#define ELF_ZERO_RUN_MIN    0x10000  /* minimum size of omitted zero run */
+#define ELF_LOAD_CNT_MAX    (PN_XNUM - 2)
+#define ELF_COPY_SIZE       0x100000 /* size of one read from the dump */
+
+class ELFDump64 : public Dump
+{
+public:
+	ELFDump64(Dump* dump, const RegisterContent64& rc);
+	virtual ~ELFDump64(void);
+	inline virtual void readMem(char* UNUSED(buf), int UNUSED(size)) {
+		throw(DumpException("ELFDump64::readMem() not implemented!"));
+	}
+	inline int seekMem(uint64_t UNUSED(offset)){
+		throw(DumpException("ELFDump64::seekMem() not implemented!"));
+	}
+	inline virtual uint64_t getMemSize() const
+	{
+		return referenceDump->getMemSize();
+	}
+	inline virtual struct timeval getDumpTime(void) const
+	{
+		return referenceDump->getDumpTime();
+	}
+	virtual void writeDump(const char* fileName);
+protected:
+	struct _nt_prstatus {
+		uint8_t  pad1[32];
+		uint32_t pr_pid;
+		uint8_t  pad2[76];
+		uint64_t psw[2];
+		uint64_t gprs[16];
+		uint32_t acrs[16];
+		uint64_t orig_gpr2;
+		uint32_t pr_fpvalid;
+		uint8_t  pad3[4];
+	} __attribute__((packed));
+
+	struct _nt_fpregset {
+		uint32_t fpc;
+		uint32_t pad;
+		uint64_t fprs[16];
+	} __attribute__((packed));
+
+	struct _nt_prpsinfo {
+		char     pr_state;
+		char     pr_sname;
+		char     pr_zomb;
+		char     pr_nice;
+		uint64_t pr_flag;
+		uint32_t pr_uid;
+		uint32_t pr_gid;
+		uint32_t pr_pid, pr_ppid, pr_pgrp, pr_sid;
+		char     pr_fname[16];
+		char     pr_psargs[80];
+	};
+
+	int getNotesSize(void) const;
+	char *initNotes(char *buf) const;
+
+	Dump* referenceDump;
+	RegisterContent64 registerContent;
+	ProgressBar progressBar;
+private:
+	/* load of the elf dump: memory behind "filesz" up to "memsz" is zero */
+	struct _load {
+		uint64_t addr;
+		uint64_t filesz;
+		uint64_t memsz;
+	};
+
+	char *initNote(char *buf, Elf64_Word type, const void *desc,
+		       int descSize, const char *name) const;
+	int createLoads(uint64_t runMin, int fill);
+	void initLoads(void);
+	void copyMem(int fd, char *buf, uint64_t size, uint64_t *memLoc,
+		     int doWrite);
+
+	struct _load *loadVec;
+	int loadCnt;
+};
+
+#endif /* ELF_DUMP_H */
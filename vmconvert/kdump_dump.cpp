@@ -0,0 +1,202 @@
+/*
+ * kdump_dump.cpp
+ *  kdump (makedumpfile compressed) dump class:
+ *     - KdumpDump64
+ *
+ *  Copyright IBM Corp. 2004, 2013.
+ *
+ *  Author(s): Michael Holzheu
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include "kdump_dump.h"
+
+KdumpDump64::KdumpDump64(Dump* dump, const RegisterContent64& r)
+	: ELFDump64(dump, r), pfnCnt(0), bitmapSize(0)
+{
+}
+
+/*
+ * All pages are valid. Pages that are known to be zero are not dumped.
+ * Return the number of dumped pages.
+ */
+uint64_t
+KdumpDump64::initBitmaps(char *bitmap)
+{
+	char *dumped = bitmap + bitmapSize;
+	uint64_t pfn, run, cnt = 0;
+
+	for (pfn = 0; pfn < pfnCnt; pfn++)
+		bitmap[pfn / 8] |= 1 << (pfn % 8);
+	for (pfn = 0; pfn < pfnCnt; pfn += run) {
+		run = referenceDump->getZeroPages(pfn * KDUMP_PAGE_SIZE,
+						  pfnCnt - pfn);
+		if (run == 0) {
+			dumped[pfn / 8] |= 1 << (pfn % 8);
+			cnt++;
+			run = 1;
+		}
+	}
+	return cnt;
+}
+
+/*
+ * Initialize main header and sub header with elf notes in the zeroed
+ * buffer "buf" and return the size of both headers
+ */
+uint64_t
+KdumpDump64::initHeader(char *buf)
+{
+	struct _kdump_header *hdr = (struct _kdump_header *) buf;
+	struct _kdump_sub_header *shdr;
+	uint64_t hdrSize, mapNr;
+	int cpuMax;
+	char *end;
+
+	memcpy(hdr->signature, KDUMP_SIGNATURE, sizeof(hdr->signature));
+	hdr->header_version = KDUMP_HEADER_VERSION;
+	strcpy(hdr->utsname_machine, "s390x");
+	hdr->timestamp.tv_sec  = getDumpTime().tv_sec;
+	hdr->timestamp.tv_usec = getDumpTime().tv_usec;
+	hdr->status        = KDUMP_DH_COMPRESSED_ZLIB;
+	hdr->block_size    = KDUMP_BLOCK_SIZE;
+	hdr->bitmap_blocks = 2 * bitmapSize / KDUMP_BLOCK_SIZE;
+	mapNr = pfnCnt > 0xffffffffULL ? 0xffffffffULL : pfnCnt;
+	hdr->max_mapnr     = mapNr;
+	/* the main header is followed by one task pointer per cpu */
+	cpuMax = (KDUMP_BLOCK_SIZE - sizeof(*hdr)) / sizeof(uint64_t);
+	hdr->nr_cpus = registerContent.getNumCpus();
+	if (hdr->nr_cpus < 1)
+		hdr->nr_cpus = 1;
+	if (hdr->nr_cpus > cpuMax)
+		hdr->nr_cpus = cpuMax;
+
+	shdr = (struct _kdump_sub_header *) (buf + KDUMP_BLOCK_SIZE);
+	shdr->dump_level   = KDUMP_DL_EXCLUDE_ZERO;
+	shdr->end_pfn      = mapNr;
+	shdr->end_pfn_64   = pfnCnt;
+	shdr->max_mapnr_64 = pfnCnt;
+	end = initNotes((char *) (shdr + 1));
+	shdr->offset_note = (char *) (shdr + 1) - buf;
+	shdr->size_note   = end - (char *) (shdr + 1);
+
+	hdrSize = ((end - buf) + KDUMP_BLOCK_SIZE - 1) &
+		~(KDUMP_BLOCK_SIZE - 1);
+	hdr->sub_hdr_size = hdrSize / KDUMP_BLOCK_SIZE - 1;
+	return hdrSize;
+}
+
+/*
+ * Compress "page" into "out" and return the size of the page data. If the
+ * page cannot be compressed, it is copied uncompressed.
+ */
+uint32_t
+KdumpDump64::compressPage(char *page, char *out)
+{
+	if (deflateReset(&zStream) != Z_OK)
+		throw(DumpException("gzip call failed: deflateReset"));
+	zStream.next_in   = (Bytef *) page;
+	zStream.avail_in  = KDUMP_PAGE_SIZE;
+	zStream.next_out  = (Bytef *) out;
+	zStream.avail_out = KDUMP_PAGE_SIZE;
+	if (deflate(&zStream, Z_FINISH) == Z_STREAM_END &&
+	    zStream.total_out < KDUMP_PAGE_SIZE)
+		return zStream.total_out;
+	memcpy(out, page, KDUMP_PAGE_SIZE);
+	return KDUMP_PAGE_SIZE;
+}
+
+/*
+ * The dump is written in one pass over the reference dump: The page data
+ * is written sequentially and then the page descriptors of each batch are
+ * written to their place in front of the page data. Therefore the output
+ * file has to be seekable.
+ */
+void
+KdumpDump64::writeDump(const char* fileName)
+{
+	struct _kdump_page_desc *descVec;
+	uint64_t hdrAlloc, hdrSize, descCnt, descOff, dataOff, dataLen;
+	uint64_t pfn, pages, i;
+	char *hdr, *bitmap, *pageBuf, *dataBuf;
+	uint32_t size;
+	int descNr, fd;
+
+	pfnCnt = (getMemSize() + KDUMP_PAGE_SIZE - 1) / KDUMP_PAGE_SIZE;
+	bitmapSize = ((pfnCnt + 7) / 8 + KDUMP_BLOCK_SIZE - 1) &
+		~(KDUMP_BLOCK_SIZE - 1);
+	hdrAlloc = (KDUMP_BLOCK_SIZE + sizeof(struct _kdump_sub_header) +
+		    getNotesSize() + KDUMP_BLOCK_SIZE - 1) &
+		~(KDUMP_BLOCK_SIZE - 1);
+
+	fd = dump_open(fileName);
+	if (lseek(fd, 0, SEEK_CUR) == -1)
+		throw(DumpErrnoException("kdump output must be seekable"));
+
+	/* write headers and bitmaps */
+
+	hdr = new char[hdrAlloc];
+	memset(hdr, 0, hdrAlloc);
+	bitmap = new char[2 * bitmapSize];
+	memset(bitmap, 0, 2 * bitmapSize);
+	descCnt = initBitmaps(bitmap);
+	hdrSize = initHeader(hdr);
+	dump_write(fd, hdr, hdrSize);
+	dump_write(fd, bitmap, 2 * bitmapSize);
+	delete[] hdr;
+	delete[] bitmap;
+
+	/* write page data and page descriptors */
+
+	descOff = hdrSize + 2 * bitmapSize;
+	dataOff = descOff + descCnt * sizeof(struct _kdump_page_desc);
+	if (lseek(fd, dataOff, SEEK_SET) == -1)
+		throw(DumpErrnoException("lseek failed"));
+	memset(&zStream, 0, sizeof(zStream));
+	if (deflateInit2(&zStream, Z_BEST_SPEED, Z_DEFLATED, 12, 5,
+			 Z_DEFAULT_STRATEGY) != Z_OK)
+		throw(DumpException("gzip call failed: deflateInit"));
+	pageBuf = new char[KDUMP_BATCH_PAGES * KDUMP_PAGE_SIZE];
+	dataBuf = new char[KDUMP_BATCH_PAGES * KDUMP_PAGE_SIZE];
+	descVec = new struct _kdump_page_desc[KDUMP_BATCH_PAGES];
+	referenceDump->seekMem(0);
+	for (pfn = 0; pfn < pfnCnt; pfn += pages) {
+		pages = pfnCnt - pfn < KDUMP_BATCH_PAGES ?
+			pfnCnt - pfn : KDUMP_BATCH_PAGES;
+		referenceDump->readMem(pageBuf, pages * KDUMP_PAGE_SIZE);
+		dataLen = 0;
+		descNr = 0;
+		for (i = 0; i < pages; i++) {
+			if (referenceDump->getZeroPages((pfn + i) *
+							KDUMP_PAGE_SIZE, 1))
+				continue;
+			size = compressPage(pageBuf + i * KDUMP_PAGE_SIZE,
+					    dataBuf + dataLen);
+			memset(&descVec[descNr], 0, sizeof(descVec[descNr]));
+			descVec[descNr].offset = dataOff + dataLen;
+			descVec[descNr].size   = size;
+			if (size < KDUMP_PAGE_SIZE)
+				descVec[descNr].flags =
+					KDUMP_DH_COMPRESSED_ZLIB;
+			descNr++;
+			dataLen += size;
+		}
+		dump_write(fd, dataBuf, dataLen);
+		dataOff += dataLen;
+		size = descNr * sizeof(descVec[0]);
+		if (pwrite(fd, descVec, size, descOff) != (ssize_t) size)
+			throw(DumpErrnoException("write failed"));
+		descOff += size;
+		progressBar.displayProgress((pfn + pages) * KDUMP_PAGE_SIZE /
+					    (1024*1024),
+					    getMemSize()/(1024*1024));
+	}
+	deflateEnd(&zStream);
+	delete[] pageBuf;
+	delete[] dataBuf;
+	delete[] descVec;
+	fprintf(stderr, "\n");
+	if (fd != STDOUT_FILENO)
+		close(fd);
+}
@@ -0,0 +1,95 @@
+/*
+ * kdump_dump.h
+ *  kdump (makedumpfile compressed) dump class
+ *
+ *  Copyright IBM Corp. 2004, 2013.
+ *
+ *  Author(s): Michael Holzheu
+ */
+
+#ifndef KDUMP_DUMP_H
+#define KDUMP_DUMP_H
+
+#include <zlib.h>
+#include "elf_dump.h"
+
+#define KDUMP_SIGNATURE       "KDUMP   "
+#define KDUMP_HEADER_VERSION  6
+#define KDUMP_UTS_LEN         65
+#define KDUMP_BLOCK_SIZE      0x1000ULL
+#define KDUMP_PAGE_SIZE       0x1000ULL
+#define KDUMP_BATCH_PAGES     256      /* pages read and written at once */
+
+#define KDUMP_DH_COMPRESSED_ZLIB 0x1  /* page is compressed with zlib */
+#define KDUMP_DL_EXCLUDE_ZERO    0x1  /* zero pages are not dumped */
+
+/*
+ * The kdump file consists of the main header, the sub header with the elf
+ * notes, the bitmap of valid pages, the bitmap of dumped pages, one page
+ * descriptor for each dumped page, and the page data.
+ */
+class KdumpDump64 : public ELFDump64
+{
+public:
+	KdumpDump64(Dump* dump, const RegisterContent64& rc);
+	virtual ~KdumpDump64(void){}
+	virtual void writeDump(const char* fileName);
+private:
+	struct _kdump_header {
+		char     signature[8];
+		int32_t  header_version;
+		char     utsname_sysname[KDUMP_UTS_LEN];
+		char     utsname_nodename[KDUMP_UTS_LEN];
+		char     utsname_release[KDUMP_UTS_LEN];
+		char     utsname_version[KDUMP_UTS_LEN];
+		char     utsname_machine[KDUMP_UTS_LEN];
+		char     utsname_domainname[KDUMP_UTS_LEN];
+		struct {uint64_t tv_sec;
+			uint64_t tv_usec;
+		} timestamp;
+		uint32_t status;
+		int32_t  block_size;
+		int32_t  sub_hdr_size;    /* size of sub header in blocks */
+		uint32_t bitmap_blocks;   /* size of both bitmaps in blocks */
+		uint32_t max_mapnr;
+		uint32_t total_ram_blocks;
+		uint32_t device_blocks;
+		uint32_t written_blocks;
+		uint32_t current_cpu;
+		int32_t  nr_cpus;
+	};
+
+	struct _kdump_sub_header {
+		uint64_t phys_base;
+		int32_t  dump_level;
+		int32_t  split;
+		uint64_t start_pfn;
+		uint64_t end_pfn;
+		int64_t  offset_vmcoreinfo;
+		uint64_t size_vmcoreinfo;
+		int64_t  offset_note;
+		uint64_t size_note;
+		int64_t  offset_eraseinfo;
+		uint64_t size_eraseinfo;
+		uint64_t start_pfn_64;
+		uint64_t end_pfn_64;
+		uint64_t max_mapnr_64;
+	};
+
+	struct _kdump_page_desc {
+		int64_t  offset;     /* file offset of page data */
+		uint32_t size;       /* size of page data */
+		uint32_t flags;      /* KDUMP_DH_COMPRESSED_ZLIB */
+		uint64_t page_flags;
+	};
+
+	uint64_t initBitmaps(char *bitmap);
+	uint64_t initHeader(char *buf);
+	uint32_t compressPage(char *page, char *out);
+
+	uint64_t pfnCnt;       /* number of page frames */
+	uint64_t bitmapSize;   /* size of one bitmap */
+	z_stream zStream;
+};
+
+#endif /* KDUMP_DUMP_H */
@@ -13,7 +13,6 @@
 #include <zlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include "lkcd_dump.h"
 
 LKCDDump::LKCDDump(Dump* dump, const char* arch){
@@ -63,96 +62,293 @@ LKCDDump::compressGZIP(const char *old, uint32_t old_size, char *n, uint32_t new
 	return rc;
 }
 
-	       
-void 
-LKCDDump::writeDump(const char* fileName)
-{
-	ProgressBar progressBar;
-	char dump_page_buf[DUMP_BUFFER_SIZE];
-	char dpcpage[DUMP_PAGE_SIZE];
-	char buf[DUMP_PAGE_SIZE];
-	char dump_header_buf[DUMP_HEADER_SIZE] = {};
-	uint32_t dp_size,dp_flags;
-	uint64_t mem_loc = 0;
-	ssize_t buf_loc = 0;
-	struct _dump_page dp;
-	int size, fd;
-
-	if (fileName == NULL)
-		fd = STDOUT_FILENO;
-	else {
-		fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC,
-			  S_IRUSR | S_IWUSR);
-		if (fd == -1) {
-			char msg[1024];
-			sprintf(msg, "Open of dump '%s' failed.", fileName);
-			throw(DumpErrnoException(msg));
-		}
-	}
 
-	/* write dump header */
+/*
+ * The dump is written by a pipeline: The calling thread reads batches of
+ * DUMP_BATCH_PAGES pages from the reference dump, a pool of compress
+ * threads compresses the batches, and the write thread writes them in
+ * order with one write() per batch. The batches are a ring buffer with
+ * batch "seq" in slot "seq % batchCnt".
+ */
 
-	memcpy(dump_header_buf, &dumpHeader, sizeof(dumpHeader));
-	memcpy(&dump_header_buf[sizeof(dumpHeader)], &dumpHeaderAsm,
-	       sizeof(dumpHeaderAsm));
-	if (write(fd, dump_header_buf, sizeof(dump_header_buf)) !=
-	    sizeof(dump_header_buf)) {
-		throw(DumpErrnoException("write failed"));
+void
+LKCDDump::failPipeline(const DumpException &ex)
+{
+	pthread_mutex_lock(&pipeLock);
+	if (!pipeFailed) {
+		pipeFailed = 1;
+		pipeError = ex;
 	}
+	pthread_cond_broadcast(&pipeCond);
+	pthread_mutex_unlock(&pipeLock);
+}
 
-	/* write memory */
+/* wait until batch "seq" has reached "state", return NULL on failure */
+struct LKCDDump::_batch *
+LKCDDump::waitBatch(uint64_t seq, BatchState state)
+{
+	struct _batch *batch = &batchVec[seq % batchCnt];
 
-	referenceDump->seekMem(0);
+	pthread_mutex_lock(&pipeLock);
+	while (!pipeFailed && batch->state != state)
+		pthread_cond_wait(&pipeCond, &pipeLock);
+	if (pipeFailed)
+		batch = NULL;
+	pthread_mutex_unlock(&pipeLock);
+	return batch;
+}
 
-	while (mem_loc < dumpHeader.memory_size) {
-		referenceDump->readMem(buf, DUMP_PAGE_SIZE);
-		copyRegsToPage(mem_loc,buf);
+void
+LKCDDump::setBatchState(struct _batch *batch, BatchState state)
+{
+	pthread_mutex_lock(&pipeLock);
+	batch->state = state;
+	pthread_cond_broadcast(&pipeCond);
+	pthread_mutex_unlock(&pipeLock);
+}
 
-		memset(dpcpage, 0, DUMP_PAGE_SIZE);
-		/* get the new compressed page size
-		 */
+void
+LKCDDump::readBatch(struct _batch *batch, uint64_t seq)
+{
+	uint64_t pages_left, run;
+	uint32_t i;
 
-		size = compressGZIP((char *)buf, DUMP_PAGE_SIZE, 
-				(char *)dpcpage, DUMP_PAGE_SIZE);
+	batch->seq = seq;
+	batch->memLoc = seq * DUMP_BATCH_PAGES * DUMP_PAGE_SIZE;
+	pages_left = (dumpHeader.memory_size - batch->memLoc +
+		      DUMP_PAGE_SIZE - 1) / DUMP_PAGE_SIZE;
+	batch->pages = pages_left < DUMP_BATCH_PAGES ?
+		pages_left : DUMP_BATCH_PAGES;
+	/* pages that are not stored in the reference dump are zero */
+	for (i = 0; i < batch->pages; i += run) {
+		run = referenceDump->getZeroPages(batch->memLoc +
+						  i * DUMP_PAGE_SIZE,
+						  batch->pages - i);
+		if (run == 0) {
+			batch->zero[i] = 0;
+			run = 1;
+		} else {
+			memset(&batch->zero[i], 1, run);
+		}
+	}
+	referenceDump->readMem(batch->pageBuf, batch->pages * DUMP_PAGE_SIZE);
+	for (i = 0; i < batch->pages; i++) {
+		if (copyRegsToPage(batch->memLoc + i * DUMP_PAGE_SIZE,
+				   batch->pageBuf + i * DUMP_PAGE_SIZE))
+			batch->zero[i] = 0;
+	}
+}
+
+void
+LKCDDump::compressBatch(struct _batch *batch)
+{
+	struct _dump_page dp;
+	char *page, *out;
+	uint32_t i;
+	int size;
 
+	out = batch->outBuf;
+	for (i = 0; i < batch->pages; i++) {
+		page = batch->pageBuf + i * DUMP_PAGE_SIZE;
+		if (batch->zero[i] && zeroPageSize != GZIP_NOT_COMPRESSED) {
+			/* use the zero page that has been compressed once */
+			size = zeroPageSize;
+			memcpy(out + sizeof(dp), zeroPage, size);
+		} else {
+			/* compress directly behind the page header */
+			size = compressGZIP(page, DUMP_PAGE_SIZE,
+					    out + sizeof(dp), DUMP_PAGE_SIZE);
+		}
 		/* if compression failed or compressed was ineffective,
 		 * we write an uncompressed page
 		 */
 		if (size == GZIP_NOT_COMPRESSED) {
-			dp_flags = DUMP_DH_RAW;
-			dp_size  = DUMP_PAGE_SIZE;
+			dp.flags = DUMP_DH_RAW;
+			dp.size  = DUMP_PAGE_SIZE;
+			memcpy(out + sizeof(dp), page, DUMP_PAGE_SIZE);
 		} else {
-			dp_flags = DUMP_DH_COMPRESSED;
-			dp_size  = size;
+			dp.flags = DUMP_DH_COMPRESSED;
+			dp.size  = size;
 		}
-		dp.address = mem_loc;
-		dp.size    = dp_size;
-		dp.flags   = dp_flags;
-		memcpy((void *)(dump_page_buf + buf_loc), 
-				(const void *)&dp, sizeof(dp));
-		buf_loc += sizeof(dp);
-		/* copy the page of memory
-		 */
-		if (dp_flags & DUMP_DH_COMPRESSED) {
-			/* copy the compressed page
-			 */
-			memcpy((void *)(dump_page_buf + buf_loc), 
-					(const void *)dpcpage, dp_size);
-		} else {
-			/* copy directly from memory
-			 */
-			memcpy((void *)(dump_page_buf + buf_loc), 
-					(const void *)buf, dp_size);
+		dp.address = batch->memLoc + i * DUMP_PAGE_SIZE;
+		memcpy(out, &dp, sizeof(dp));
+		out += sizeof(dp) + dp.size;
+	}
+	batch->outLen = out - batch->outBuf;
+}
+
+void
+LKCDDump::writeBatch(struct _batch *batch)
+{
+	uint64_t mem_loc;
+
+	dump_write(outFd, batch->outBuf, batch->outLen);
+	mem_loc = batch->memLoc + batch->pages * DUMP_PAGE_SIZE;
+	progressBar.displayProgress(mem_loc/(1024*1024),
+				    dumpHeader.memory_size/(1024*1024));
+}
+
+void *
+LKCDDump::compressThread(void *data)
+{
+	LKCDDump *dump = (LKCDDump *) data;
+	struct _batch *batch;
+	uint64_t seq;
+
+	while (1) {
+		/* claim the next batch, once it has been read */
+		pthread_mutex_lock(&dump->pipeLock);
+		while (1) {
+			seq = dump->compressSeq;
+			batch = &dump->batchVec[seq % dump->batchCnt];
+			if (dump->pipeFailed || seq >= dump->batchTotal ||
+			    batch->state == BATCH_READ)
+				break;
+			pthread_cond_wait(&dump->pipeCond, &dump->pipeLock);
 		}
-		buf_loc += dp_size;
-		if(write(fd, dump_page_buf, buf_loc) != buf_loc){
-			throw(DumpErrnoException("write failed"));
+		if (dump->pipeFailed || seq >= dump->batchTotal) {
+			pthread_mutex_unlock(&dump->pipeLock);
+			break;
+		}
+		dump->compressSeq++;
+		batch->state = BATCH_BUSY;
+		pthread_mutex_unlock(&dump->pipeLock);
+		try {
+			dump->compressBatch(batch);
+		} catch (DumpException ex) {
+			dump->failPipeline(ex);
+			break;
 		}
-		buf_loc = 0;
-		mem_loc += DUMP_PAGE_SIZE;
-		progressBar.displayProgress(mem_loc/(1024*1024),
-				dumpHeader.memory_size/(1024*1024));
+		dump->setBatchState(batch, BATCH_DONE);
 	}
+	return NULL;
+}
+
+void *
+LKCDDump::writeThread(void *data)
+{
+	LKCDDump *dump = (LKCDDump *) data;
+	struct _batch *batch;
+	uint64_t seq;
+
+	for (seq = 0; seq < dump->batchTotal; seq++) {
+		batch = dump->waitBatch(seq, BATCH_DONE);
+		if (!batch)
+			break;
+		try {
+			dump->writeBatch(batch);
+		} catch (DumpException ex) {
+			dump->failPipeline(ex);
+			break;
+		}
+		dump->setBatchState(batch, BATCH_FREE);
+	}
+	return NULL;
+}
+
+void
+LKCDDump::startPipeline(int fd)
+{
+	char batchZero[DUMP_PAGE_SIZE];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+
+	threadCnt = cpus < 1 ? 1 : (cpus > DUMP_THREADS_MAX ?
+				    DUMP_THREADS_MAX : cpus);
+	/* one batch for reading, one for writing, and some slack */
+	batchCnt = threadCnt + 4;
+	batchTotal = (dumpHeader.memory_size +
+		      DUMP_BATCH_PAGES * DUMP_PAGE_SIZE - 1) /
+		(DUMP_BATCH_PAGES * DUMP_PAGE_SIZE);
+	compressSeq = 0;
+	outFd = fd;
+	memset(batchZero, 0, sizeof(batchZero));
+	zeroPageSize = compressGZIP(batchZero, DUMP_PAGE_SIZE, zeroPage,
+				    DUMP_PAGE_SIZE);
+	pipeFailed = 0;
+	pthread_mutex_init(&pipeLock, NULL);
+	pthread_cond_init(&pipeCond, NULL);
+	batchVec = new struct _batch[batchCnt];
+	for (i = 0; i < batchCnt; i++) {
+		batchVec[i].state = BATCH_FREE;
+		batchVec[i].pageBuf = new char[DUMP_BATCH_PAGES *
+					       DUMP_PAGE_SIZE];
+		batchVec[i].outBuf = new char[DUMP_BATCH_PAGES *
+					      (DUMP_PAGE_SIZE +
+					       sizeof(struct _dump_page))];
+	}
+	threadVec = new pthread_t[threadCnt];
+	for (i = 0; i < threadCnt; i++) {
+		if (pthread_create(&threadVec[i], NULL, compressThread, this))
+			break;
+	}
+	threadCnt = i;
+	writeThreadStarted = (threadCnt > 0 &&
+		pthread_create(&writeThreadId, NULL, writeThread, this) == 0);
+	if (!writeThreadStarted) {
+		stopPipeline();
+		throw(DumpException("Could not create dump write threads"));
+	}
+}
+
+void
+LKCDDump::stopPipeline(void)
+{
+	int i;
+
+	if (!writeThreadStarted)
+		failPipeline(DumpException("Dump write pipeline failed"));
+	for (i = 0; i < threadCnt; i++)
+		pthread_join(threadVec[i], NULL);
+	if (writeThreadStarted)
+		pthread_join(writeThreadId, NULL);
+	for (i = 0; i < batchCnt; i++) {
+		delete[] batchVec[i].pageBuf;
+		delete[] batchVec[i].outBuf;
+	}
+	delete[] batchVec;
+	delete[] threadVec;
+	pthread_cond_destroy(&pipeCond);
+	pthread_mutex_destroy(&pipeLock);
+}
+
+void 
+LKCDDump::writeDump(const char* fileName)
+{
+	char dump_header_buf[DUMP_HEADER_SIZE] = {};
+	struct _batch *batch;
+	struct _dump_page dp;
+	uint64_t seq;
+	int fd;
+
+	fd = dump_open(fileName);
+
+	/* write dump header */
+
+	memcpy(dump_header_buf, &dumpHeader, sizeof(dumpHeader));
+	memcpy(&dump_header_buf[sizeof(dumpHeader)], &dumpHeaderAsm,
+	       sizeof(dumpHeaderAsm));
+	dump_write(fd, dump_header_buf, sizeof(dump_header_buf));
+
+	/* write memory */
+
+	referenceDump->seekMem(0);
+	startPipeline(fd);
+	for (seq = 0; seq < batchTotal; seq++) {
+		batch = waitBatch(seq, BATCH_FREE);
+		if (!batch)
+			break;
+		try {
+			readBatch(batch, seq);
+		} catch (DumpException ex) {
+			failPipeline(ex);
+			break;
+		}
+		setBatchState(batch, BATCH_READ);
+	}
+	stopPipeline();
+	if (pipeFailed)
+		throw(pipeError);
 
 	/* write end marker
 	 */
@@ -160,9 +356,7 @@ LKCDDump::writeDump(const char* fileName)
 	dp.address = 0x0;
 	dp.size    = 0x0;
 	dp.flags   = DUMP_DH_END;
-	if(write(fd, &dp, sizeof(dp)) != sizeof(dp)){
-		throw(DumpErrnoException("write failed"));
-	}
+	dump_write(fd, &dp, sizeof(dp));
 	fprintf(stderr, "\n");
 	if (fd != STDOUT_FILENO)
 		close(fd);
@@ -192,9 +386,9 @@ LKCDDump32::LKCDDump32(Dump* dump, const RegisterContent32& r)
 	registerContent = r;
 }
 
-void 
+int 
 LKCDDump32::copyRegsToPage(uint64_t offset, char *buf){
-	int cpu;
+	int cpu, copied = 0;
 	for(cpu = 0; cpu < registerContent.getNumCpus(); cpu++){
 		if(offset == registerContent.regSets[cpu].prefix){
 			memcpy(buf+0xd8,&registerContent.regSets[cpu].cpuTimer,
@@ -213,8 +407,10 @@ LKCDDump32::copyRegsToPage(uint64_t offset, char *buf){
 				sizeof(registerContent.regSets[cpu].gprs));
 			memcpy(buf+0x1c0,&registerContent.regSets[cpu].crs,
 				sizeof(registerContent.regSets[cpu].crs));
+			copied++;
 		}
 	}
+	return copied;
 }
 
 LKCDDump64::LKCDDump64(Dump* dump, const RegisterContent64& r) 
@@ -232,9 +428,9 @@ LKCDDump64::LKCDDump64(Dump* dump, const RegisterContent64& r)
 	registerContent = r;
 }
 
-void 
+int 
 LKCDDump64::copyRegsToPage(uint64_t offset, char *buf){
-	int cpu;
+	int cpu, copied = 0;
 	for(cpu = 0; cpu < registerContent.getNumCpus(); cpu++){
 		if(offset == (registerContent.regSets[cpu].prefix + 0x1000)){
 			memcpy(buf+0x328,&registerContent.regSets[cpu].cpuTimer,
@@ -255,6 +451,8 @@ LKCDDump64::copyRegsToPage(uint64_t offset, char *buf){
 				sizeof(registerContent.regSets[cpu].crs));
 			memcpy(buf+0x31c,&registerContent.regSets[cpu].fpCr,
 				sizeof(registerContent.regSets[cpu].fpCr));
+			copied++;
 		}
 	}
+	return copied;
 }
@@ -10,13 +10,13 @@
 #ifndef LKCD_DUMP_H
 #define LKCD_DUMP_H
 
+#include <pthread.h>
 #include "dump.h"
 #include "zt_common.h"
 #include "register_content.h"
 
 
 #define UTS_LEN 65
-#define DUMP_BUFFER_SIZE     0x2000  /* size of dump buffer */
 
 /* standard header definitions */
 #define DUMP_HEADER_SIZE    0x10000
@@ -42,6 +42,10 @@
 
 #define GZIP_NOT_COMPRESSED -1
 
+/* dump write pipeline */
+#define DUMP_BATCH_PAGES    256      /* pages per compress/write batch   */
+#define DUMP_THREADS_MAX    16       /* maximum number of compress threads */
+
 class LKCDDump : public Dump
 {
 public:
@@ -59,7 +63,7 @@ public:
 	}
 	virtual struct timeval getDumpTime(void) const;
 	virtual void writeDump(const char* fileName);
-	virtual void copyRegsToPage(uint64_t offset, char *buf) = 0;
+	virtual int copyRegsToPage(uint64_t offset, char *buf) = 0;
 protected:
 	struct _lkcd_dump_header {
 		uint64_t magic_number; /* dump magic number,unique to verify */
@@ -119,16 +123,60 @@ protected:
 	struct _lkcd_dump_header_asm dumpHeaderAsm;
 
 private:
+	/* state of a batch in the write pipeline */
+	typedef enum {BATCH_FREE, BATCH_READ, BATCH_BUSY, BATCH_DONE}
+		BatchState;
+
+	struct _batch {
+		uint64_t   seq;      /* sequence number of batch */
+		uint64_t   memLoc;   /* address of first page */
+		uint32_t   pages;    /* number of pages in batch */
+		BatchState state;
+		char       *pageBuf; /* uncompressed pages */
+		char       zero[DUMP_BATCH_PAGES]; /* page is known to be zero */
+		char       *outBuf;  /* page headers and (compressed) pages */
+		ssize_t    outLen;
+	};
+
 	int compressGZIP(const char *old, uint32_t old_size, char *n, 
 			uint32_t new_size);
+	void startPipeline(int fd);
+	void stopPipeline(void);
+	void failPipeline(const DumpException &ex);
+	struct _batch *waitBatch(uint64_t seq, BatchState state);
+	void setBatchState(struct _batch *batch, BatchState state);
+	void readBatch(struct _batch *batch, uint64_t seq);
+	void compressBatch(struct _batch *batch);
+	void writeBatch(struct _batch *batch);
+	static void *compressThread(void *data);
+	static void *writeThread(void *data);
+
 	Dump* referenceDump;
+
+	/* write pipeline: reader -> compress threads -> ordered writer */
+	pthread_mutex_t pipeLock;
+	pthread_cond_t  pipeCond;
+	struct _batch   *batchVec;
+	int             batchCnt;
+	uint64_t        batchTotal;   /* number of batches of the dump */
+	uint64_t        compressSeq;  /* next batch to be compressed */
+	pthread_t       *threadVec;
+	int             threadCnt;
+	pthread_t       writeThreadId;
+	int             writeThreadStarted;
+	int             outFd;
+	int             pipeFailed;
+	DumpException   pipeError;
+	ProgressBar     progressBar;
+	char            zeroPage[DUMP_PAGE_SIZE]; /* compressed zero page */
+	int             zeroPageSize;
 };
 
 class LKCDDump32 : public LKCDDump
 {
 public:
 	LKCDDump32(Dump* dump, const RegisterContent32& rc);
-	virtual void copyRegsToPage(uint64_t offset, char *buf);
+	virtual int copyRegsToPage(uint64_t offset, char *buf);
 private:
 	RegisterContent32 registerContent;
 };
@@ -137,7 +185,7 @@ class LKCDDump64 : public LKCDDump
 {
 public:
 	LKCDDump64(Dump* dump, const RegisterContent64& rc);
-	virtual void copyRegsToPage(uint64_t offset, char *buf);
+	virtual int copyRegsToPage(uint64_t offset, char *buf);
 private:
 	RegisterContent64 registerContent;
 };
@@ -20,10 +20,11 @@ static struct option longopts[] = {
 	{"help",no_argument,0,'h'},
 	{"version",no_argument,0,'v'},
 	{"output",required_argument,0,'o'},
+	{"format",required_argument,0,'F'},
 	{0,0,0,0}
 };
 
-#define OPTSTRING "f:o:vh"
+#define OPTSTRING "f:o:F:vh"
 extern char *optarg;
 
 /* Version info */
@@ -35,21 +36,27 @@ static const char copyright_notice[] = "Copyright IBM Corp. 2004, 2006";
 
 /* Usage information */
 static const char usage_text[] = \
-"Usage: vmconvert -f VMDUMPFILE [-o OUTPUTFILE]\n" \
+"Usage: vmconvert -f VMDUMPFILE [-o OUTPUTFILE] [-F FORMAT]\n" \
 "       vmconvert VMDUMPFILE [OUTPUTFILE]\n" \
 "\n" \
-"Convert a vmdump into a lkcd (linux kernel crash dumps) dump.\n" \
+"Convert a vmdump into a lkcd (linux kernel crash dumps), elf core, or\n" \
+"kdump dump.\n" \
 "\n" \
 "-h, --help                 Print this help, then exit.\n" \
 "-v, --version              Print version information, then exit.\n" \
 "-f, --file VMDUMPFILE      The vmdump file VMDUMPFILE, which should be\n"\
 "                           converted.\n" \
-"-o, --output OUTPUTFILE    The converted lkcd dump file OUTPUTFILE.\n"\
-"                           The default file name is 'dump.lkcd'.\n";
+"-o, --output OUTPUTFILE    The converted dump file OUTPUTFILE.\n"\
+"                           The default file name is 'dump.FORMAT'.\n"\
+"-F, --format FORMAT        The dump format of OUTPUTFILE: 'lkcd' (default),\n"\
+"                           'elf', or 'kdump' (makedumpfile compressed).\n"\
+"                           The elf and kdump formats require a 64 bit\n"\
+"                           vmdump.\n";
 
 /* Globals */
 char inputFileName[1024];
-char outputFileName[1024] = "dump.lkcd";
+char outputFileName[1024];
+ConvertFormat format = CF_LKCD;
 
 void 
 parseOpts(int argc, char* argv[])
@@ -68,6 +75,19 @@ parseOpts(int argc, char* argv[])
 				strcpy(outputFileName, optarg);
 				outputFileSet = 1;
 				break;
+			case 'F':
+				if (strcmp(optarg, "lkcd") == 0)
+					format = CF_LKCD;
+				else if (strcmp(optarg, "elf") == 0)
+					format = CF_ELF;
+				else if (strcmp(optarg, "kdump") == 0)
+					format = CF_KDUMP;
+				else {
+					printf("%s: invalid dump format '%s'\n",
+					       argv[0], optarg);
+					exit(1);
+				}
+				break;
 			case 'h':
 				printf("%s", usage_text);
 				exit(0);
@@ -104,6 +124,10 @@ parseOpts(int argc, char* argv[])
 		printf("%s: input file required - use '-f' option!\n",argv[0]);	
 		exit(1);
 	}
+	if(!outputFileSet){
+		static const char* const suffix[] = {"lkcd", "elf", "kdump"};
+		sprintf(outputFileName, "dump.%s", suffix[format]);
+	}
 }
 	
 int
@@ -123,7 +147,7 @@ main(int argc, char* argv[])
 		if((strcmp(answer,"y") != 0) && (strcmp(answer,"yes") != 0))
 			exit(0);
 	}
-	rc = vm_convert(inputFileName, outputFileName, argv[0]);
+	rc = vm_convert(inputFileName, outputFileName, argv[0], format);
 	if (!rc)
 		printf("'%s' has been written successfully.\n", outputFileName);
 	return rc;
@@ -207,9 +207,51 @@ VMDump::seekMem(uint64_t offset)
 	return 0;
 }
 
+/*
+ * Return the number of pages starting with page "bit" (max "maxPages")
+ * that are either all present or all absent in the page bitmap
+ */
+uint64_t
+VMDump::getPageRun(uint64_t bit, uint64_t maxPages) const
+{
+	int present = testPage(bit) ? 1 : 0;
+	char fill = present ? 0xff : 0x00;
+	uint64_t run = 0;
+
+	while (run < maxPages) {
+		/* skip full bitmap bytes */
+		if ((bit + run) % 8 == 0 && maxPages - run >= 8 &&
+		    bitmap[(bit + run) / 8] == fill) {
+			run += 8;
+			continue;
+		}
+		if ((testPage(bit + run) ? 1 : 0) != present)
+			break;
+		run++;
+	}
+	return run;
+}
+
+uint64_t
+VMDump::getZeroPages(uint64_t offset, uint64_t maxPages) const
+{
+	uint64_t bit = offset / 0x1000;
+
+	if (offset % 0x1000 != 0 || offset >= getMemSize() || testPage(bit))
+		return 0;
+	if (maxPages > (getMemSize() - offset) / 0x1000)
+		maxPages = (getMemSize() - offset) / 0x1000;
+	return getPageRun(bit, maxPages);
+}
+
+/*
+ * Read runs of present pages with one read and fill runs of absent
+ * pages with zeroes
+ */
 void
 VMDump::readMem(char* buf, int size)
 {
+	uint64_t run;
 	int i;
 
 	if(pageOffset == 0)
@@ -220,13 +262,14 @@ VMDump::readMem(char* buf, int size)
 		"can only handle sizes which are multiples of page size"));
 	}
 
-	for(i = 0; i < size; i += 0x1000) {
+	for(i = 0; i < size; i += run * 0x1000) {
+		run = getPageRun(pageOffset, (size - i) / 0x1000);
 		if(testPage(pageOffset)) {
-			dump_read(buf + i, 0x1000,1,fh);
+			dump_read(buf + i, 0x1000 * run, 1, fh);
 		} else {
-			memset(buf + i, 0, 0x1000);
+			memset(buf + i, 0, 0x1000 * run);
 		}
-		pageOffset += 1;
+		pageOffset += run;
 	}
 }
 
@@ -63,6 +63,7 @@ public:
 	virtual ~VMDump(void);
 	virtual void readMem(char* buf, int size);
 	virtual int seekMem(uint64_t offset);
+	virtual uint64_t getZeroPages(uint64_t offset, uint64_t maxPages) const;
 	virtual struct timeval getDumpTime(void) const;
 
 	void printDebug(void);
@@ -77,6 +78,7 @@ public:
 	{
 		bitmap[bit/8] |= (1 << (7-(bit % 8)));
 	}
+	uint64_t getPageRun(uint64_t bit, uint64_t maxPages) const;
 protected:
 	/* types */
 	struct _adsr {
@@ -27,6 +27,7 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "util.h"
 #include "vmcp.h"
 
 static int keep_case = 0;
@@ -145,25 +146,6 @@ static inline void linux_error(const char *message)
 	fprintf(stderr, "Error: %s: %s\n", message, strerror(errno));
 }
 
-/* Read at most COUNT bytes from FD into memory at location BUF. Return
- * number of bytes read on success, -1 on error. */
-static ssize_t read_buffer(int fd, char *buf, size_t count)
-{
-	ssize_t ret;
-	ssize_t done;
-
-	for (done = 0; done < (ssize_t) count; done += ret) {
-		ret = read(fd, &buf[done], count - done);
-		if (ret == -1 && errno == EINTR)
-			continue;
-		if (ret == -1)
-			return -1;
-		if (ret == 0)
-			break;
-	}
-	return done;
-}
-
 /* Write COUNT bytes to FD from memory at location BUF. Return number of bytes
  * written on success, -1 otherwise. */
 static ssize_t write_buffer(int fd, const char *buf, size_t count)
@@ -185,11 +167,9 @@ static ssize_t write_buffer(int fd, const char *buf, size_t count)
 
 int main(int argc, char **argv)
 {
-	int ret;
-	int fd;
+	struct util_vmcp vmcp;
 	int response_code;
-	int response_size;
-	char *buffer;
+	int ret;
 
 	ret = parse_args(argc, argv);
 	if (ret != VMCP_OK)
@@ -198,64 +178,33 @@ int main(int argc, char **argv)
 	if (!keep_case)
 		uppercase(command);
 
-	buffer = malloc(buffersize);
-	if (!buffer) {
-		linux_error("Could not allocate return buffer");
-		return VMCP_LIN;
-	}
-	fd = open(DEVICE_NODE, O_RDWR);
-	if (fd == -1) {
+	if (util_vmcp_open(&vmcp)) {
 		linux_error("Could not open device " DEVICE_NODE);
-		free(buffer);
 		return VMCP_LIN;
 	}
-	if (ioctl(fd, VMCP_SETBUF, &buffersize) == -1) {
+	if (util_vmcp_set_buf(&vmcp, buffersize)) {
 		linux_error("Could not set buffer size");
-		free(buffer);
-		close(fd);
+		util_vmcp_close(&vmcp);
 		return VMCP_LIN;
 	}
-	if (write(fd, command, strlen(command)) == -1) {
+	if (util_vmcp_cmd(&vmcp, command, 0, &response_code)) {
 		linux_error("Could not issue CP command");
-		free(buffer);
-		close(fd);
-		return VMCP_LIN;
-	}
-	if (ioctl(fd, VMCP_GETCODE, &response_code) == -1) {
-		linux_error("Could not query return code");
-		free(buffer);
-		close(fd);
-		return VMCP_LIN;
-	}
-	if (ioctl(fd, VMCP_GETSIZE, &response_size) == -1) {
-		linux_error("Could not query response size");
-		free(buffer);
-		close(fd);
-		return VMCP_LIN;
-	}
-	ret = read_buffer(fd, buffer, buffersize);
-	if (ret == -1) {
-		linux_error("Could not read CP response");
-		free(buffer);
-		close(fd);
+		util_vmcp_close(&vmcp);
 		return VMCP_LIN;
 	}
-	write_buffer(STDOUT_FILENO, buffer, ret);
-	if (response_size > buffersize) {
+	write_buffer(STDOUT_FILENO, vmcp.buf, vmcp.resp_len);
+	if (vmcp.resp_size > vmcp.resp_len) {
 		fprintf(stderr, "Error: output (%d bytes) was truncated, try "
-			"--buffer to increase size\n", response_size);
-		free(buffer);
-		close(fd);
+			"--buffer to increase size\n", vmcp.resp_size);
+		util_vmcp_close(&vmcp);
 		return VMCP_BUF;
 	}
 	if (response_code > 0) {
 		fprintf(stderr, "Error: non-zero CP response for command '%s': "
 			"#%d\n", command, response_code);
-		free(buffer);
-		close(fd);
+		util_vmcp_close(&vmcp);
 		return VMCP_CP;
 	}
-	free(buffer);
-	close(fd);
+	util_vmcp_close(&vmcp);
 	return VMCP_OK;
 }
@@ -17,10 +17,6 @@
 
 #define DEVICE_NODE "/dev/vmcp"
 
-#define VMCP_GETCODE _IOR(0x10, 1, int)
-#define VMCP_SETBUF _IOW(0x10, 2, int)
-#define VMCP_GETSIZE _IOR(0x10, 3, int)
-
 #define MAXBUFFER 1048576
 #define MINBUFFER 4096
 #define MAXCMDLEN 240
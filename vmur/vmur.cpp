@@ -20,16 +20,17 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <signal.h>
-#include <iconv.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <pthread.h>
 #include <ctype.h>
 #include <linux/types.h>
 #include "zt_common.h"
+#include "util.h"
 #include "vmur.h"
 #include "dump.h"
 
@@ -73,13 +74,21 @@ struct vmur {
 	int   stdout_specified;
 	int   hold_specified;
 	int   convert_specified;
+	int   all_specified;
+	char  directory[PATH_MAX];
+	int   directory_specified;
 	enum  ur_action action;
 	int   devno;
 	int   ur_reclen;
 	int   file_reclen;
 	enum spoolfile_fmt spoolfile_fmt;
 	struct sigaction sigact;
-	iconv_t iconv;
+	struct util_ebcdic conv;
+	char  line_buf[VMUR_LINE_BUF_SIZE];
+	size_t line_buf_pos;
+	size_t line_buf_end;
+	char  *out_buf;
+	size_t out_buf_size;
 } vmur_info;
 
 /*
@@ -140,6 +149,7 @@ static char *to_valid_linux_name(char *str)
 
 static char HELP_TEXT[] =
 "Usage: vmur receive [OPTIONS] [SPOOLID] [FILE]\n"
+"       vmur receive [OPTIONS] --all\n"
 "       vmur punch   [OPTIONS] [FILE]\n"
 "       vmur print   [OPTIONS] [FILE]\n"
 "       vmur purge   [OPTIONS] [SPOOLID]\n"
@@ -171,6 +181,9 @@ static char HELP_TEXT[] =
 "-O, --stdout             Write spool file to stdout.\n"
 "-f, --force              Overwrite files without prompt.\n"
 "-H, --hold               Hold spool file in reader after receive.\n"
+"-a, --all                Receive all files of the reader queue.\n"
+"-D, --directory          Target directory for --all. If omitted, the\n"
+"                         current directory is used.\n"
 "\n"
 "Options for 'punch' and 'print' command:\n"
 "\n"
@@ -225,24 +238,6 @@ fail:
 	ERR_EXIT("Could not initialize signal handler (errno = %i)\n", errno);
 }
 
-/*
- * Read at most COUNT bytes from FD into memory at location BUF.
- * Return number of bytes read on success, -1 on error.
- */
-static ssize_t read_buf(int fd, char *buf, ssize_t count)
-{
-	ssize_t rc, len;
-
-	for (len = 0; len < count; len += rc) {
-		rc = read(fd, &buf[len], count - len);
-		if (rc == -1)
-			return -1;
-		if (rc == 0)
-			break;
-	}
-	return len;
-}
-
 /*
  * Strip leading CP header from error message
  */
@@ -273,70 +268,56 @@ static void cperr_exit(char *cpcmd, int cprc, char *buf)
 	ERR_EXIT("%s\n", buf);
 }
 
+/*
+ * Open the CP command session on first use, it is used for all commands
+ */
+static struct util_vmcp *vmcp_session(char *cmd)
+{
+	static struct util_vmcp vmcp;
+	static int vmcp_open;
+
+	if (vmcp_open)
+		return &vmcp;
+	if (util_vmcp_open(&vmcp) || util_vmcp_set_buf(&vmcp, VMCP_BUFSIZE))
+		ERR_EXIT("Could not issue cp command: \"%s\"\n"
+			 "Ensure that vmcp kernel module is loaded!\n", cmd);
+	vmcp_open = 1;
+	return &vmcp;
+}
+
 static void _cpcmd(char *cpcmd, char **resp, int *rc, int retry, int upper)
 {
-	int fd, len, cprc, bufsize = VMCP_BUFSIZE;
-	char *buf;
+	struct util_vmcp *vmcp;
 	char cmd[MAXCMDLEN];
+	int cprc;
 
 	strcpy(cmd, cpcmd);
 	if (upper)
 		to_upper(cmd);
 
-	fd = open(VMCP_DEVICE_NODE, O_RDWR);
-	if (fd == -1)
-		ERR_EXIT("Could not issue cp command: \"%s\"\n"
-			 "Ensure that vmcp kernel module is loaded!\n", cmd);
-
-	do {
-		if (ioctl(fd, VMCP_SETBUF, &bufsize) == -1)
-			goto fail;
-
-		if (write(fd, cmd, strlen(cmd)) == -1)
-			goto fail;
-
-		if (ioctl(fd, VMCP_GETCODE, &cprc) == -1)
-			goto fail;
-
-		if (ioctl(fd, VMCP_GETSIZE, &len) == -1)
-			goto fail;
-
-		if (len <= bufsize)
-			break;
-		else if (retry)
-			bufsize = len;
-		else
-			ERR_EXIT("Not enough buffer space (%i/%i) for CP "
-				 "command '%s'.\nSorry, please issue command "
-				 "on your 3270 console!\n", len, bufsize, cmd);
-	} while (1);
-
-	buf = (char *) malloc(len + 1);
-	if (!buf)
-		ERR_EXIT("Out of memory for CP command '%s'\n", cmd);
-
-	memset(buf, 0, len + 1);
-	if (read_buf(fd, buf, len) == -1)
-		goto fail;
+	vmcp = vmcp_session(cmd);
+	if (util_vmcp_cmd(vmcp, cmd, retry, &cprc))
+		ERR_EXIT("CP command '%s' failed.\n", cmd);
+	if (vmcp->resp_size > vmcp->resp_len)
+		ERR_EXIT("Not enough buffer space (%i/%i) for CP "
+			 "command '%s'.\nSorry, please issue command "
+			 "on your 3270 console!\n", vmcp->resp_size,
+			 vmcp->buf_size, cmd);
 
 	if (rc == NULL) {
 		if (cprc != 0) {
 			/* caller wants us to handle the error */
-			cperr_exit(cmd, cprc, buf);
+			cperr_exit(cmd, cprc, vmcp->buf);
 		}
 	} else {
 		*rc = cprc;
 	}
 
-	if (resp)
-		*resp = buf;
-	else
-		free(buf);
-	close(fd);
-	return;
-
-fail:
-	ERR_EXIT("CP command '%s' failed.\n", cmd);
+	if (resp) {
+		*resp = strdup(vmcp->buf);
+		if (!*resp)
+			ERR_EXIT("Out of memory for CP command '%s'\n", cmd);
+	}
 }
 
 /*
@@ -365,6 +346,32 @@ static void cpcmd_cs(char *cpcmd, char **resp, int *rc, int retry)
 	_cpcmd(cpcmd, resp, rc, retry, 0);
 }
 
+/*
+ * Issue   CP commands one after the other until a command fails:
+ * @cmd_vec: CP commands to be issued, already in uppercase.
+ * @cnt:     Number of CP commands.
+ * @rc:      CP return code of the last issued command.
+ * Return the number of successful commands. If rc is NULL, this function
+ * exits on error.
+ */
+static int cpcmd_vec(char *cmd_vec[], int cnt, int *rc)
+{
+	struct util_vmcp *vmcp;
+	int i, cprc;
+
+	vmcp = vmcp_session(cmd_vec[0]);
+	i = util_vmcp_cmd_vec(vmcp, cmd_vec, cnt, &cprc);
+	if (i == -1)
+		ERR_EXIT("CP command '%s' failed.\n", cmd_vec[0]);
+	if (rc == NULL) {
+		if (i < cnt)
+			cperr_exit(cmd_vec[i], cprc, vmcp->buf);
+	} else {
+		*rc = cprc;
+	}
+	return i;
+}
+
 /*
  * Extract minor from sysfs file
  */
@@ -620,9 +627,11 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		{ "convert",     no_argument,       NULL, 'c'},
 		{ "device",      required_argument, NULL, 'd'},
 		{ "blocked",     required_argument, NULL, 'b'},
+		{ "all",         no_argument,       NULL, 'a'},
+		{ "directory",   required_argument, NULL, 'D'},
 		{ 0,             0,                 0,    0  }
 	};
-	static const char option_string[] = "vhtOfHcd:b:";
+	static const char option_string[] = "vhtOfHcad:b:D:";
 
 	strcpy(info->devnode, VMRDR_DEVICE_NODE);
 	while (1) {
@@ -655,12 +664,35 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		case 'c':
 			++info->convert_specified;
 			break;
+		case 'a':
+			++info->all_specified;
+			break;
+		case 'D':
+			++info->directory_specified;
+			strncpy(info->directory, optarg,
+				sizeof(info->directory) - 1);
+			break;
 		default:
 			std_usage_exit();
 		}
 	}
 
-	set_spoolid(info, argv, argc, optind + 1, 1);
+	CHECK_SPEC_MAX(info->all_specified, 1, "all");
+	CHECK_SPEC_MAX(info->directory_specified, 1, "directory");
+	if (info->directory_specified && !info->all_specified)
+		ERR_EXIT("--directory without --all specified\n");
+	if (info->all_specified) {
+		if (argc > optind + 1)
+			ERR_EXIT("Spool id or file not allowed, when --all "
+				 "specified!\n");
+		if (info->stdout_specified)
+			ERR_EXIT("Conflicting options: --all together with "
+				 "--stdout specified\n");
+		if (!info->directory_specified)
+			strcpy(info->directory, ".");
+	}
+
+	set_spoolid(info, argv, argc, optind + 1, !info->all_specified);
 	set_file(info, argv, argc, optind + 2);
 
 	CHECK_SPEC_MAX(info->text_specified, 1, "text");
@@ -1111,12 +1143,12 @@ static void check_hold_state(char *spoolid)
  */
 static void order_change_reader_file(struct vmur *info)
 {
-	char cmd[MAXCMDLEN];
+	char order[MAXCMDLEN], change[MAXCMDLEN];
+	char *cmd_vec[] = {order, change};
 
-	sprintf(cmd, "ORDER * READER %s", info->spoolid);
-	cpcmd(cmd, NULL, NULL, 0);
-	sprintf(cmd, "CHANGE * READER %s NOHOLD", info->spoolid);
-	cpcmd(cmd, NULL, NULL, 0);
+	sprintf(order, "ORDER * READER %s", info->spoolid);
+	sprintf(change, "CHANGE * READER %s NOHOLD", info->spoolid);
+	cpcmd_vec(cmd_vec, 2, NULL);
 
 	check_hold_state(info->spoolid);
 }
@@ -1335,7 +1367,8 @@ static int convert_text(struct vmur *info, struct splink_record *rec,
 	if ((rec->ccw.data_len == 1) && (data_ptr[0] == 0x40))
 		goto out; /* one blank -> just a newline */
 
-	rc = iconv(info->iconv, &data_ptr, &in_count, out_ptr, &out_count);
+	rc = util_ebcdic_conv(&info->conv, &data_ptr, &in_count, out_ptr,
+			      &out_count);
 	if ((rc == -1) || (in_count != 0)) {
 		ERR("Code page translation EBCDIC-ASCII failed\n");
 		return -1;
@@ -1422,7 +1455,7 @@ ssize_t convert_sfdata(struct vmur *info, struct splink_page *in, char *out)
 		if (info->text_specified) {
 			rc = convert_text(info, rec, &out_ptr);
 			if (rc)
-				return rc;
+				return -1;
 		} else if (info->blocked_specified) {
 			convert_blocked(info, rec, &out_ptr);
 		} else
@@ -1433,35 +1466,61 @@ ssize_t convert_sfdata(struct vmur *info, struct splink_page *in, char *out)
 }
 
 /*
- * Write normal spool file data.
+ * Make sure that the output buffer can hold "size" bytes. The buffer is
+ * reused for all blocks of a spool file and only grows when needed.
+ */
+static int out_buf_reserve(struct vmur *info, size_t size)
+{
+	char *buf;
+
+	if (size <= info->out_buf_size)
+		return 0;
+	if (size < READ_BLOCKS * sizeof(struct splink_page))
+		size = READ_BLOCKS * sizeof(struct splink_page);
+	buf = (char *) realloc(info->out_buf, size);
+	if (!buf)
+		return -ENOMEM;
+	info->out_buf = buf;
+	info->out_buf_size = size;
+	return 0;
+}
+
+/*
+ * Write normal spool file data: Convert all blocks into the output buffer
+ * and write them with one system call.
  */
 int write_normal(struct vmur *info, struct splink_page *sfdata, int count,
 		 int fho)
 {
-	char *outbuf;
-	int len, i;
+	size_t size = 0, pos = 0;
+	ssize_t len;
+	int i;
 
+	for (i = 0; i < count; i++)
+		size += (size_t) (info->file_reclen + 1) * sfdata[i].data_recs;
+	if (out_buf_reserve(info, size)) {
+		ERR("Out of memory\n");
+		return -ENOMEM;
+	}
 	for (i = 0; i < count; i++) {
-		struct splink_page *data;
-
-		data = &sfdata[i];
-		outbuf = (char *) malloc((info->file_reclen + 1) *
-					 data->data_recs);
-		if (!outbuf) {
-			ERR("Out of memory\n");
-			return -ENOMEM;
-		}
-		len = convert_sfdata(info, data, outbuf);
+		len = convert_sfdata(info, &sfdata[i], info->out_buf + pos);
 		if (len < 0) {
 			ERR("Data conversion failed\n");
 			return -EINVAL;
 		}
-		if (write(fho, outbuf, len) == -1) {
+		pos += len;
+	}
+	for (size = 0; size < pos; size += len) {
+		len = write(fho, info->out_buf + size, pos - size);
+		if (len == -1) {
+			if (errno == EINTR) {
+				len = 0;
+				continue;
+			}
 			ERR("Write to file %s failed: %s\n", info->file_name,
 			    strerror(errno));
 			return -errno;
 		}
-		free(outbuf);
 	}
 
 	return 0;
@@ -1604,6 +1663,9 @@ static void ur_receive(struct vmur *info)
 	if (fho != STDOUT_FILENO)
 		close(fho);
 	close(fhi);
+	free(info->out_buf);
+	info->out_buf = NULL;
+	info->out_buf_size = 0;
 vm_convert_done:
 	if (info->hold_specified)
 		close_reader(info, "HOLD");
@@ -1616,6 +1678,445 @@ fail:
 	exit(1);
 }
 
+/*
+ * Receive all reader files: The read thread orders the reader files one
+ * after the other and reads them from the reader device, while the write
+ * thread converts and writes the previously read data.
+ */
+static struct {
+	struct rdr_file *file_vec;
+	int file_cnt;
+	struct rcv_buf buf_vec[RECEIVE_BUFS];
+	int buf_head;   /* next buffer to fill */
+	int buf_tail;   /* next buffer to write */
+	int buf_cnt;    /* number of filled buffers */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} rcv;
+
+/*
+ * Get the next free read buffer, wait if all buffers are filled
+ */
+static struct rcv_buf *rcv_buf_get_free(void)
+{
+	struct rcv_buf *buf;
+
+	pthread_mutex_lock(&rcv.lock);
+	while (rcv.buf_cnt == RECEIVE_BUFS)
+		pthread_cond_wait(&rcv.cond, &rcv.lock);
+	buf = &rcv.buf_vec[rcv.buf_head];
+	pthread_mutex_unlock(&rcv.lock);
+	return buf;
+}
+
+/*
+ * Pass the buffer returned by rcv_buf_get_free() to the write thread
+ */
+static void rcv_buf_put_full(void)
+{
+	pthread_mutex_lock(&rcv.lock);
+	rcv.buf_head = (rcv.buf_head + 1) % RECEIVE_BUFS;
+	rcv.buf_cnt++;
+	pthread_cond_broadcast(&rcv.cond);
+	pthread_mutex_unlock(&rcv.lock);
+}
+
+/*
+ * Get the next filled read buffer, wait if there is none
+ */
+static struct rcv_buf *rcv_buf_get_full(void)
+{
+	struct rcv_buf *buf;
+
+	pthread_mutex_lock(&rcv.lock);
+	while (rcv.buf_cnt == 0)
+		pthread_cond_wait(&rcv.cond, &rcv.lock);
+	buf = &rcv.buf_vec[rcv.buf_tail];
+	pthread_mutex_unlock(&rcv.lock);
+	return buf;
+}
+
+/*
+ * Give the buffer returned by rcv_buf_get_full() back to the read thread
+ */
+static void rcv_buf_put_free(void)
+{
+	pthread_mutex_lock(&rcv.lock);
+	rcv.buf_tail = (rcv.buf_tail + 1) % RECEIVE_BUFS;
+	rcv.buf_cnt--;
+	pthread_cond_broadcast(&rcv.cond);
+	pthread_mutex_unlock(&rcv.lock);
+}
+
+/*
+ * Read one reader file and pass its data to the write thread. The file is
+ * closed with HOLD, it is purged after it has been written successfully.
+ * Return -1, if the batch has to be stopped.
+ */
+static int rcv_read_file(struct vmur *info, struct rdr_file *file)
+{
+	char order[MAXCMDLEN], change[MAXCMDLEN];
+	char *cmd_vec[] = {order, change};
+	int fhi, count, cnt, cprc, rc = 0;
+	struct rcv_buf *buf;
+
+	/* Only files with user hold state have to be changed */
+	sprintf(order, "ORDER * READER %s", file->spoolid);
+	sprintf(change, "CHANGE * READER %s NOHOLD", file->spoolid);
+	cnt = strcmp(file->hold, "NONE") != 0 ? 2 : 1;
+	rc = cpcmd_vec(cmd_vec, cnt, &cprc);
+	if (rc < cnt) {
+		ERR("Skipping spool file %s: CP command '%s' failed with "
+		    "rc=%i\n", file->spoolid, cmd_vec[rc], cprc);
+		return 0;
+	}
+	rc = 0;
+
+	fhi = open(info->devnode, O_RDONLY | O_NONBLOCK);
+	if (fhi == -1) {
+		ERR("Could not open device %s\n%s\n", info->devnode,
+		    strerror(errno));
+		return -1;
+	}
+	buf = rcv_buf_get_free();
+	buf->file = file;
+	buf->eof = 0;
+	buf->converted = 0;
+	count = read(fhi, buf->sfdata, sizeof(buf->sfdata));
+	if (count > 0 && buf->sfdata[0].magic == 0 &&
+	    buf->sfdata[0].spoolid != atoi(file->spoolid)) {
+		ERR("Could not receive spool file %s. Spoolid mismatch (%i)\n",
+		    file->spoolid, buf->sfdata[0].spoolid);
+		close(fhi);
+		close_reader(info, "HOLD");
+		return -1;
+	}
+	if (count > 0 && buf->sfdata[0].magic != 0 &&
+	    info->convert_specified) {
+		close(fhi);
+		buf->converted = 1;
+		file->tmp = 1;
+		rc = vm_convert(info->devnode, file->tmp_path, prog_name);
+		count = 0;
+		goto out;
+	}
+	while (count > 0) {
+		buf->blocks = count / sizeof(buf->sfdata[0]);
+		rcv_buf_put_full();
+		buf = rcv_buf_get_free();
+		buf->file = file;
+		buf->eof = 0;
+		buf->converted = 0;
+		count = read(fhi, buf->sfdata, sizeof(buf->sfdata));
+	}
+	if (count == -1) {
+		ERR("Could not read from device %s\n%s\n", info->devnode,
+		    strerror(errno));
+		rc = -1;
+	}
+	close(fhi);
+out:
+	close_reader(info, "HOLD");
+	buf->blocks = 0;
+	buf->eof = 1;
+	buf->rc = rc;
+	rcv_buf_put_full();
+	return count == -1 ? -1 : 0;
+}
+
+/*
+ * Read thread: Read all reader files that have not been skipped
+ */
+static void *rcv_read_thread(void *arg)
+{
+	struct vmur *info = (struct vmur *) arg;
+	struct rcv_buf *buf;
+	int i;
+
+	for (i = 0; i < rcv.file_cnt; i++) {
+		if (rcv.file_vec[i].skip)
+			continue;
+		if (rcv_read_file(info, &rcv.file_vec[i]))
+			break;
+	}
+	buf = rcv_buf_get_free();
+	buf->file = NULL;
+	rcv_buf_put_full();
+	return NULL;
+}
+
+/*
+ * Remove temporary files of reader files that have not been received
+ * completely, for example after a signal or an error exit
+ */
+static void rcv_tmp_cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < rcv.file_cnt; i++) {
+		if (rcv.file_vec[i].tmp)
+			unlink(rcv.file_vec[i].tmp_path);
+	}
+}
+
+/*
+ * Rename the temporary file of a received reader file to its final name.
+ * If the file has not been received successfully, remove it instead.
+ * Return 0, if the file is complete.
+ */
+static int rcv_tmp_finish(struct rdr_file *file, int failed)
+{
+	if (!file->tmp)
+		return -1;
+	if (!failed && rename(file->tmp_path, file->path) == -1) {
+		ERR("Could not rename file %s to %s\n%s\n", file->tmp_path,
+		    file->path, strerror(errno));
+		failed = 1;
+	}
+	if (failed)
+		unlink(file->tmp_path);
+	file->tmp = 0;
+	return failed ? -1 : 0;
+}
+
+/*
+ * Write thread: Convert and write the data of all read reader files
+ */
+static void rcv_write(struct vmur *info)
+{
+	struct rdr_file *file = NULL;
+	enum spoolfile_fmt type = TYPE_NORMAL;
+	struct rcv_buf *buf;
+	int fho = -1, failed = 0;
+
+	while (1) {
+		buf = rcv_buf_get_full();
+		if (!buf->file)
+			break;
+		if (buf->file != file) {
+			file = buf->file;
+			strcpy(info->file_name, file->path);
+			failed = 0;
+			type = TYPE_NORMAL;
+			if (buf->blocks)
+				type = get_spoolfile_fmt(info, &buf->sfdata[0]);
+			if (type == TYPE_VMDUMP && !buf->converted)
+				ERR("INFO: Reader file %s has VMDUMP format.\n",
+				    file->spoolid);
+			if (type == TYPE_NETDATA)
+				ERR("INFO: Reader file %s has NETDATA format.\n",
+				    file->spoolid);
+			if (!buf->converted) {
+				fho = open(file->tmp_path,
+					   O_WRONLY | O_CREAT | O_TRUNC,
+					   S_IRUSR | S_IWUSR);
+				if (fho == -1) {
+					ERR("Could not open file %s\n%s\n",
+					    file->tmp_path, strerror(errno));
+					failed = 1;
+				} else {
+					file->tmp = 1;
+				}
+			}
+		}
+		if (buf->blocks && !failed) {
+			if (type == TYPE_VMDUMP)
+				failed = write_vmdump(info, buf->sfdata,
+						      buf->blocks, fho);
+			else
+				failed = write_normal(info, buf->sfdata,
+						      buf->blocks, fho);
+		}
+		if (buf->eof) {
+			if (fho != -1)
+				close(fho);
+			fho = -1;
+			if (rcv_tmp_finish(file, failed || buf->rc) == 0)
+				file->done = 1;
+		}
+		rcv_buf_put_free();
+	}
+}
+
+/*
+ * Build the list of reader files from the response of
+ * QUERY RDR * ALL SHORTDATE
+ */
+static void rcv_file_list_init(struct vmur *info)
+{
+	char cmd[MAXCMDLEN], *buf, *line, *next, name[9], type[9];
+	struct rdr_file *file;
+	int cnt = 0, len, i;
+
+	strcpy(cmd, "QUERY RDR * ALL SHORTDATE");
+	cpcmd(cmd, &buf, NULL, 1);
+	for (line = buf; *line; line++)
+		cnt += (*line == '\n');
+	rcv.file_vec = (struct rdr_file *) calloc(cnt + 1, sizeof(*file));
+	if (!rcv.file_vec)
+		ERR_EXIT("Out of memory\n");
+
+	for (line = buf; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		if (strlen(line) < RDR_COL_HOLD + 4)
+			continue;
+		for (i = 0; i < 4; i++)
+			if (!isdigit(line[RDR_COL_SPOOLID + i]))
+				break;
+		if (i < 4)
+			continue; /* header line */
+		file = &rcv.file_vec[rcv.file_cnt++];
+		memcpy(file->spoolid, &line[RDR_COL_SPOOLID], 4);
+		file->class_ = line[RDR_COL_CLASS];
+		memcpy(file->hold, &line[RDR_COL_HOLD], 4);
+		strstrip(file->hold);
+		memset(name, 0, sizeof(name));
+		memset(type, 0, sizeof(type));
+		if (strlen(line) > RDR_COL_NAME)
+			strncpy(name, &line[RDR_COL_NAME], 8);
+		if (strlen(line) > RDR_COL_TYPE)
+			strncpy(type, &line[RDR_COL_TYPE], 8);
+		strstrip(name);
+		strstrip(type);
+		/* unnamed spool files get their spoolid as name */
+		if (strlen(name) == 0)
+			strcpy(name, file->spoolid);
+		to_valid_linux_name(name);
+		to_valid_linux_name(type);
+		if (strlen(type) == 0)
+			len = snprintf(file->path, sizeof(file->path), "%s/%s",
+				       info->directory, name);
+		else
+			len = snprintf(file->path, sizeof(file->path),
+				       "%s/%s.%s", info->directory, name, type);
+		if (len >= (int) sizeof(file->path)) {
+			ERR("Skipping spool file %s: Path name in directory "
+			    "%s is too long\n", file->spoolid, info->directory);
+			file->skip = 1;
+		}
+	}
+	free(buf);
+}
+
+/*
+ * Skip files that cannot be received. Spool files with the same name get
+ * their spoolid appended to the output file name.
+ */
+static void rcv_file_list_check(struct vmur *info)
+{
+	char cmd[MAXCMDLEN], device_class, *buf;
+	struct rdr_file *file;
+	struct stat stat_info;
+	int i, j, len, too_long;
+
+	sprintf(cmd, "QUERY VIRTUAL %X", info->devno);
+	cpcmd(cmd, &buf, NULL, 0);
+	device_class = buf[13];
+	free(buf);
+
+	for (i = 0; i < rcv.file_cnt; i++) {
+		file = &rcv.file_vec[i];
+		if (file->skip)
+			continue; /* path name is too long */
+		too_long = 0;
+		for (j = 0; j < i; j++) {
+			if (strcmp(rcv.file_vec[j].path, file->path) != 0)
+				continue;
+			len = strlen(file->path);
+			if (snprintf(file->path + len, sizeof(file->path) - len,
+				     ".%s", file->spoolid) >=
+			    (int) (sizeof(file->path) - len))
+				too_long = 1;
+			break;
+		}
+		if (snprintf(file->tmp_path, sizeof(file->tmp_path), "%s%s",
+			     file->path, RECEIVE_TMP_SUFFIX) >=
+		    (int) sizeof(file->tmp_path))
+			too_long = 1;
+		if (too_long) {
+			ERR("Skipping spool file %s: Path name in directory "
+			    "%s is too long\n", file->spoolid, info->directory);
+			file->skip = 1;
+		} else if (device_class != '*' && device_class != file->class_) {
+			ERR("Skipping spool file %s: Class %c does not match "
+			    "reader device class %c\n", file->spoolid,
+			    file->class_, device_class);
+			file->skip = 1;
+		} else if (strcmp(file->hold, "NONE") != 0 &&
+			   strcmp(file->hold, "USER") != 0) {
+			ERR("Skipping spool file %s: hold state = %s\n",
+			    file->spoolid, file->hold);
+			file->skip = 1;
+		} else if (!info->force_specified &&
+			   stat(file->path, &stat_info) == 0) {
+			ERR("Skipping spool file %s: File %s already exists\n",
+			    file->spoolid, file->path);
+			file->skip = 1;
+		}
+	}
+}
+
+/*
+ * Purge all received files with as few CP commands as possible
+ */
+static void rcv_purge_done(void)
+{
+	char cmd[MAXCMDLEN];
+	int i, len = 0;
+
+	for (i = 0; i < rcv.file_cnt; i++) {
+		if (!rcv.file_vec[i].done)
+			continue;
+		if (len && len + 5 >= MAXCMDLEN) {
+			cpcmd(cmd, NULL, NULL, 0);
+			len = 0;
+		}
+		if (!len)
+			len = sprintf(cmd, "PURGE * READER");
+		len += sprintf(cmd + len, " %s", rcv.file_vec[i].spoolid);
+	}
+	if (len)
+		cpcmd(cmd, NULL, NULL, 0);
+}
+
+/*
+ * Receive all reader files to the target directory
+ */
+static void ur_receive_all(struct vmur *info)
+{
+	pthread_t thread;
+	int i, cnt = 0;
+
+	acquire_lock(info);
+	close_reader(info, "HOLD");
+	rcv_file_list_init(info);
+	rcv_file_list_check(info);
+
+	/* The signal handler and ERR_EXIT() remove incomplete files */
+	atexit(rcv_tmp_cleanup);
+	set_signal_handler(info, ur_receive_sig_handler);
+	pthread_mutex_init(&rcv.lock, NULL);
+	pthread_cond_init(&rcv.cond, NULL);
+	if (pthread_create(&thread, NULL, rcv_read_thread, info))
+		ERR_EXIT("Could not create read thread\n");
+	rcv_write(info);
+	pthread_join(thread, NULL);
+	pthread_cond_destroy(&rcv.cond);
+	pthread_mutex_destroy(&rcv.lock);
+	free(info->out_buf);
+
+	if (!info->hold_specified)
+		rcv_purge_done();
+	for (i = 0; i < rcv.file_cnt; i++)
+		cnt += rcv.file_vec[i].done;
+	if (cnt != rcv.file_cnt)
+		ERR_EXIT("%i of %i spool files received.\n", cnt,
+			 rcv.file_cnt);
+	free(rcv.file_vec);
+}
+
 /*
  * Issue CP command CLOSE PUNCH
  */
@@ -1743,24 +2244,45 @@ static void ur_write_sig_handler(int UNUSED(sig), siginfo_t *UNUSED(sip),
 }
 
 /*
- * Read on line from fd not including newline
+ * Read one line from fd not including newline
+ *
+ * The input is read in blocks of VMUR_LINE_BUF_SIZE bytes into the line
+ * buffer and the lines are copied from there.
  */
-static int read_line(int fd, char *buf, int len, int lf)
+static int read_line(struct vmur *info, int fd, char *buf, int len, int lf)
 {
 	int offs = 0;
 
 	memset(buf, 0, len);
 	do {
-		int rc;
-
-		rc = read(fd, buf + offs, 1);
-		if (rc < 0)
-			return -EIO;
-		if (rc == 0)
-			return -ENODATA;
-		if (*(buf + offs) == lf)
+		size_t cnt;
+		char *in_ptr, *sep;
+
+		if (info->line_buf_pos == info->line_buf_end) {
+			ssize_t rc;
+
+			rc = read(fd, info->line_buf, sizeof(info->line_buf));
+			if (rc < 0)
+				return -EIO;
+			if (rc == 0)
+				return -ENODATA;
+			info->line_buf_pos = 0;
+			info->line_buf_end = rc;
+		}
+		in_ptr = info->line_buf + info->line_buf_pos;
+		cnt = info->line_buf_end - info->line_buf_pos;
+		if (cnt > (size_t) (len - offs))
+			cnt = len - offs;
+		sep = (char *) memchr(in_ptr, lf, cnt);
+		if (sep)
+			cnt = sep - in_ptr;
+		memcpy(buf + offs, in_ptr, cnt);
+		offs += cnt;
+		info->line_buf_pos += cnt;
+		if (sep) {
+			info->line_buf_pos++;
 			goto found;
-		offs++;
+		}
 	} while (offs < len);
 
 	return -EINVAL;
@@ -1793,7 +2315,8 @@ static int read_text_file(struct vmur *info, int fd, char *out_buf, size_t len)
 		size_t rec_len, out_len;
 		char *in_ptr, *out_ptr;
 
-		line_len = read_line(fd, buf, info->ur_reclen  + 1, sep);
+		line_len = read_line(info, fd, buf, info->ur_reclen  + 1,
+				     sep);
 		if (line_len == -ENODATA) {
 			break;
 		} else if (line_len == -EINVAL) {
@@ -1809,7 +2332,8 @@ static int read_text_file(struct vmur *info, int fd, char *out_buf, size_t len)
 		rec_len = out_len = info->ur_reclen;
 		in_ptr = buf;
 		out_ptr = &out_buf[pos];
-		rc = iconv(info->iconv, &in_ptr, &rec_len, &out_ptr, &out_len);
+		rc = util_ebcdic_conv(&info->conv, &in_ptr, &rec_len, &out_ptr,
+				      &out_len);
 		if ((rc == -1) || (out_len != 0)) {
 			ERR("Code page conversion failed at line %i\n", line);
 			goto fail;
@@ -1843,7 +2367,8 @@ static int read_blocked_file(struct vmur *info, int fd, char *out_buf,
 		return -ENOMEM;
 
 	do {
-		line_len = read_line(fd, buf, info->ur_reclen  + 1, sep);
+		line_len = read_line(info, fd, buf, info->ur_reclen  + 1,
+				     sep);
 		if (line_len == -ENODATA) {
 			break;
 		} else if (line_len == -EINVAL) {
@@ -2051,12 +2576,11 @@ static int ur_list(struct vmur *info)
 }
 
 /*
- * Initialize iconv: "from" -> "to"
+ * Initialize code page conversion: "from" -> "to"
  */
-static void setup_iconv(struct vmur *info, const char *from, const char *to)
+static void setup_conv(struct vmur *info, const char *from, const char *to)
 {
-	info->iconv = iconv_open(to, from);
-	if (info->iconv == ((iconv_t) -1))
+	if (util_ebcdic_open(&info->conv, to, from))
 		ERR_EXIT("Could not initialize conversion table %s->%s.\n",
 			 from, to);
 }
@@ -2076,14 +2600,17 @@ int main(int argc, char **argv)
 	case RECEIVE:
 		setup_ur_device(&vmur_info);
 		if (vmur_info.text_specified)
-			setup_iconv(&vmur_info, EBCDIC_CODE_PAGE,
+			setup_conv(&vmur_info, EBCDIC_CODE_PAGE,
 				    ASCII_CODE_PAGE);
-		ur_receive(&vmur_info);
+		if (vmur_info.all_specified)
+			ur_receive_all(&vmur_info);
+		else
+			ur_receive(&vmur_info);
 		break;
 	case PUNCH:
 	case PRINT:
 		if (vmur_info.text_specified)
-			setup_iconv(&vmur_info, ASCII_CODE_PAGE,
+			setup_conv(&vmur_info, ASCII_CODE_PAGE,
 				    EBCDIC_CODE_PAGE);
 		setup_ur_device(&vmur_info);
 		ur_write(&vmur_info);
@@ -32,11 +32,7 @@ do { \
 		ERR_EXIT(str " can only be specified once.\n"); \
 } while (0)
 
-#define VMCP_DEVICE_NODE "/dev/vmcp"
 #define VMCP_BUFSIZE 0x4000
-#define VMCP_GETSIZE _IOR(0x10, 3, int)
-#define VMCP_SETBUF  _IOW(0x10, 2, int)
-#define VMCP_GETCODE _IOR(0x10, 1, int)
 
 #define CP_PREFIX_LEN 11
 
@@ -48,6 +44,7 @@ do { \
 #define VMPRT_RECLEN 132
 
 #define VMUR_REC_COUNT 511
+#define VMUR_LINE_BUF_SIZE 0x10000 /* input buffer for punch/print */
 
 #define PAGE_SIZE 4096
 #define MAXCMDLEN 80
@@ -70,6 +67,15 @@ do { \
 #define ASCII_CODE_PAGE  "ISO-8859-1"
 
 #define READ_BLOCKS 80
+#define RECEIVE_BUFS 4 /* read buffers for receive --all */
+#define RECEIVE_TMP_SUFFIX ".part" /* receive --all writes to path.part */
+
+/* Columns of a file line in the QUERY RDR * ALL SHORTDATE response */
+#define RDR_COL_SPOOLID 9
+#define RDR_COL_CLASS   14
+#define RDR_COL_HOLD    33
+#define RDR_COL_NAME    53
+#define RDR_COL_TYPE    63
 
 enum spoolfile_fmt {
 	TYPE_NORMAL,
@@ -138,4 +144,30 @@ struct splink_record {
 	struct data data;
 } __attribute__ ((packed));
 
+/*
+ * Reader file for receive --all
+ */
+struct rdr_file {
+	char spoolid[5];
+	char class_;
+	char hold[5];
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX]; /* file is written here and then renamed */
+	int  skip; /* set before the read thread is started */
+	int  tmp;  /* tmp_path has been created and not yet renamed */
+	int  done; /* set by the write thread after the file is written */
+};
+
+/*
+ * Read buffer passed from the read thread to the write thread
+ */
+struct rcv_buf {
+	struct splink_page sfdata[READ_BLOCKS];
+	int blocks;
+	struct rdr_file *file; /* NULL: no more files */
+	int eof;               /* last buffer of file */
+	int converted;         /* file was converted with vm_convert() */
+	int rc;                /* read result of file, valid if eof is set */
+};
+
 #endif
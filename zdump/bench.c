@@ -0,0 +1,543 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Benchmark for the dump input and output formats (--benchmark option)
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <fcntl.h>
+#include <time.h>
+#include <zlib.h>
+#include <sys/wait.h>
+#include "zgetdump.h"
+
+#define BENCH_MEM_SIZE	(128 * MIB)	/* Memory size of synthetic dumps */
+#define BENCH_BLK_SIZE	MIB		/* Read size for copy benchmark */
+#define BENCH_FUSE_SIZE	(128 * KIB)	/* Read size for mount benchmark */
+#define BENCH_HIST_CNT	24		/* Latency buckets (powers of two) */
+#define BENCH_LC_1	0x20000		/* Lowcore of first synthetic CPU */
+#define BENCH_LC_2	0x40000		/* Lowcore of second synthetic CPU */
+
+/*
+ * Output formats that are benchmarked
+ */
+static const char *fmt_vec[] = {"s390", "elf", "kdump", NULL};
+
+/*
+ * Synthetic input dumps: File name and converter (NULL: generated directly)
+ */
+struct synth_dump {
+	const char	*name;
+	const char	*fmt;
+};
+
+static struct synth_dump synth_vec[] = {
+	{"dump.s390", NULL},
+	{"dump.elf", "elf"},
+	{"dump.lkcd", NULL},
+	{NULL, NULL},
+};
+
+/*
+ * Benchmark result for one input and output format combination
+ */
+struct result {
+	u64			size;		/* Size of output dump */
+	u64			init_us;	/* Time for DFI and DFO init */
+	u64			copy_us;	/* Time for copy */
+	u64			mount_us;	/* Time for read via page cache */
+	u64			hist[BENCH_HIST_CNT]; /* Copy read latencies */
+	struct zg_io_stats	io_stats;	/* I/O of copy */
+};
+
+/*
+ * File local static data
+ */
+static struct {
+	char	dir[PATH_MAX];	/* Directory for synthetic dumps */
+	int	child;		/* Running in benchmark child process */
+} l;
+
+/*
+ * Return monotonic time in microseconds
+ */
+static u64 time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Add latency "us" to histogram: Bucket "i" counts latencies < 2^i usec
+ */
+static void hist_add(u64 *hist, u64 us)
+{
+	unsigned int i = 0;
+
+	while (i < BENCH_HIST_CNT - 1 && us >= (1ULL << i))
+		i++;
+	hist[i]++;
+}
+
+/*
+ * Print latency histogram
+ */
+static void hist_print(u64 *hist)
+{
+	unsigned int i;
+	u64 us;
+
+	STDOUT("  Latency:");
+	for (i = 0; i < BENCH_HIST_CNT; i++) {
+		if (!hist[i])
+			continue;
+		us = 1ULL << i;
+		if (i == BENCH_HIST_CNT - 1)
+			STDOUT(" >=%llus:%llu", us / 2000000, hist[i]);
+		else if (us < 1000)
+			STDOUT(" <%lluus:%llu", us, hist[i]);
+		else if (us < 1000000)
+			STDOUT(" <%llums:%llu", us / 1000, hist[i]);
+		else
+			STDOUT(" <%llus:%llu", us / 1000000, hist[i]);
+	}
+	STDOUT("\n");
+}
+
+/*
+ * Return throughput in MB/s for "size" bytes in "us" microseconds
+ */
+static double mb_per_sec(u64 size, u64 us)
+{
+	return (double) size / MIB / ((double) MAX(us, 1) / 1000000);
+}
+
+/*
+ * Print result line
+ */
+static void result_print(const char *dfi, const char *dfo, struct result *res)
+{
+	STDOUT("%-10s %-6s %9llu %9llu %10.1f ", dfi, dfo, TO_MIB(res->size),
+	       res->init_us / 1000, mb_per_sec(res->size, res->copy_us));
+	if (res->mount_us)
+		STDOUT("%11.1f ", mb_per_sec(res->size, res->mount_us));
+	else
+		STDOUT("%11s ", "-");
+	STDOUT("%9llu %9llu %7llu\n", res->io_stats.read_cnt,
+	       TO_MIB(res->io_stats.read_bytes), res->io_stats.seek_cnt);
+	hist_print(res->hist);
+}
+
+/*
+ * Read complete output dump via dfo_pread() or via dfo_read() for dumps
+ * that can only be read sequentially
+ */
+static void bench_copy(struct result *res, void *buf)
+{
+	struct zg_io_stats start;
+	u64 off, cnt, t;
+
+	zg_io_stats(&start);
+	res->copy_us = time_us();
+	for (off = 0; off < dfo_size(); off += cnt) {
+		t = time_us();
+		cnt = MIN(BENCH_BLK_SIZE, dfo_size() - off);
+		if (dfi_feat_seek())
+			cnt = dfo_pread(buf, cnt, off);
+		else
+			cnt = dfo_read(buf, cnt);
+		if (cnt == 0)
+			ERR_EXIT("Could not read output dump at %llu", off);
+		hist_add(res->hist, time_us() - t);
+	}
+	res->copy_us = time_us() - res->copy_us;
+	zg_io_stats(&res->io_stats);
+	res->io_stats.read_cnt -= start.read_cnt;
+	res->io_stats.read_bytes -= start.read_bytes;
+	res->io_stats.seek_cnt -= start.seek_cnt;
+}
+
+/*
+ * Read complete output dump in FUSE request sizes via the page cache
+ */
+static void bench_mount(struct result *res, void *buf)
+{
+#ifndef WITHOUT_FUSE
+	u64 off, cnt;
+
+	if (!dfi_feat_seek())
+		return;
+	zfuse_cache_init(g.opts.cache_size);
+	res->mount_us = time_us();
+	for (off = 0; off < dfo_size(); off += cnt) {
+		cnt = zfuse_cache_read(buf, BENCH_FUSE_SIZE, off);
+		if (cnt == 0)
+			ERR_EXIT("Could not read output dump at %llu", off);
+	}
+	res->mount_us = time_us() - res->mount_us;
+#else
+	(void) res;
+	(void) buf;
+#endif
+}
+
+/*
+ * Benchmark dump "path" with output format "fmt" (runs in child process)
+ */
+static void bench_child(const char *path, const char *fmt)
+{
+	struct result res;
+	void *buf;
+
+	memset(&res, 0, sizeof(res));
+	g.opts.device = (char *) path;
+	dfo_set(fmt);
+	res.init_us = time_us();
+	if (dfi_init() != 0)
+		ERR_EXIT("Dump cannot be processed (is not complete)");
+	if (!dfi_feat_copy()) {
+		STDOUT("%-10s %-6s Copying not supported\n", dfi_name(), fmt);
+		return;
+	}
+	dfo_init();
+	res.init_us = time_us() - res.init_us;
+	res.size = dfo_size();
+	buf = zg_alloc(BENCH_BLK_SIZE);
+	bench_copy(&res, buf);
+	bench_mount(&res, buf);
+	result_print(dfi_name(), fmt, &res);
+	zg_free(buf);
+	dfi_exit();
+}
+
+/*
+ * Write output dump with format "fmt" for dump "src" to file "dst"
+ * (runs in child process)
+ */
+static void convert_child(const char *src, const char *dst, const char *fmt)
+{
+	void *buf = zg_alloc(BENCH_BLK_SIZE);
+	u64 off, cnt;
+	int fh;
+
+	g.opts.device = (char *) src;
+	dfo_set(fmt);
+	if (dfi_init() != 0)
+		ERR_EXIT("Dump cannot be processed (is not complete)");
+	dfo_init();
+	fh = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fh == -1)
+		ERR_EXIT_ERRNO("Could not create \"%s\"", dst);
+	for (off = 0; off < dfo_size(); off += cnt) {
+		cnt = dfo_pread(buf, MIN(BENCH_BLK_SIZE, dfo_size() - off),
+				off);
+		if (write(fh, buf, cnt) != (ssize_t) cnt)
+			ERR_EXIT_ERRNO("Could not write \"%s\"", dst);
+	}
+	close(fh);
+	zg_free(buf);
+	dfi_exit();
+}
+
+/*
+ * Run benchmark or conversion in child process so that each run starts
+ * with fresh DFI and DFO state
+ */
+static int run_child(const char *src, const char *dst, const char *fmt)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid == -1)
+		ERR_EXIT_ERRNO("Could not create benchmark process");
+	if (pid == 0) {
+		l.child = 1;
+		if (dst)
+			convert_child(src, dst, fmt);
+		else
+			bench_child(src, fmt);
+		zg_exit(0);
+	}
+	if (waitpid(pid, &status, 0) == -1)
+		ERR_EXIT_ERRNO("Could not wait for benchmark process");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Write "cnt" bytes to synthetic dump file
+ */
+static void synth_write(int fh, const void *buf, u64 cnt)
+{
+	if (write(fh, buf, cnt) != (ssize_t) cnt)
+		ERR_EXIT_ERRNO("Could not write synthetic dump");
+}
+
+/*
+ * Get path of file "name" with "suffix" in synthetic dump directory
+ */
+static void synth_path(char *path, const char *name, const char *suffix)
+{
+	if (snprintf(path, PATH_MAX, "%s/%s%s", l.dir, name, suffix) >=
+	    PATH_MAX)
+		ERR_EXIT("Path name for \"%s\" is too long", name);
+}
+
+/*
+ * Create synthetic dump file "name"
+ */
+static int synth_open(const char *name)
+{
+	char path[PATH_MAX];
+	int fh;
+
+	synth_path(path, name, "");
+	fh = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fh == -1)
+		ERR_EXIT_ERRNO("Could not create \"%s\"", path);
+	return fh;
+}
+
+/*
+ * Fill synthetic memory page "pg_nr"
+ *
+ * The first MiB (lowcores) and every fourth page are zero, every fourth
+ * page contains random data and the other pages contain compressible text.
+ */
+static void synth_page(u64 pg_nr, void *buf)
+{
+	u64 *ptr = buf, x = pg_nr * 0x9e3779b97f4a7c15ULL + 1;
+	unsigned int i, len;
+
+	if (pg_nr < MIB / PAGE_SIZE || pg_nr % 4 == 0) {
+		memset(buf, 0, PAGE_SIZE);
+	} else if (pg_nr % 4 == 1) {
+		for (i = 0; i < PAGE_SIZE / sizeof(u64); i++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			ptr[i] = x;
+		}
+	} else {
+		for (i = 0; i < PAGE_SIZE; i += len) {
+			len = snprintf(buf + i, PAGE_SIZE - i,
+				       "Synthetic page %llu offset %u\n",
+				       pg_nr, i);
+			len = MIN(len, PAGE_SIZE - i);
+		}
+	}
+}
+
+/*
+ * Return TOD clock value for current time
+ */
+static u64 synth_tod(void)
+{
+	u64 us = (u64) time(NULL) * 1000000;
+
+	/* Inverse of tod2timeval() in df_s390.c */
+	return (us << 12) + 0x8126d60e46000000ULL -
+		(0x3c26700ULL * 1000000 * 4096);
+}
+
+/*
+ * Generate synthetic s390 dump
+ */
+static void synth_s390(const char *name)
+{
+	struct df_s390_hdr *hdr = zg_alloc(DF_S390_HDR_SIZE);
+	char buf[PAGE_SIZE];
+	struct df_s390_em em;
+	u64 pg_nr;
+	int fh;
+
+	hdr->magic = DF_S390_MAGIC;
+	hdr->version = 5;
+	hdr->hdr_size = DF_S390_HDR_SIZE;
+	hdr->page_size = PAGE_SIZE;
+	hdr->mem_size = BENCH_MEM_SIZE;
+	hdr->mem_end = BENCH_MEM_SIZE;
+	hdr->num_pages = BENCH_MEM_SIZE / PAGE_SIZE;
+	hdr->tod = synth_tod();
+	hdr->arch = DF_S390_ARCH_64;
+	hdr->build_arch = DF_S390_ARCH_64;
+	hdr->mem_size_real = BENCH_MEM_SIZE;
+	hdr->cpu_cnt = 2;
+	hdr->real_cpu_cnt = 2;
+	hdr->lc_vec[0] = BENCH_LC_1;
+	hdr->lc_vec[1] = BENCH_LC_2;
+
+	fh = synth_open(name);
+	synth_write(fh, hdr, DF_S390_HDR_SIZE);
+	for (pg_nr = 0; pg_nr < BENCH_MEM_SIZE / PAGE_SIZE; pg_nr++) {
+		synth_page(pg_nr, buf);
+		synth_write(fh, buf, PAGE_SIZE);
+	}
+	memcpy(em.str, DF_S390_EM_STR, sizeof(em.str));
+	em.tod = hdr->tod;
+	synth_write(fh, &em, sizeof(em));
+	close(fh);
+	zg_free(hdr);
+}
+
+/*
+ * Generate synthetic LKCD dump with gzip compressed pages
+ */
+static void synth_lkcd(const char *name)
+{
+	char *hdr_buf = zg_alloc(DF_LKCD_HDR_SIZE);
+	struct df_lkcd_hdr *hdr = (void *) hdr_buf;
+	struct df_lkcd_hdr_asm *hdr_asm;
+	char buf[PAGE_SIZE], cbuf[2 * PAGE_SIZE];
+	struct df_lkcd_pg_hdr pg_hdr;
+	unsigned long size;
+	u64 pg_nr;
+	int fh;
+
+	hdr->magic = DF_LKCD_MAGIC;
+	hdr->version = DF_LKCD_VERSION;
+	hdr->hdr_size = sizeof(*hdr);
+	hdr->page_size = PAGE_SIZE;
+	hdr->mem_size = BENCH_MEM_SIZE;
+	hdr->mem_end = BENCH_MEM_SIZE;
+	hdr->num_dump_pgs = BENCH_MEM_SIZE / PAGE_SIZE;
+	hdr->time_tv_sec = time(NULL);
+	strcpy(hdr->panic_string, "zgetdump benchmark");
+	strcpy(hdr->utsname_sysname, "Linux");
+	strcpy(hdr->utsname_nodename, "zgetdump");
+	strcpy(hdr->utsname_machine, "s390x");
+	hdr->dump_compress = DF_LKCD_COMPRESS_GZIP;
+	hdr_asm = (void *) PTR_ADD(hdr_buf, hdr->hdr_size);
+	hdr_asm->magic = DF_LKCD_MAGIC_ASM;
+	hdr_asm->hdr_size = sizeof(*hdr_asm);
+	hdr_asm->cpu_cnt = 2;
+	hdr_asm->real_cpu_cnt = 2;
+	hdr_asm->lc_vec[0] = BENCH_LC_1;
+	hdr_asm->lc_vec[1] = BENCH_LC_2;
+
+	fh = synth_open(name);
+	synth_write(fh, hdr_buf, DF_LKCD_HDR_SIZE);
+	for (pg_nr = 0; pg_nr < BENCH_MEM_SIZE / PAGE_SIZE; pg_nr++) {
+		synth_page(pg_nr, buf);
+		pg_hdr.addr = pg_nr * PAGE_SIZE;
+		size = sizeof(cbuf);
+		if (compress2((void *) cbuf, &size, (void *) buf, PAGE_SIZE,
+			      Z_BEST_SPEED) == Z_OK && size < PAGE_SIZE) {
+			pg_hdr.size = size;
+			pg_hdr.flags = DF_LKCD_DH_COMPRESSED;
+			synth_write(fh, &pg_hdr, sizeof(pg_hdr));
+			synth_write(fh, cbuf, size);
+		} else {
+			pg_hdr.size = PAGE_SIZE;
+			pg_hdr.flags = DF_LKCD_DH_RAW;
+			synth_write(fh, &pg_hdr, sizeof(pg_hdr));
+			synth_write(fh, buf, PAGE_SIZE);
+		}
+	}
+	memset(&pg_hdr, 0, sizeof(pg_hdr));
+	pg_hdr.flags = DF_LKCD_DH_END;
+	synth_write(fh, &pg_hdr, sizeof(pg_hdr));
+	close(fh);
+	zg_free(hdr_buf);
+}
+
+/*
+ * Remove synthetic dumps
+ */
+static void synth_cleanup(void)
+{
+	char path[PATH_MAX];
+	struct synth_dump *dump;
+
+	if (l.child || l.dir[0] == '\0')
+		return;
+	for (dump = synth_vec; dump->name; dump++) {
+		synth_path(path, dump->name, "");
+		unlink(path);
+		/* Page index file of LKCD dump */
+		synth_path(path, dump->name, ".zidx");
+		unlink(path);
+	}
+	rmdir(l.dir);
+	l.dir[0] = '\0';
+}
+
+/*
+ * Generate synthetic dumps in temporary directory
+ */
+static void synth_init(void)
+{
+	const char *tmp = getenv("TMPDIR");
+	char src[PATH_MAX], dst[PATH_MAX];
+	struct synth_dump *dump;
+
+	if (snprintf(l.dir, sizeof(l.dir), "%s/zgetdump-bench.XXXXXX",
+		     tmp ? tmp : "/tmp") >= (int) sizeof(l.dir))
+		ERR_EXIT("Path name for TMPDIR is too long");
+	if (!mkdtemp(l.dir))
+		ERR_EXIT_ERRNO("Could not create directory \"%s\"", l.dir);
+	zg_atexit(synth_cleanup);
+	STDERR("Generating synthetic dumps (%llu MB) in %s\n",
+	       (unsigned long long) TO_MIB(BENCH_MEM_SIZE), l.dir);
+	synth_s390("dump.s390");
+	synth_lkcd("dump.lkcd");
+	synth_path(src, "dump.s390", "");
+	for (dump = synth_vec; dump->name; dump++) {
+		if (!dump->fmt)
+			continue;
+		synth_path(dst, dump->name, "");
+		if (run_child(src, dst, dump->fmt))
+			ERR_EXIT("Could not create synthetic dump \"%s\"", dst);
+	}
+}
+
+/*
+ * Benchmark dump "path" with all selected output formats
+ */
+static int bench_dump(const char *path)
+{
+	int i, rc = 0;
+
+	for (i = 0; fmt_vec[i]; i++) {
+		if (g.opts.fmt_specified && strcmp(g.opts.fmt, fmt_vec[i]))
+			continue;
+		if (run_child(path, NULL, fmt_vec[i]) == 0)
+			continue;
+		STDOUT("%-10s %-6s Failed\n", path, fmt_vec[i]);
+		rc = 1;
+	}
+	return rc;
+}
+
+/*
+ * Run "--benchmark" action
+ *
+ * Without DUMP, synthetic s390, ELF and LKCD dumps are generated.
+ */
+int bench_run(void)
+{
+	struct synth_dump *dump;
+	char path[PATH_MAX];
+	int rc = 0;
+
+	if (!g.opts.device)
+		synth_init();
+	STDOUT("%-10s %-6s %9s %9s %10s %11s %9s %9s %7s\n", "Input",
+	       "Output", "Size(MB)", "Init(ms)", "Copy(MB/s)", "Mount(MB/s)",
+	       "Reads", "Read(MB)", "Seeks");
+	if (g.opts.device)
+		return bench_dump(g.opts.device);
+	for (dump = synth_vec; dump->name; dump++) {
+		synth_path(path, dump->name, "");
+		rc |= bench_dump(path);
+	}
+	synth_cleanup();
+	return rc;
+}
@@ -0,0 +1,199 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Checkpoints for resuming interrupted copies
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <limits.h>
+#include "zgetdump.h"
+
+#define CHECKPOINT_INTERVAL	(1ULL * GIB)	/* Bytes between checkpoints */
+
+/*
+ * File local static data
+ *
+ * The checkpoint file records how many bytes of the output dump ("done")
+ * have been written to the output file starting at offset "out_off".
+ */
+static struct {
+	const char	*path;
+	off_t		out_off;
+	u64		done;
+	char		manifest[MANIFEST_STATE_SIZE];
+	int		manifest_valid;
+} l;
+
+/*
+ * Return value of line "line" for key "key" or NULL
+ */
+static char *line_val(char *line, const char *key)
+{
+	size_t len = strlen(key);
+
+	if (strncmp(line, key, len) != 0 || line[len] != ':' ||
+	    line[len + 1] != ' ')
+		return NULL;
+	line[strcspn(line, "\n")] = '\0';
+	return line + len + 2;
+}
+
+/*
+ * Read checkpoint file and verify that it belongs to the current copy
+ */
+static void checkpoint_read(void)
+{
+	int source_ok = 0, format_ok = 0, size_ok = 0, done_ok = 0;
+	unsigned long long val;
+	char line[1024], *str;
+	FILE *fh;
+
+	fh = fopen(l.path, "r");
+	if (!fh)
+		ERR_EXIT_ERRNO("Could not open checkpoint \"%s\"", l.path);
+	while (fgets(line, sizeof(line), fh)) {
+		if ((str = line_val(line, "source"))) {
+			source_ok = strcmp(str, g.opts.device) == 0;
+		} else if ((str = line_val(line, "format"))) {
+			format_ok = strcmp(str, dfo_name()) == 0;
+		} else if ((str = line_val(line, "size"))) {
+			size_ok = sscanf(str, "%llu", &val) == 1 &&
+				val == dfo_size();
+		} else if ((str = line_val(line, "offset"))) {
+			if (sscanf(str, "%llu", &val) == 1)
+				l.out_off = val;
+		} else if ((str = line_val(line, "done"))) {
+			done_ok = sscanf(str, "%llu", &val) == 1 &&
+				val <= dfo_size();
+			l.done = val;
+		} else if ((str = line_val(line, "manifest"))) {
+			if (strlen(str) < sizeof(l.manifest)) {
+				strcpy(l.manifest, str);
+				l.manifest_valid = 1;
+			}
+		}
+	}
+	fclose(fh);
+	if (!source_ok || !format_ok || !size_ok)
+		ERR_EXIT("Checkpoint \"%s\" does not match dump \"%s\" with "
+			 "format \"%s\"", l.path, g.opts.device, dfo_name());
+	if (!done_ok)
+		ERR_EXIT("Checkpoint \"%s\" is invalid", l.path);
+	if (g.opts.manifest && !l.manifest_valid)
+		ERR_EXIT("Checkpoint \"%s\" has no manifest state", l.path);
+}
+
+/*
+ * Prepare output file for resuming the copy at the checkpoint
+ *
+ * Data written after the checkpoint is removed. The output file can be
+ * opened in append mode.
+ */
+static void out_resume(void)
+{
+	off_t off = l.out_off + l.done;
+	struct stat sb;
+
+	if (fstat(STDOUT_FILENO, &sb) == -1)
+		ERR_EXIT_ERRNO("Could not access output file");
+	if (sb.st_size < off)
+		ERR_EXIT("Output file is smaller than the checkpoint "
+			 "(use \">>\" to keep the copied data)");
+	if (ftruncate(STDOUT_FILENO, off) == -1)
+		ERR_EXIT_ERRNO("Could not set size of output file");
+	if (lseek(STDOUT_FILENO, off, SEEK_SET) == -1)
+		ERR_EXIT_ERRNO("Error: Seek failed");
+}
+
+/*
+ * Write checkpoint for "written" bytes of the output dump
+ *
+ * The output file is synced before, so that the checkpoint is valid after
+ * a system crash. The file is replaced atomically with rename().
+ */
+void checkpoint_write(u64 written)
+{
+	char tmp_path[PATH_MAX], manifest[MANIFEST_STATE_SIZE];
+	FILE *fh;
+
+	if (!l.path)
+		return;
+	if (fdatasync(STDOUT_FILENO) == -1)
+		ERR_EXIT_ERRNO("Could not sync output file");
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", l.path) >=
+	    (int) sizeof(tmp_path))
+		ERR_EXIT("Path name for checkpoint \"%s\" is too long", l.path);
+	fh = fopen(tmp_path, "w");
+	if (!fh)
+		ERR_EXIT_ERRNO("Could not create checkpoint \"%s\"", tmp_path);
+	fprintf(fh, "source: %s\n", g.opts.device);
+	fprintf(fh, "format: %s\n", dfo_name());
+	fprintf(fh, "size: %llu\n", (unsigned long long) dfo_size());
+	fprintf(fh, "offset: %llu\n", (unsigned long long) l.out_off);
+	fprintf(fh, "done: %llu\n", (unsigned long long) written);
+	if (manifest_state(manifest) == 0)
+		fprintf(fh, "manifest: %s\n", manifest);
+	if (fflush(fh) || fsync(fileno(fh)) || fclose(fh))
+		ERR_EXIT_ERRNO("Could not write checkpoint \"%s\"", tmp_path);
+	if (rename(tmp_path, l.path) == -1)
+		ERR_EXIT_ERRNO("Could not create checkpoint \"%s\"", l.path);
+	l.done = written;
+}
+
+/*
+ * Check if checkpoint should be written after "written" bytes
+ */
+int checkpoint_due(u64 written)
+{
+	return l.path && written - l.done >= CHECKPOINT_INTERVAL;
+}
+
+/*
+ * Return manifest state of resumed checkpoint or NULL
+ */
+const char *checkpoint_manifest(void)
+{
+	return l.manifest_valid ? l.manifest : NULL;
+}
+
+/*
+ * Initialize checkpoints and return output dump offset for copy start
+ *
+ * For "--resume" the copy starts at the offset recorded in the checkpoint
+ * file. Otherwise the copy starts at zero.
+ */
+u64 checkpoint_init(void)
+{
+	struct stat sb;
+
+	if (!g.opts.checkpoint)
+		return 0;
+	l.path = g.opts.checkpoint;
+	if (fstat(STDOUT_FILENO, &sb) == -1 || !S_ISREG(sb.st_mode))
+		ERR_EXIT("Checkpoints require a regular output file");
+	if (!g.opts.resume) {
+		l.out_off = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+		if (l.out_off == -1)
+			ERR_EXIT_ERRNO("Could not get position of output file");
+		return 0;
+	}
+	if (!dfi_feat_seek())
+		ERR_EXIT("Resuming not possible for %s dumps", dfi_name());
+	checkpoint_read();
+	out_resume();
+	STDERR("Resuming copy at %llu MB\n\n",
+	       (unsigned long long) TO_MIB(l.done));
+	return l.done;
+}
+
+/*
+ * Remove checkpoint file after the copy has been completed
+ */
+void checkpoint_exit(void)
+{
+	if (!l.path)
+		return;
+	if (unlink(l.path) == -1 && errno != ENOENT)
+		ERR_EXIT_ERRNO("Could not remove checkpoint \"%s\"", l.path);
+}
@@ -97,4 +97,6 @@ static inline void df_elf_ensure_s390x(void)
 #endif
 }
 
+extern int dfi_elf_hdr_read(u64 off, int (*load_fn)(Elf64_Phdr *phdr));
+
 #endif /* DF_ELF_H */
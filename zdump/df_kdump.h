@@ -0,0 +1,94 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * kdump (makedumpfile) dump format definitions
+ *
+ * Copyright IBM Corp. 2001, 2013
+ * Author(s): Michael Holzheu <holzheu@linux.vnet.ibm.com>
+ */
+
+#ifndef DF_KDUMP_H
+#define DF_KDUMP_H
+
+#include <sys/time.h>
+#include <linux/utsname.h>
+
+#define DF_KDUMP_SIGNATURE		"KDUMP   "
+#define DF_KDUMP_HDR_VERSION		6
+
+#define DF_KDUMP_DH_COMPRESSED_ZLIB	0x1	/* Page is compressed with zlib */
+#define DF_KDUMP_DL_EXCLUDE_ZERO	0x1	/* Zero pages are not dumped */
+
+/*
+ * kdump (diskdump) main header
+ */
+struct df_kdump_hdr {
+	char			signature[8];
+	int			header_version;
+	struct new_utsname	utsname;
+	struct timeval		timestamp;
+	unsigned int		status;
+	int			block_size;
+	int			sub_hdr_size;
+	unsigned int		bitmap_blocks;
+	unsigned int		max_mapnr;
+	unsigned int		total_ram_blocks;
+	unsigned int		device_blocks;
+	unsigned int		written_blocks;
+	unsigned int		current_cpu;
+	int			nr_cpus;
+	void			*tasks[0];
+};
+
+/*
+ * kdump sub header
+ */
+struct df_kdump_sub_hdr {
+	unsigned long		phys_base;
+	int			dump_level;
+	int			split;
+	unsigned long		start_pfn;
+	unsigned long		end_pfn;
+	off_t			offset_vmcoreinfo;
+	unsigned long		size_vmcoreinfo;
+	off_t			offset_note;
+	unsigned long		size_note;
+	off_t			offset_eraseinfo;
+	unsigned long		size_eraseinfo;
+	unsigned long long	start_pfn_64;
+	unsigned long long	end_pfn_64;
+	unsigned long long	max_mapnr_64;
+};
+
+/*
+ * kdump page descriptor
+ */
+struct df_kdump_page_desc {
+	off_t			offset;		/* Offset of page data */
+	unsigned int		size;		/* Size of page data */
+	unsigned int		flags;		/* DF_KDUMP_DH_COMPRESSED_ZLIB */
+	unsigned long long	page_flags;
+};
+
+/*
+ * kdump_flat (makedumpfile flattened format) headers
+ */
+struct df_kdump_flat_hdr {
+	char	signature[16];
+	u64	type;
+	u64	version;
+};
+
+struct df_kdump_flat_data_hdr {
+	s64	offs;
+	s64	size;
+};
+
+static inline void df_kdump_ensure_s390x(void)
+{
+#ifndef __s390x__
+	ERR_EXIT("The kdump dump format is only supported on s390x (64 bit)");
+#endif
+}
+
+#endif /* DF_KDUMP_H */
@@ -74,4 +74,24 @@ struct df_lkcd_pg_hdr {
 	u32	flags;	/* flags (DF_LKCD_COMPRESSED, DF_LKCD_RAW,...) */
 } __attribute__((packed));
 
+/*
+ * Page index file header (written by zgetdump for flex dumps)
+ *
+ * The header is followed by "pg_cnt" file offsets of the page headers in
+ * the dump. Pages that are not contained in the dump have offset zero.
+ */
+#define DF_LKCD_IDX_MAGIC	0x7a67657464756d70ULL /* "zgetdump" */
+
+struct df_lkcd_idx_hdr {
+	u64	magic;
+	u32	version;
+	u32	reserved;
+	u64	dump_size;	/* Size of dump file */
+	u64	dump_mtime;	/* Modification time of dump file */
+	u64	dump_mtime_ns;	/* Nanoseconds of modification time */
+	u64	dump_ino;	/* Inode number of dump file */
+	u64	dump_time;	/* Dump creation time from LKCD header */
+	u64	pg_cnt;		/* Number of page offsets */
+} __attribute__((packed));
+
 #endif /* DF_LKCD_H */
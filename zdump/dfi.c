@@ -22,6 +22,7 @@ static struct dfi *dfi_vec[] = {
 	&dfi_s390mv,
 	&dfi_s390,
 	&dfi_lkcd,
+	&dfi_compact,
 	&dfi_elf,
 	&dfi_kdump,
 	&dfi_kdump_flat,
@@ -42,15 +43,26 @@ struct cpus {
 	unsigned int		cnt;
 };
 
+/*
+ * Memory chunk index entry
+ */
+struct mem_idx {
+	u64			start;
+	u64			end;
+	struct dfi_mem_chunk	*chunk;
+};
+
 /*
  * Memory information
  */
 struct mem {
-	struct dfi_mem_chunk	*chunk_cache;
 	u64			start_addr;
 	u64			end_addr;
 	unsigned int		chunk_cnt;
 	struct util_list	chunk_list;
+	struct mem_idx		*idx;		/* Sorted chunk index */
+	unsigned int		idx_cnt;	/* Number of index entries */
+	int			idx_valid;	/* Index is up to date */
 };
 
 /*
@@ -111,6 +123,7 @@ static void mem_init(struct mem *mem)
 	mem->start_addr = U64_MAX;
 	mem->end_addr = 0;
 	util_list_init(&mem->chunk_list, struct dfi_mem_chunk, list);
+	mem->idx_valid = 0;
 }
 
 /*
@@ -124,6 +137,43 @@ static int mem_chunk_cmp_fn(void *a, void *b, void *UNUSED(data))
 	return mem_chunk1->start < mem_chunk2->start ? -1 : 1;
 }
 
+/*
+ * Memory chunk index compare function for qsort
+ */
+static int mem_idx_cmp_fn(const void *a, const void *b)
+{
+	const struct mem_idx *idx1 = a;
+	const struct mem_idx *idx2 = b;
+
+	if (idx1->start == idx2->start)
+		return 0;
+	return idx1->start < idx2->start ? -1 : 1;
+}
+
+/*
+ * Build sorted index of memory chunks for binary search
+ *
+ * DFI memory chunks do not overlap, therefore the index can be sorted
+ * by the start address only.
+ */
+static void mem_idx_build(struct mem *mem)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	unsigned int i = 0;
+
+	zg_free(mem->idx);
+	mem->idx_cnt = util_list_len(&mem->chunk_list);
+	mem->idx = zg_alloc(sizeof(*mem->idx) * MAX(mem->idx_cnt, 1));
+	util_list_iterate(&mem->chunk_list, mem_chunk) {
+		mem->idx[i].start = mem_chunk->start;
+		mem->idx[i].end = mem_chunk->end;
+		mem->idx[i].chunk = mem_chunk;
+		i++;
+	}
+	qsort(mem->idx, mem->idx_cnt, sizeof(*mem->idx), mem_idx_cmp_fn);
+	mem->idx_valid = 1;
+}
+
 /*
  * Update DFI memory chunks
  */
@@ -138,6 +188,7 @@ static void mem_update(struct mem *mem)
 		mem->start_addr = MIN(mem->start_addr, mem_chunk->start);
 		mem->end_addr = MAX(mem->end_addr, mem_chunk->end);
 	}
+	mem_idx_build(mem);
 }
 
 /*
@@ -251,32 +302,33 @@ static void mem_chunk_create(struct mem *mem, u64 start, u64 size, void *data,
 	util_list_add_tail(&mem->chunk_list, mem_chunk);
 	mem->start_addr = MIN(mem->start_addr, mem_chunk->start);
 	mem->end_addr = MAX(mem->end_addr, mem_chunk->end);
-	mem->chunk_cache = mem_chunk;
 	mem->chunk_cnt++;
-}
-
-/*
- * Check if memory chunk contains address
- */
-static int mem_chunk_has_addr(struct dfi_mem_chunk *mem_chunk, u64 addr)
-{
-	return (addr >= mem_chunk->start && addr <= mem_chunk->end);
+	mem->idx_valid = 0;
 }
 
 /*
  * Find memory chunk that contains address
+ *
+ * Do binary search on the sorted chunk index. The index is (re)built
+ * lazily when chunks have been added since the last lookup. After the
+ * dump has been initialized the index is not modified any more, so lookups
+ * can be done by multiple threads concurrently.
  */
 static struct dfi_mem_chunk *mem_chunk_find(struct mem *mem, u64 addr)
 {
-	struct dfi_mem_chunk *mem_chunk;
-
-	if (mem_chunk_has_addr(mem->chunk_cache, addr))
-		return mem->chunk_cache;
-	util_list_iterate(&mem->chunk_list, mem_chunk) {
-		if (mem_chunk_has_addr(mem_chunk, addr)) {
-			mem->chunk_cache = mem_chunk;
-			return mem_chunk;
-		}
+	unsigned int lo = 0, hi, mid;
+
+	if (!mem->idx_valid)
+		mem_idx_build(mem);
+	hi = mem->idx_cnt;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (addr < mem->idx[mid].start)
+			hi = mid;
+		else if (addr > mem->idx[mid].end)
+			lo = mid + 1;
+		else
+			return mem->idx[mid].chunk;
 	}
 	return NULL;
 }
@@ -352,6 +404,101 @@ void dfi_mem_chunk_add(u64 start, u64 size, void *data,
 	mem_chunk_create(&l.mem_virt, start, size, data, read_fn, free_fn);
 }
 
+/*
+ * Read memory for memory chunk that is stored uncompressed in a file
+ */
+static void mem_chunk_file_read_fn(struct dfi_mem_chunk *mem_chunk, u64 off,
+				   void *buf, u64 cnt)
+{
+	struct dfi_mem_file *file = mem_chunk->data;
+
+	zg_pread(file->fh, buf, cnt, file->off + off, ZG_CHECK);
+}
+
+/*
+ * Add memory chunk that is stored uncompressed at offset "off" of "fh"
+ *
+ * The physical and the virtual memory chunk get their own copy of the file
+ * location because virtual memory chunks can be freed by mem_unmap().
+ */
+void dfi_mem_chunk_add_file(u64 start, u64 size, struct zg_fh *fh, u64 off)
+{
+	struct dfi_mem_file *file_phys = zg_alloc(sizeof(*file_phys));
+	struct dfi_mem_file *file_virt = zg_alloc(sizeof(*file_virt));
+
+	file_phys->fh = file_virt->fh = fh;
+	file_phys->off = file_virt->off = off;
+	mem_chunk_create(&l.mem_phys, start, size, file_phys,
+			 mem_chunk_file_read_fn, zg_free);
+	mem_chunk_create(&l.mem_virt, start, size, file_virt,
+			 mem_chunk_file_read_fn, zg_free);
+}
+
+/*
+ * Find input file data for "cnt" bytes at offset "off" of memory chunk
+ *
+ * Return the number of bytes that are stored contiguously at "*file_off"
+ * of "*fh" or 0, if the memory is not stored uncompressed in a file.
+ */
+u64 dfi_mem_chunk_file_map(struct dfi_mem_chunk *mem_chunk, u64 off, u64 cnt,
+			   struct zg_fh **fh, u64 *file_off)
+{
+	struct dfi_mem_file *file;
+	u64 addr;
+
+	cnt = MIN(cnt, mem_chunk->size - off);
+	if (mem_chunk_is_virt(mem_chunk)) {
+		addr = mem_chunk_start_phys(mem_chunk) + off;
+		mem_chunk = mem_chunk_find(&l.mem_phys, addr);
+		if (!mem_chunk)
+			return 0;
+		off = addr - mem_chunk->start;
+		cnt = MIN(cnt, mem_chunk->size - off);
+	}
+	if (mem_chunk->read_fn != mem_chunk_file_read_fn)
+		return 0;
+	file = mem_chunk->data;
+	*fh = file->fh;
+	*file_off = file->off + off;
+	return cnt;
+}
+
+/*
+ * Start read-ahead streams for all files that contain memory chunks
+ *
+ * Each file gets one stream for the file region of all its memory chunks.
+ * This way multiple files, e.g. the volumes of a multi-volume dump, are
+ * read concurrently. Return -1 if asynchronous I/O is not available.
+ */
+int dfi_mem_aio_start(unsigned int depth, int odirect)
+{
+	struct dfi_mem_chunk *mem_chunk, *tmp;
+	struct dfi_mem_file *file, *file_tmp;
+	u64 start, end;
+
+	util_list_iterate(&l.mem_phys.chunk_list, mem_chunk) {
+		if (mem_chunk->read_fn != mem_chunk_file_read_fn)
+			continue;
+		file = mem_chunk->data;
+		if (file->fh->aio)
+			continue;
+		start = U64_MAX;
+		end = 0;
+		util_list_iterate(&l.mem_phys.chunk_list, tmp) {
+			if (tmp->read_fn != mem_chunk_file_read_fn)
+				continue;
+			file_tmp = tmp->data;
+			if (file_tmp->fh != file->fh)
+				continue;
+			start = MIN(start, file_tmp->off);
+			end = MAX(end, file_tmp->off + tmp->size);
+		}
+		if (zg_aio_start(file->fh, start, end - start, depth, odirect))
+			return -1;
+	}
+	return 0;
+}
+
 /*
  * Return mem_chunk list head
  */
@@ -538,6 +685,14 @@ int dfi_feat_copy(void)
 	return l.dfi->feat_bits & DFI_FEAT_COPY;
 };
 
+/*
+ * Can input dump format memory be read by several threads in parallel?
+ */
+int dfi_feat_par(void)
+{
+	return l.dfi->feat_bits & DFI_FEAT_PAR;
+};
+
 /*
  * Return DFI arch string
  */
@@ -878,6 +1033,43 @@ free:
 	mem_update(&l.mem_virt);
 }
 
+/*
+ * Restrict memory to the ranges of the sorted vector "vec"
+ *
+ * Memory outside of the ranges is unmapped. In contrast to mem_unmap() the
+ * chunk list is walked only once, so also a large number of small ranges
+ * can be processed.
+ */
+void dfi_mem_restrict(struct dfi_mem_range *vec, unsigned long cnt)
+{
+	unsigned long i = 0, j, chunk_cnt;
+	struct dfi_mem_chunk *mem_chunk;
+	u64 start, end, start_phys;
+
+	chunk_cnt = util_list_len(&l.mem_virt.chunk_list);
+	while (chunk_cnt--) {
+		/* New chunks are added at the tail, old ones are sorted */
+		mem_chunk = util_list_start(&l.mem_virt.chunk_list);
+		start_phys = mem_chunk_start_phys(mem_chunk);
+		while (i < cnt &&
+		       vec[i].start + vec[i].size <= mem_chunk->start)
+			i++;
+		for (j = i; j < cnt && vec[j].start <= mem_chunk->end; j++) {
+			start = MAX(vec[j].start, mem_chunk->start);
+			end = MIN(vec[j].start + vec[j].size - 1,
+				  mem_chunk->end);
+			mem_chunk_virt_add(start, end - start + 1, start_phys +
+					   start - mem_chunk->start);
+		}
+		util_list_remove(&l.mem_virt.chunk_list, mem_chunk);
+		if (mem_chunk->data && mem_chunk->free_fn)
+			mem_chunk->free_fn(mem_chunk->data);
+		zg_free(mem_chunk);
+	}
+	l.mem_virt.chunk_cnt = util_list_len(&l.mem_virt.chunk_list);
+	mem_update(&l.mem_virt);
+}
+
 /*
  * Map memory region
  */
@@ -899,6 +1091,9 @@ static void kdump_init(void)
 {
 	unsigned long base, size;
 
+	/* Incremental snapshots do not always contain the lowcore */
+	if (!dfi_mem_range_valid(0x10418, sizeof(base) + sizeof(size)))
+		return;
 	mem_read(&l.mem_phys, 0x10418, &base, sizeof(base));
 	mem_read(&l.mem_phys, 0x10420, &size, sizeof(size));
 	if (base == 0 || size == 0)
@@ -143,9 +143,31 @@ struct dfi_mem_chunk {
 	void			*data;		/* Data for callback */
 };
 
+/*
+ * Location of memory chunk that is stored uncompressed in a file
+ */
+struct dfi_mem_file {
+	struct zg_fh	*fh;
+	u64		off;		/* File offset of chunk start */
+};
+
+/*
+ * Memory range
+ */
+struct dfi_mem_range {
+	u64	start;
+	u64	size;
+};
+
 extern void dfi_mem_chunk_add(u64 start, u64 size, void *data,
 			      dfi_mem_chunk_read_fn read_fn,
 			      dfi_mem_chunk_free_fn free_fn);
+extern void dfi_mem_chunk_add_file(u64 start, u64 size, struct zg_fh *fh,
+				   u64 off);
+extern u64 dfi_mem_chunk_file_map(struct dfi_mem_chunk *mem_chunk, u64 off,
+				  u64 cnt, struct zg_fh **fh, u64 *file_off);
+extern int dfi_mem_aio_start(unsigned int depth, int odirect);
+extern void dfi_mem_restrict(struct dfi_mem_range *vec, unsigned long cnt);
 extern u64 dfi_mem_range(void);
 extern int dfi_mem_range_valid(u64 addr, u64 len);
 extern unsigned int dfi_mem_chunk_cnt(void);
@@ -203,9 +225,11 @@ extern void dfi_info_print(void);
  */
 #define DFI_FEAT_SEEK	0x1 /* Necessary for fuse mount */
 #define DFI_FEAT_COPY	0x2 /* Necessary for stdout */
+#define DFI_FEAT_PAR	0x4 /* Memory can be read by several threads */
 
 extern int dfi_feat_seek(void);
 extern int dfi_feat_copy(void);
+extern int dfi_feat_par(void);
 
 /*
  * DFI kdump functions
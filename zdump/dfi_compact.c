@@ -0,0 +1,287 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Compact zfcpdump dump input format
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <zlib.h>
+#include <pthread.h>
+#include "zgetdump.h"
+
+/*
+ * ELF load of the original dump
+ */
+struct compact_load {
+	u64	off;		/* Offset in the original ELF dump */
+	u64	filesz;
+};
+
+/*
+ * File local static data
+ *
+ * The block index is sorted by the offset in the original ELF dump. The
+ * last decoded block is cached for reads that do not cover full blocks.
+ */
+static struct {
+	struct df_compact_hdr	hdr;
+	struct df_compact_blk	*blk_vec;
+	u64			blk_cnt;
+	pthread_mutex_t		lock;
+	struct df_compact_blk	*cache_blk;
+	void			*cache_buf;
+} l;
+
+/*
+ * Block compare function for qsort and bsearch
+ *
+ * For bsearch the key is a block with size one at the searched offset.
+ */
+static int blk_cmp_fn(const void *a, const void *b)
+{
+	const struct df_compact_blk *key = a, *blk = b;
+
+	if (key->off < blk->off)
+		return -1;
+	if (key->off >= blk->off + blk->size)
+		return 1;
+	return 0;
+}
+
+/*
+ * Find block that contains offset "off" of the original ELF dump
+ */
+static struct df_compact_blk *blk_find(u64 off)
+{
+	struct df_compact_blk key;
+
+	key.off = off;
+	key.size = 1;
+	return bsearch(&key, l.blk_vec, l.blk_cnt, sizeof(*l.blk_vec),
+		       blk_cmp_fn);
+}
+
+/*
+ * Check if page "pg" of block is stored in the dump
+ */
+static int blk_page_stored(struct df_compact_blk *blk, u64 pg)
+{
+	return blk->page_map[pg / 8] & (1 << (pg % 8));
+}
+
+/*
+ * Move the "len" bytes of stored pages at the start of "buf" to their
+ * block positions and zero all pages that are not stored
+ *
+ * The pages are processed backwards, so the stored pages are never
+ * overwritten before they have been moved.
+ */
+static void blk_expand(struct df_compact_blk *blk, void *buf, u64 len)
+{
+	u64 pg, size;
+
+	for (pg = ROUNDUP(blk->size, PAGE_SIZE) / PAGE_SIZE; pg-- > 0;) {
+		size = MIN(PAGE_SIZE, blk->size - pg * PAGE_SIZE);
+		if (!blk_page_stored(blk, pg)) {
+			memset(buf + pg * PAGE_SIZE, 0, size);
+			continue;
+		}
+		if (len < size)
+			break;
+		len -= size;
+		memmove(buf + pg * PAGE_SIZE, buf + len, size);
+	}
+	if (len != 0 || pg != (u64) -1)
+		ERR_EXIT("Compact dump block at 0x%llx is invalid",
+			 (unsigned long long) blk->off);
+}
+
+/*
+ * Decode block into "buf" that has the size of the block
+ */
+static void blk_decode(struct df_compact_blk *blk, void *buf)
+{
+	uLongf len = blk->size;
+	void *zbuf;
+	int rc;
+
+	if (!(blk->flags & DF_COMPACT_BLK_ZLIB)) {
+		/* Blocks with only zero pages have no data */
+		if (blk->data_size)
+			zg_pread(g.fh, buf, blk->data_size, blk->data_off,
+				 ZG_CHECK);
+		blk_expand(blk, buf, blk->data_size);
+		return;
+	}
+	zbuf = zg_alloc(blk->data_size);
+	zg_pread(g.fh, zbuf, blk->data_size, blk->data_off, ZG_CHECK);
+	rc = uncompress(buf, &len, zbuf, blk->data_size);
+	zg_free(zbuf);
+	if (rc != Z_OK)
+		ERR_EXIT("Compact dump block at 0x%llx is corrupted",
+			 (unsigned long long) blk->off);
+	blk_expand(blk, buf, len);
+}
+
+/*
+ * Read "cnt" bytes at offset "off" of block
+ *
+ * Full blocks are decoded directly into "buf". Otherwise the block is
+ * decoded outside of the lock and then stored in the cache.
+ */
+static void blk_read(struct df_compact_blk *blk, u64 off, void *buf, u64 cnt)
+{
+	void *tmp;
+
+	if (off == 0 && cnt == blk->size) {
+		blk_decode(blk, buf);
+		return;
+	}
+	pthread_mutex_lock(&l.lock);
+	if (l.cache_blk == blk) {
+		memcpy(buf, l.cache_buf + off, cnt);
+		pthread_mutex_unlock(&l.lock);
+		return;
+	}
+	pthread_mutex_unlock(&l.lock);
+	tmp = zg_alloc(l.hdr.blk_size);
+	blk_decode(blk, tmp);
+	memcpy(buf, tmp + off, cnt);
+	pthread_mutex_lock(&l.lock);
+	zg_free(l.cache_buf);
+	l.cache_buf = tmp;
+	l.cache_blk = blk;
+	pthread_mutex_unlock(&l.lock);
+}
+
+/*
+ * Read memory for memory chunk of ELF load
+ */
+static void dfi_compact_mem_chunk_read_fn(struct dfi_mem_chunk *mem_chunk,
+					  u64 off, void *buf, u64 cnt)
+{
+	struct compact_load *load = mem_chunk->data;
+	struct df_compact_blk *blk;
+	u64 blk_off, size;
+
+	while (cnt) {
+		/* Bytes beyond p_filesz are zero */
+		if (off >= load->filesz) {
+			memset(buf, 0, cnt);
+			return;
+		}
+		blk = blk_find(load->off + off);
+		if (!blk)
+			ERR_EXIT("Compact dump has no data for offset 0x%llx",
+				 (unsigned long long) (load->off + off));
+		blk_off = load->off + off - blk->off;
+		size = MIN(cnt, blk->size - blk_off);
+		size = MIN(size, load->filesz - off);
+		blk_read(blk, blk_off, buf, size);
+		buf += size;
+		off += size;
+		cnt -= size;
+	}
+}
+
+/*
+ * Add load (memory chunk) to DFI dump
+ */
+static int pt_load_add(Elf64_Phdr *phdr)
+{
+	struct compact_load *load;
+
+	if (phdr->p_memsz == 0)
+		return 0;
+	if (phdr->p_offset + phdr->p_filesz > l.hdr.elf_size)
+		return -EINVAL;
+	load = zg_alloc(sizeof(*load));
+	load->off = phdr->p_offset;
+	load->filesz = phdr->p_filesz;
+	dfi_mem_chunk_add(phdr->p_vaddr, phdr->p_memsz, load,
+			  dfi_compact_mem_chunk_read_fn, NULL);
+	return 0;
+}
+
+/*
+ * Read and verify block index
+ */
+static int idx_read(void)
+{
+	struct df_compact_blk *blk;
+	u64 i, size = zg_size(g.fh);
+
+	if (l.hdr.blk_cnt > (size - l.hdr.idx_off) / sizeof(*l.blk_vec))
+		return -EINVAL;
+	l.blk_cnt = l.hdr.blk_cnt;
+	l.blk_vec = zg_alloc(l.blk_cnt * sizeof(*l.blk_vec));
+	zg_pread(g.fh, l.blk_vec, l.blk_cnt * sizeof(*l.blk_vec),
+		 l.hdr.idx_off, ZG_CHECK);
+	qsort(l.blk_vec, l.blk_cnt, sizeof(*l.blk_vec), blk_cmp_fn);
+	for (i = 0; i < l.blk_cnt; i++) {
+		blk = &l.blk_vec[i];
+		if (blk->size == 0 || blk->size > l.hdr.blk_size)
+			return -EINVAL;
+		if (!(blk->flags & DF_COMPACT_BLK_ZLIB) &&
+		    blk->data_size > blk->size)
+			return -EINVAL;
+		if (blk->data_off + blk->data_size > size)
+			return -EINVAL;
+		if (i > 0 && blk[-1].off + blk[-1].size > blk->off)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Print dump information (dfi operation)
+ */
+static void dfi_compact_info_dump(void)
+{
+	u64 i, zcnt = 0;
+
+	for (i = 0; i < l.blk_cnt; i++) {
+		if (l.blk_vec[i].flags & DF_COMPACT_BLK_ZLIB)
+			zcnt++;
+	}
+	STDERR("  Compact blocks.....: %llu (%llu compressed)\n",
+	       (unsigned long long) l.blk_cnt, (unsigned long long) zcnt);
+	STDERR("  Compact dump size..: %llu MB (ELF dump size: %llu MB)\n",
+	       TO_MIB(l.hdr.dump_size), TO_MIB(l.hdr.elf_size));
+}
+
+/*
+ * Initialize compact input dump format
+ */
+static int dfi_compact_init(void)
+{
+	if (zg_size(g.fh) < sizeof(l.hdr))
+		return -ENODEV;
+	zg_read(g.fh, &l.hdr, sizeof(l.hdr), ZG_CHECK);
+	if (l.hdr.magic != DF_COMPACT_MAGIC)
+		return -ENODEV;
+	if (l.hdr.version != DF_COMPACT_VERSION)
+		ERR_EXIT("Compact dump version %u is not supported",
+			 l.hdr.version);
+	if (l.hdr.blk_size != DF_COMPACT_BLK_SIZE ||
+	    l.hdr.dump_size > zg_size(g.fh) ||
+	    l.hdr.idx_off > l.hdr.dump_size)
+		return -EINVAL;
+	if (idx_read())
+		return -EINVAL;
+	pthread_mutex_init(&l.lock, NULL);
+	if (dfi_elf_hdr_read(l.hdr.elf_hdr_off, pt_load_add))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Compact DFI operations
+ */
+struct dfi dfi_compact = {
+	.name		= "compact",
+	.init		= dfi_compact_init,
+	.info_dump	= dfi_compact_info_dump,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
+};
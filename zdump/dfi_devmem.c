@@ -19,6 +19,17 @@
 #include <linux/fs.h>
 #include "zgetdump.h"
 
+/*
+ * File local static data
+ *
+ * The memory map of the system is remembered separately because the DFI
+ * memory chunks can be restricted, for example by "--snapshot".
+ */
+static struct {
+	struct dfi_mem_range	*range_vec;
+	unsigned int		range_cnt;
+} l;
+
 /*
  * Add live dump magic to buffer
  */
@@ -45,8 +56,9 @@ static void dfi_devmem_mem_chunk_read(struct dfi_mem_chunk *mem_chunk, u64 off,
 		len = MIN(len, PAGE_SIZE - off % PAGE_SIZE);
 	len = MIN(len, cnt);
 	do {
-		zg_seek(g.fh, mem_chunk->start + off + copied, ZG_CHECK);
-		if (zg_read(g.fh, buf + copied, len, ZG_CHECK_NONE) < 0) {
+		if (zg_pread(g.fh, buf + copied, len,
+			     mem_chunk->start + off + copied,
+			     ZG_CHECK_NONE) < 0) {
 			if (errno == EFAULT) {
 				/* This can happen when using CMM */
 				memset(buf + copied, 0, len);
@@ -71,7 +83,7 @@ static int detect_mem_chunks(int check)
 {
 	char line[4096], type1[4096], type2[4096];
 	unsigned long start, end, cnt = 0;
-	struct dfi_mem_chunk *mem_chunk;
+	struct dfi_mem_range *range;
 	struct zg_fh *fh;
 	ssize_t rc;
 
@@ -86,20 +98,26 @@ static int detect_mem_chunks(int check)
 		if (strcmp(type2, "RAM") != 0 && strcmp(type2, "ROM") != 0)
 			continue;
 		if (check) {
-			mem_chunk = dfi_mem_chunk_find(start);
-			if (!mem_chunk)
+			if (cnt >= l.range_cnt)
 				return -EINVAL;
-			if (mem_chunk->start != start)
+			range = &l.range_vec[cnt];
+			if (range->start != start)
 				return -EINVAL;
-			if (mem_chunk->end != end)
+			if (range->size != end - start + 1)
 				return -EINVAL;
 			cnt++;
 		} else {
 			dfi_mem_chunk_add(start, end - start + 1, NULL,
 					  dfi_devmem_mem_chunk_read, NULL);
+			l.range_vec = zg_realloc(l.range_vec,
+						 (l.range_cnt + 1) *
+						 sizeof(*l.range_vec));
+			range = &l.range_vec[l.range_cnt++];
+			range->start = start;
+			range->size = end - start + 1;
 		}
 	} while (1);
-	if (check && cnt != dfi_mem_chunk_cnt())
+	if (check && cnt != l.range_cnt)
 		return -EINVAL;
 	return 0;
 }
@@ -151,5 +169,5 @@ struct dfi dfi_devmem = {
 	.name		= "devmem",
 	.init		= dfi_devmem_init,
 	.exit		= dfi_devmem_exit,
-	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
 };
@@ -16,15 +16,12 @@
 #include "zgetdump.h"
 
 /*
- * Read memory for given memory chunk
+ * Read memory for zero filled part of load (p_memsz > p_filesz)
  */
-static void dfi_elf_mem_chunk_read_fn(struct dfi_mem_chunk *mem_chunk, u64 off,
-				      void *buf, u64 cnt)
+static void dfi_elf_mem_chunk_zero_fn(struct dfi_mem_chunk *UNUSED(chunk),
+				      u64 UNUSED(off), void *buf, u64 cnt)
 {
-	u64 elf_load_off = *((u64 *) mem_chunk->data);
-
-	zg_seek(g.fh, elf_load_off + off, ZG_CHECK);
-	zg_read(g.fh, buf, cnt, ZG_CHECK);
+	memset(buf, 0, cnt);
 }
 
 /*
@@ -32,21 +29,22 @@ static void dfi_elf_mem_chunk_read_fn(struct dfi_mem_chunk *mem_chunk, u64 off,
  */
 static int pt_load_add(Elf64_Phdr *phdr)
 {
-	u64 *off_ptr;
-
 	if (phdr->p_paddr != phdr->p_vaddr) {
 		phdr->p_paddr = phdr->p_vaddr;
 		STDERR("Dump file \"%s\" is a user space core dump\n",
 		      g.opts.device);
 	}
-	if (phdr->p_filesz == 0) /* Skip null pt loads */
-		return 0;
-	off_ptr = zg_alloc(sizeof(*off_ptr));
-	*off_ptr = phdr->p_offset;
-	dfi_mem_chunk_add(phdr->p_paddr, phdr->p_filesz, off_ptr,
-			  dfi_elf_mem_chunk_read_fn, zg_free);
-	if (phdr->p_offset + phdr->p_filesz > zg_size(g.fh))
-		return -EINVAL;
+	if (phdr->p_filesz != 0) { /* Skip null pt loads */
+		dfi_mem_chunk_add_file(phdr->p_paddr, phdr->p_filesz, g.fh,
+				       phdr->p_offset);
+		if (phdr->p_offset + phdr->p_filesz > zg_size(g.fh))
+			return -EINVAL;
+	}
+	/* Bytes beyond p_filesz are zero and are not stored in the file */
+	if (phdr->p_memsz > phdr->p_filesz)
+		dfi_mem_chunk_add(phdr->p_paddr + phdr->p_filesz,
+				  phdr->p_memsz - phdr->p_filesz, NULL,
+				  dfi_elf_mem_chunk_zero_fn, NULL);
 	return 0;
 }
 
@@ -173,9 +171,9 @@ static int nt_s390_prefix_read(struct dfi_cpu *cpu, Elf64_Nhdr *note)
 }
 
 /*
- * Add all notes for notes phdr
+ * Add all notes for notes phdr of ELF header at file offset "off"
  */
-static int pt_notes_add(Elf64_Phdr *phdr)
+static int pt_notes_add(Elf64_Phdr *phdr, u64 off)
 {
 	u64 start_off = zg_tell(g.fh, ZG_CHECK);
 	struct dfi_cpu *cpu_current = NULL;
@@ -183,7 +181,7 @@ static int pt_notes_add(Elf64_Phdr *phdr)
 	Elf64_Nhdr note;
 	int rc;
 
-	zg_seek(g.fh, phdr->p_offset, ZG_CHECK);
+	zg_seek(g.fh, off + phdr->p_offset, ZG_CHECK);
 	notes_start_off = zg_tell(g.fh, ZG_CHECK);
 	while (zg_tell(g.fh, ZG_CHECK) - notes_start_off < phdr->p_filesz) {
 		rc = zg_read(g.fh, &note, sizeof(note), ZG_CHECK_ERR);
@@ -230,12 +228,13 @@ static int pt_notes_add(Elf64_Phdr *phdr)
 }
 
 /*
- * Read ELF header
+ * Read ELF header at file offset "off"
  */
-static int read_elf_hdr(Elf64_Ehdr *ehdr)
+static int read_elf_hdr(Elf64_Ehdr *ehdr, u64 off)
 {
-	if (zg_size(g.fh) < sizeof(*ehdr))
+	if (zg_size(g.fh) < off + sizeof(*ehdr))
 		return -ENODEV;
+	zg_seek(g.fh, off, ZG_CHECK);
 	zg_read(g.fh, ehdr, sizeof(*ehdr), ZG_CHECK);
 	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
 		return -ENODEV;
@@ -247,15 +246,19 @@ static int read_elf_hdr(Elf64_Ehdr *ehdr)
 }
 
 /*
- * Initialize ELF input dump format
+ * Read ELF header and notes at file offset "off"
+ *
+ * The file offsets of the program headers are relative to "off". The
+ * loads are passed to "load_fn". This is also used for the ELF header
+ * that is stored in compact zfcpdump dumps.
  */
-static int dfi_elf_init(void)
+int dfi_elf_hdr_read(u64 off, int (*load_fn)(Elf64_Phdr *phdr))
 {
 	Elf64_Ehdr ehdr;
 	Elf64_Phdr phdr;
 	int i;
 
-	if (read_elf_hdr(&ehdr) != 0)
+	if (read_elf_hdr(&ehdr, off) != 0)
 		return -ENODEV;
 
 	df_elf_ensure_s390x();
@@ -266,11 +269,11 @@ static int dfi_elf_init(void)
 		zg_read(g.fh, &phdr, sizeof(phdr), ZG_CHECK);
 		switch (phdr.p_type) {
 		case PT_LOAD:
-			if (pt_load_add(&phdr))
+			if (load_fn(&phdr))
 				return -EINVAL;
 			break;
 		case PT_NOTE:
-			if (pt_notes_add(&phdr))
+			if (pt_notes_add(&phdr, off))
 				return -EINVAL;
 			break;
 		default:
@@ -281,11 +284,19 @@ static int dfi_elf_init(void)
 	return 0;
 }
 
+/*
+ * Initialize ELF input dump format
+ */
+static int dfi_elf_init(void)
+{
+	return dfi_elf_hdr_read(0, pt_load_add);
+}
+
 /*
  * ELF DFI operations
  */
 struct dfi dfi_elf = {
 	.name		= "elf",
 	.init		= dfi_elf_init,
-	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
 };
@@ -11,95 +11,167 @@
 #include "zgetdump.h"
 
 #define MEM_HOLE_SIZE_MIN	(1024 * 1024)
-#define IDX_KIB		64	/* One index entry per IDX_KIB */
-#define IDX_TO_ADDR(idx) (idx * IDX_KIB * 1024)
-#define ADDR_TO_IDX(addr) (addr / (1024 * IDX_KIB))
+#define IDX_SUFFIX		".zidx"
+#define IDX_VERSION		2
+#define BATCH_PG_MAX		64	/* Maximum pages per read batch */
 
 /*
  * File local static data
+ *
+ * For flex dumps "pg_off" contains the file offset of the page header for
+ * each dump page or zero, if the page is not contained in the dump.
  */
 static struct {
-	u64			*pg_hdr_idx;
-	u64			page_last;
+	u64			*pg_off;
+	u64			pg_cnt;
+	char			idx_path[PATH_MAX];
 	struct df_lkcd_hdr	hdr;
 	struct df_lkcd_hdr_asm	hdr_asm;
 	int			dump_full;
 } l;
 
 /*
- * Read LKCD page buffer, either compressed or uncompressed
+ * Batch of dump pages that is read from the dump file with one pread() call
+ *
+ * The batch contains the pages "pg_start" up to "pg_end" - 1 with their
+ * page headers as they are stored in the dump file.
+ */
+struct batch {
+	u64		pg_start;	/* First page of batch */
+	u64		pg_end;		/* First page after batch */
+	u64		off;		/* File offset of "buf" */
+	u64		len;		/* Number of valid bytes in "buf" */
+	u64		size;		/* Size of "buf" */
+	char		*buf;		/* Page headers and page data */
+	z_stream	zs;		/* Inflate stream reused for all pages */
+	int		zs_init;	/* Inflate stream has been initialized */
+};
+
+/*
+ * Return file offset of page header for page "pg_num" (0 if not present)
  */
-static void read_page_buf(struct df_lkcd_pg_hdr *pg_hdr, void *buf)
+static u64 pg_off(u64 pg_num)
 {
-	unsigned long size = PAGE_SIZE;
-	unsigned char cbuf[PAGE_SIZE];
+	return pg_num < l.pg_cnt ? l.pg_off[pg_num] : 0;
+}
 
-	switch (pg_hdr->flags) {
-	case DF_LKCD_DH_RAW:
-		zg_read(g.fh, buf, pg_hdr->size, ZG_CHECK);
-		break;
-	case DF_LKCD_DH_COMPRESSED:
-		zg_read(g.fh, cbuf, pg_hdr->size, ZG_CHECK);
-		uncompress(buf, &size, cbuf, pg_hdr->size);
-		if (size != PAGE_SIZE)
-			ABORT("Invalid page size: %ld", size);
-		break;
-	default:
-		ERR_EXIT("Unsupported page flags: %x at addr %Lx",
-			 pg_hdr->flags, pg_hdr->addr);
-	}
+/*
+ * Initialize batch for reading "pg_cnt" pages
+ */
+static void batch_init(struct batch *b, u64 pg_cnt)
+{
+	memset(b, 0, sizeof(*b));
+	b->size = MIN(pg_cnt, BATCH_PG_MAX) * DF_LKCD_UCP_SIZE;
+	b->buf = zg_alloc(b->size);
 }
 
 /*
- * Read next LKCD page from current file position
- *
- * If we find the page, we copy the page content. If the page is not present
- * we copy zeroes and skip it. If the page address is not yet reached, we just
- * skip it.
+ * Free batch resources
  */
-static int read_next_page(u64 addr, void *buf)
+static void batch_exit(struct batch *b)
 {
-	struct df_lkcd_pg_hdr pg_hdr;
+	if (b->zs_init)
+		inflateEnd(&b->zs);
+	zg_free(b->buf);
+}
 
-	zg_read(g.fh, &pg_hdr, sizeof(pg_hdr), ZG_CHECK);
-	l.page_last = pg_hdr.addr / PAGE_SIZE;
-	if (pg_hdr.addr == addr) {
-		read_page_buf(&pg_hdr, buf);
-		return 0;
+/*
+ * Read batch starting with page "pg_start" and ending at most with
+ * page "pg_end" - 1
+ *
+ * The batch ends early if the buffer is full or the pages are not stored
+ * in ascending order in the dump file.
+ */
+static void batch_read(struct batch *b, u64 pg_start, u64 pg_end)
+{
+	u64 pg_num, off, off_prev = 0, off_start = 0, off_end = 0;
+
+	for (pg_num = pg_start; pg_num < pg_end; pg_num++) {
+		off = pg_off(pg_num);
+		if (off == 0)
+			continue;
+		if (off_start == 0) {
+			off_start = off;
+		} else if (off < off_prev + sizeof(struct df_lkcd_pg_hdr) ||
+			   off + DF_LKCD_UCP_SIZE - off_start > b->size) {
+			break;
+		}
+		off_end = off + DF_LKCD_UCP_SIZE;
+		off_prev = off;
 	}
-	if (pg_hdr.addr > addr) {
-		memset(buf, 0, PAGE_SIZE);
-		zg_seek_cur(g.fh, pg_hdr.size, ZG_CHECK);
-		return 0;
+	b->pg_start = pg_start;
+	b->pg_end = pg_num;
+	b->off = off_start;
+	if (off_start == 0)
+		b->len = 0;
+	else
+		b->len = zg_pread(g.fh, b->buf, off_end - off_start,
+				  off_start, ZG_CHECK_ERR);
+}
+
+/*
+ * Inflate compressed page
+ */
+static void page_inflate(struct batch *b, void *cbuf, u32 size, void *buf)
+{
+	int rc;
+
+	if (!b->zs_init) {
+		if (inflateInit(&b->zs) != Z_OK)
+			ABORT("Could not initialize zlib");
+		b->zs_init = 1;
+	} else if (inflateReset(&b->zs) != Z_OK) {
+		ABORT("Could not reset zlib");
 	}
-	zg_seek_cur(g.fh, pg_hdr.size, ZG_CHECK);
-	return -ENODEV;
+	b->zs.next_in = cbuf;
+	b->zs.avail_in = size;
+	b->zs.next_out = buf;
+	b->zs.avail_out = PAGE_SIZE;
+	rc = inflate(&b->zs, Z_FINISH);
+	if (rc != Z_STREAM_END || b->zs.total_out != PAGE_SIZE)
+		ABORT("Invalid page size: %ld", b->zs.total_out);
 }
 
 /*
- * Read LKCD dump page for flex dump
+ * Copy page "pg_num" from batch into "buf", either compressed or
+ * uncompressed
  *
- * If the page after the last read page should be read, we just read
- * the next one. Otherwise we seek to the beginning of the page cluster
- * of the page index and search the page there.
+ * If the page is not present, we copy zeroes.
  */
-static void read_page_flex(u64 pg_num, void *buf)
+static void batch_page_copy(struct batch *b, u64 pg_num, void *buf)
 {
-	u64 addr = pg_num * PAGE_SIZE;
-
-	if (l.pg_hdr_idx[ADDR_TO_IDX(addr)] == 0)
-		ABORT("Dump page index broken");
+	struct df_lkcd_pg_hdr pg_hdr;
+	u64 off = pg_off(pg_num);
+	char *data;
 
-	if (l.page_last == pg_num - 1) {
-		read_next_page(addr, buf);
+	if (off == 0) {
+		memset(buf, 0, PAGE_SIZE);
 		return;
 	}
-
-	zg_seek(g.fh, l.pg_hdr_idx[ADDR_TO_IDX(addr)], ZG_CHECK);
-	do {
-		if (read_next_page(addr, buf) == 0)
-			break;
-	} while (1);
+	off -= b->off;
+	if (off + sizeof(pg_hdr) > b->len)
+		goto fail_eof;
+	memcpy(&pg_hdr, b->buf + off, sizeof(pg_hdr));
+	if (off + sizeof(pg_hdr) + pg_hdr.size > b->len)
+		goto fail_eof;
+	if (pg_hdr.size > PAGE_SIZE)
+		ABORT("Invalid page size: %u", pg_hdr.size);
+	data = b->buf + off + sizeof(pg_hdr);
+
+	switch (pg_hdr.flags) {
+	case DF_LKCD_DH_RAW:
+		memcpy(buf, data, pg_hdr.size);
+		break;
+	case DF_LKCD_DH_COMPRESSED:
+		page_inflate(b, data, pg_hdr.size, buf);
+		break;
+	default:
+		ERR_EXIT("Unsupported page flags: %x at addr %Lx",
+			 pg_hdr.flags, pg_hdr.addr);
+	}
+	return;
+fail_eof:
+	ERR_EXIT("Unexpected end of file for \"%s\"", zg_path(g.fh));
 }
 
 /*
@@ -107,40 +179,47 @@ static void read_page_flex(u64 pg_num, void *buf)
  */
 static void read_page_full(u64 pg_num, void *buf)
 {
-	zg_seek(g.fh, DF_LKCD_HDR_SIZE + pg_num * DF_LKCD_UCP_SIZE +
-		sizeof(struct df_lkcd_pg_hdr), ZG_CHECK);
-	zg_read(g.fh, buf, PAGE_SIZE, ZG_CHECK);
-}
-
-/*
- * Read lkcd page
- */
-static void read_page(u64 pg_num, void *buf)
-{
-	if (l.dump_full)
-		read_page_full(pg_num, buf);
-	else
-		read_page_flex(pg_num, buf);
+	zg_pread(g.fh, buf, PAGE_SIZE, DF_LKCD_HDR_SIZE +
+		 pg_num * DF_LKCD_UCP_SIZE + sizeof(struct df_lkcd_pg_hdr),
+		 ZG_CHECK);
 }
 
 /*
  * LKCD mem chunk read callback
+ *
+ * For flex dumps the requested pages are read in batches with one pread()
+ * call. Complete pages are decompressed directly into "buf".
  */
 static void dfi_lkcd_mem_chunk_read_fn(struct dfi_mem_chunk *mem_chunk, u64 off,
 				       void *buf, u64 cnt)
 {
-	u64 copied = 0, size, pg_nr, addr = off + mem_chunk->start;
-	char pg_buf[PAGE_SIZE];
+	u64 copied = 0, size, pg_nr, pg_end, addr = off + mem_chunk->start;
+	char pg_buf[PAGE_SIZE], *dst;
 	unsigned int pg_off;
+	struct batch b;
 
+	pg_nr = addr / PAGE_SIZE;
+	pg_end = (addr + cnt + PAGE_SIZE - 1) / PAGE_SIZE;
+	if (!l.dump_full)
+		batch_init(&b, pg_end - pg_nr);
 	while (copied != cnt) {
 		pg_nr = (addr + copied) / PAGE_SIZE;
 		pg_off = (addr + copied) % PAGE_SIZE;
 		size = MIN(cnt - copied, PAGE_SIZE - pg_off);
-		read_page(pg_nr, pg_buf);
-		memcpy(buf + copied, &pg_buf[pg_off], size);
+		dst = (size == PAGE_SIZE) ? buf + copied : pg_buf;
+		if (l.dump_full) {
+			read_page_full(pg_nr, dst);
+		} else {
+			if (pg_nr < b.pg_start || pg_nr >= b.pg_end)
+				batch_read(&b, pg_nr, pg_end);
+			batch_page_copy(&b, pg_nr, dst);
+		}
+		if (dst == pg_buf)
+			memcpy(buf + copied, &pg_buf[pg_off], size);
 		copied += size;
 	}
+	if (!l.dump_full)
+		batch_exit(&b);
 }
 
 /*
@@ -181,55 +260,184 @@ static int mem_init_full(void)
 }
 
 /*
- * Init memory chunks for flex dump
- *
- * Flex dump: It is compressed and/or it has memory holes.
+ * Build page index by scanning all page headers of the dump
  */
-static int mem_init_flex(void)
+static int idx_build(void)
 {
-	u64 addr = U64_MAX, idx = 0, mem_chunk_start = 0, rc;
+	u64 addr = U64_MAX, off = DF_LKCD_HDR_SIZE;
 	struct df_lkcd_pg_hdr pg_hdr;
-	int dump_incomplete = 0;
+	int rc = 0;
 
-	l.pg_hdr_idx = zg_alloc(sizeof(u64) * (ADDR_TO_IDX(l.hdr.mem_end) + 1));
-	zg_seek(g.fh, DF_LKCD_HDR_SIZE, ZG_CHECK_NONE);
 	zg_progress_init("Analyzing dump", l.hdr.mem_end);
 	do {
-		rc = zg_read(g.fh, &pg_hdr, sizeof(pg_hdr), ZG_CHECK_ERR);
-		if (rc != sizeof(pg_hdr)) {
-			dump_incomplete = 1;
+		if (zg_pread(g.fh, &pg_hdr, sizeof(pg_hdr), off,
+			     ZG_CHECK_ERR) != sizeof(pg_hdr)) {
+			rc = -EINVAL;
 			break;
 		}
 		if (dump_end(addr, &pg_hdr))
 			break;
-		if (pg_hdr.addr - addr > MEM_HOLE_SIZE_MIN) {
+		addr = pg_hdr.addr;
+		zg_progress(addr);
+		if (addr / PAGE_SIZE < l.pg_cnt)
+			l.pg_off[addr / PAGE_SIZE] = off;
+		off += sizeof(pg_hdr) + pg_hdr.size;
+	} while (1);
+	zg_progress(l.hdr.mem_end);
+	if (g.opts.action != ZG_ACTION_MOUNT)
+		fprintf(stderr, "\n");
+	return rc;
+}
+
+/*
+ * Initialize index file header for the current dump
+ */
+static void idx_hdr_init(struct df_lkcd_idx_hdr *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = DF_LKCD_IDX_MAGIC;
+	hdr->version = IDX_VERSION;
+	hdr->dump_size = zg_size(g.fh);
+	hdr->dump_mtime = zg_stat(g.fh)->st_mtime;
+	hdr->dump_mtime_ns = zg_stat(g.fh)->st_mtim.tv_nsec;
+	hdr->dump_ino = zg_stat(g.fh)->st_ino;
+	hdr->dump_time = l.hdr.time_tv_sec;
+	hdr->pg_cnt = l.pg_cnt;
+}
+
+/*
+ * Load page index from index file
+ *
+ * The index file is only used if it has been created for the same dump
+ * file, that is, dump size, inode, and modification time (including
+ * nanoseconds) have not changed.
+ */
+static int idx_load(void)
+{
+	struct df_lkcd_idx_hdr hdr, hdr_exp;
+	u64 size = l.pg_cnt * sizeof(u64);
+	struct zg_fh *fh;
+	int rc = -EINVAL;
+
+	fh = zg_open(l.idx_path, O_RDONLY, ZG_CHECK_NONE);
+	if (!fh)
+		return -ENOENT;
+	idx_hdr_init(&hdr_exp);
+	if (zg_size(fh) != sizeof(hdr) + size)
+		goto out;
+	if (zg_read(fh, &hdr, sizeof(hdr), ZG_CHECK_NONE) != sizeof(hdr))
+		goto out;
+	if (memcmp(&hdr, &hdr_exp, sizeof(hdr)) != 0)
+		goto out;
+	if (zg_read(fh, l.pg_off, size, ZG_CHECK_NONE) != (ssize_t) size)
+		goto out;
+	rc = 0;
+out:
+	zg_close(fh);
+	return rc;
+}
+
+/*
+ * Write "cnt" bytes of "buf" to file descriptor "fd"
+ */
+static int idx_write(int fd, const void *buf, u64 cnt)
+{
+	u64 written = 0;
+	ssize_t rc;
+
+	while (written != cnt) {
+		rc = write(fd, buf + written, cnt - written);
+		if (rc <= 0)
+			return -EIO;
+		written += rc;
+	}
+	return 0;
+}
+
+/*
+ * Save page index to index file
+ *
+ * The file is written to a temporary file first and then renamed, so
+ * that concurrent zgetdump instances never see a partial index. Errors
+ * are ignored because the index file is only an optimization.
+ */
+static void idx_save(void)
+{
+	char tmp_path[PATH_MAX];
+	struct df_lkcd_idx_hdr hdr;
+	int fd, rc;
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d", l.idx_path,
+		     getpid()) >= (int) sizeof(tmp_path))
+		return;
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		return;
+	idx_hdr_init(&hdr);
+	rc = idx_write(fd, &hdr, sizeof(hdr));
+	if (rc == 0)
+		rc = idx_write(fd, l.pg_off, l.pg_cnt * sizeof(u64));
+	if (close(fd) != 0)
+		rc = -EIO;
+	if (rc == 0 && rename(tmp_path, l.idx_path) == 0)
+		return;
+	unlink(tmp_path);
+}
+
+/*
+ * Initialize page index
+ *
+ * For dump files the index is stored in "<dump>.zidx" so that the dump
+ * has to be scanned only once.
+ */
+static int idx_init(void)
+{
+	int use_file;
+
+	l.pg_cnt = PAGE_ALIGN(l.hdr.mem_end) / PAGE_SIZE;
+	l.pg_off = zg_alloc(l.pg_cnt * sizeof(u64));
+	use_file = zg_type(g.fh) == ZG_TYPE_FILE &&
+		snprintf(l.idx_path, sizeof(l.idx_path), "%s%s",
+			 zg_path(g.fh), IDX_SUFFIX) < (int) sizeof(l.idx_path);
+	if (use_file && idx_load() == 0)
+		return 0;
+	memset(l.pg_off, 0, l.pg_cnt * sizeof(u64));
+	if (idx_build() != 0)
+		return -EINVAL;
+	if (use_file)
+		idx_save();
+	return 0;
+}
+
+/*
+ * Init memory chunks for flex dump
+ *
+ * Flex dump: It is compressed and/or it has memory holes. Memory holes
+ * that are larger than MEM_HOLE_SIZE_MIN are not covered by memory chunks.
+ */
+static int mem_init_flex(void)
+{
+	u64 pg_num, addr = U64_MAX, mem_chunk_start = 0;
+
+	if (idx_init() != 0)
+		return -EINVAL;
+	for (pg_num = 0; pg_num < l.pg_cnt; pg_num++) {
+		if (l.pg_off[pg_num] == 0)
+			continue;
+		if (pg_num * PAGE_SIZE - addr > MEM_HOLE_SIZE_MIN) {
 			dfi_mem_chunk_add(mem_chunk_start,
 					  addr + PAGE_SIZE - mem_chunk_start,
 					  NULL, dfi_lkcd_mem_chunk_read_fn,
 					  NULL);
-			mem_chunk_start = pg_hdr.addr;
-		}
-		addr = pg_hdr.addr;
-		zg_progress(addr);
-		if (addr >= IDX_TO_ADDR(idx)) {
-			idx = ADDR_TO_IDX(addr);
-			l.pg_hdr_idx[idx] = zg_tell(g.fh, ZG_CHECK) -
-				sizeof(pg_hdr);
-			idx++;
+			mem_chunk_start = pg_num * PAGE_SIZE;
 		}
-		zg_seek_cur(g.fh, pg_hdr.size, ZG_CHECK);
-	} while (1);
-
+		addr = pg_num * PAGE_SIZE;
+	}
 	if (addr != mem_chunk_start) {
 		dfi_mem_chunk_add(mem_chunk_start,
 				  l.hdr.mem_end - mem_chunk_start,
 				  NULL, dfi_lkcd_mem_chunk_read_fn, NULL);
 	}
-	zg_progress(l.hdr.mem_end);
-	if (g.opts.action != ZG_ACTION_MOUNT)
-		fprintf(stderr, "\n");
-	if (dump_incomplete)
-		return -EINVAL;
 	return 0;
 }
 
@@ -329,5 +537,5 @@ static int dfi_lkcd_init(void)
 struct dfi dfi_lkcd = {
 	.name		= "lkcd",
 	.init		= dfi_lkcd_init,
-	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
 };
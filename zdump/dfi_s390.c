@@ -25,18 +25,6 @@ static struct {
 	struct df_s390_em	em;	/* s390 end marker */
 } l;
 
-/*
- * S390 mem chunk read callback
- */
-static void dfi_s390_mem_chunk_read(struct dfi_mem_chunk *mem_chunk, u64 off,
-				    void *buf, u64 cnt)
-{
-	(void) mem_chunk;
-
-	zg_seek(g.fh, off + DF_S390_HDR_SIZE, ZG_CHECK);
-	zg_read(g.fh, buf, cnt, ZG_CHECK);
-}
-
 /*
  * Read s390 dump header
  */
@@ -78,8 +66,7 @@ static int dfi_s390_init(void)
 {
 	if (read_s390_hdr() != 0)
 		return -ENODEV;
-	dfi_mem_chunk_add(0, l.hdr.mem_size, NULL, dfi_s390_mem_chunk_read,
-			  NULL);
+	dfi_mem_chunk_add_file(0, l.hdr.mem_size, g.fh, DF_S390_HDR_SIZE);
 	if (read_s390_em() != 0)
 		return -EINVAL;
 	df_s390_cpu_info_add(&l.hdr, l.hdr.mem_size);
@@ -93,5 +80,5 @@ static int dfi_s390_init(void)
 struct dfi dfi_s390 = {
 	.name		= "s390",
 	.init		= dfi_s390_init,
-	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
 };
@@ -7,6 +7,7 @@
  * Author(s): Michael Holzheu <holzheu@linux.vnet.ibm.com>
  */
 
+#include <pthread.h>
 #include <string.h>
 #include <time.h>
 #include <fcntl.h>
@@ -217,21 +218,9 @@ static void vol_read(struct vol *vol)
 }
 
 /*
- * Read memory
+ * Open DASD volume
  */
-static void df_s390mv_mem_read(struct dfi_mem_chunk *mem_chunk, u64 off,
-			       void *buf, u64 cnt)
-{
-	struct vol *vol = mem_chunk->data;
-
-	zg_seek(vol->fh, vol->part_off + off + DF_S390_HDR_SIZE, ZG_CHECK);
-	zg_read(vol->fh, buf, cnt, ZG_CHECK);
-}
-
-/*
- * Initialize DASD volume
- */
-static void vol_init(struct vol *vol, struct vol_parm *vol_parm, u64 *mem_off)
+static void vol_open(struct vol *vol, struct vol_parm *vol_parm)
 {
 	u64 blk_cnt = vol_parm->end_blk - vol_parm->start_blk + 1;
 
@@ -247,21 +236,41 @@ static void vol_init(struct vol *vol, struct vol_parm *vol_parm, u64 *mem_off)
 
 	vol->devnode = zg_devnode_create(vol->dev);
 	vol->fh = zg_open(vol->devnode, O_RDONLY, ZG_CHECK);
+}
+
+/*
+ * Read and verify DASD volume (reader thread)
+ *
+ * Each online volume is verified by its own thread, so that the I/O for
+ * all volumes is done in parallel.
+ */
+static void *vol_verify_fn(void *data)
+{
+	struct vol *vol = data;
 
 	vol_read(vol);
 
 	if ((vol->hdr.volnr == vol->nr) && (vol->hdr.mem_size != 0))
 		vol->sign = SIGN_ACTIVE;
 
-	if (vol->hdr.mvdump_sign != DF_S390_MAGIC) {
+	if (vol->hdr.mvdump_sign != DF_S390_MAGIC)
 		vol->sign = SIGN_INVALID;
-		l.dump_incomplete = 1;
-	}
 
-	if (strncmp(df_s390_dumper_magic(vol->dumper), "ZMULT64", 7) != 0) {
+	if (strncmp(df_s390_dumper_magic(vol->dumper), "ZMULT64", 7) != 0)
 		vol->sign = SIGN_INVALID;
+	return NULL;
+}
+
+/*
+ * Initialize memory range of DASD volume
+ */
+static void vol_mem_init(struct vol *vol, u64 *mem_off)
+{
+	if (vol->status != DEV_ONLINE)
+		return;
+
+	if (vol->sign == SIGN_INVALID)
 		l.dump_incomplete = 1;
-	}
 
 	if (vol->nr == 0)
 		l.hdr = vol->hdr;
@@ -319,9 +328,10 @@ static void mem_chunks_add(void)
 		struct vol *vol = &l.vol_vec[i];
 		if (vol->sign != SIGN_ACTIVE)
 			continue;
-		dfi_mem_chunk_add(vol->mem_start,
-				  vol->mem_end - vol->mem_start + 1,
-				  vol, df_s390mv_mem_read, NULL);
+		dfi_mem_chunk_add_file(vol->mem_start,
+				       vol->mem_end - vol->mem_start + 1,
+				       vol->fh,
+				       vol->part_off + DF_S390_HDR_SIZE);
 	}
 }
 
@@ -448,9 +458,15 @@ static int mv_dumper_read(void)
 
 /*
  * Initialize all volumes
+ *
+ * The volumes are opened one after the other. Then all online volumes are
+ * read and verified in parallel. Finally the memory layout is set up in
+ * volume order.
  */
 static void volumes_init(void)
 {
+	pthread_t thread_vec[MAX_VOLUMES];
+	struct vol *vol;
 	u64 mem_off = 0;
 	unsigned int i;
 
@@ -458,8 +474,21 @@ static void volumes_init(void)
 
 	for (i = 0; i < l.table.vol_cnt; i++) {
 		l.vol_vec[i].nr = i;
-		vol_init(&l.vol_vec[i], &l.table.vol_parm[i], &mem_off);
+		vol_open(&l.vol_vec[i], &l.table.vol_parm[i]);
+	}
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		vol = &l.vol_vec[i];
+		if (vol->status != DEV_ONLINE)
+			continue;
+		if (pthread_create(&thread_vec[i], NULL, vol_verify_fn, vol))
+			ERR_EXIT("Could not create volume thread");
 	}
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		if (l.vol_vec[i].status == DEV_ONLINE)
+			pthread_join(thread_vec[i], NULL);
+	}
+	for (i = 0; i < l.table.vol_cnt; i++)
+		vol_mem_init(&l.vol_vec[i], &mem_off);
 	if (mem_off != l.hdr.mem_size)
 		l.dump_incomplete = 1;
 }
@@ -543,5 +572,5 @@ struct dfi dfi_s390mv = {
 	.name		= "s390mv",
 	.init		= dfi_s390mv_init,
 	.info_dump	= dfi_s390mvfo_dump,
-	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK | DFI_FEAT_PAR,
 };
@@ -19,9 +19,19 @@
 static struct dfo *dfo_vec[] = {
 	&dfo_s390,
 	&dfo_elf,
+	&dfo_kdump,
 	NULL,
 };
 
+/*
+ * Dump chunk index entry: Range of the dump that is provided by "chunk"
+ */
+struct dump_idx {
+	u64			start;
+	u64			end;
+	struct dfo_chunk	*chunk;
+};
+
 /*
  * Dump (output) information
  */
@@ -30,6 +40,8 @@ struct dump {
 	u64		size;		/* Size of dump in bytes */
 	unsigned int	chunk_cnt;	/* Number of dump chunks */
 	struct util_list	chunk_list;	/* DFO chunk list */
+	struct dump_idx	*idx;		/* Sorted non-overlapping chunk index */
+	unsigned int	idx_cnt;	/* Number of index entries */
 };
 
 /*
@@ -87,6 +99,17 @@ void dfo_chunk_mem_fn(struct dfo_chunk *dfo_chunk, u64 off, void *buf, u64 cnt)
 	mem_chunk->read_fn(mem_chunk, off, buf, cnt);
 }
 
+/*
+ * Dump chunk function: Copy memory range that starts within memory chunk
+ */
+void dfo_chunk_mem_range_fn(struct dfo_chunk *dfo_chunk, u64 off, void *buf,
+			    u64 cnt)
+{
+	struct dfo_mem_range *range = dfo_chunk->data;
+
+	range->mem_chunk->read_fn(range->mem_chunk, range->off + off, buf, cnt);
+}
+
 /*
  * Get DFO name
  */
@@ -114,50 +137,135 @@ int dfo_set(const char *dfo_name)
 }
 
 /*
- * Initialize output dump format
+ * Compare function for sorting u64 values with qsort
  */
-void dfo_init(void)
+static int u64_cmp_fn(const void *a, const void *b)
 {
-	if (!l.dfo)
-		ABORT("DFO not set");
-	util_list_init(&l.dump.chunk_list, struct dfo_chunk, list);
-	l.dfo->init();
+	u64 val1 = *((const u64 *) a);
+	u64 val2 = *((const u64 *) b);
+
+	if (val1 == val2)
+		return 0;
+	return val1 < val2 ? -1 : 1;
 }
 
 /*
- * Find dump chunk for offset "off"
+ * Return index of "val" in sorted vector "vec"
+ */
+static unsigned int u64_vec_find(u64 *vec, unsigned int cnt, u64 val)
+{
+	unsigned int lo = 0, hi = cnt, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (vec[mid] < val)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Build the dump chunk index
  *
- * This function is a bit hacky. DFO chunks can overlap. If two DFO chunks
- * overlap, the last registered chunk wins. The dfo_chunk_find() function
- * reflects that by returning the first memory chunk that is found in
- * the dfo chunk list.
+ * DFO chunks can overlap. If two DFO chunks overlap, the last registered
+ * chunk wins. Because chunks are added to the head of the chunk list,
+ * this is the first chunk that is found in the list.
  *
- * In addition to that it calculates the "virtual end" of that chunk. An
- * overlapping chunk can limit the "virtual end" of an underlying chunk so
- * that the "virtual end" of that chunk is lower than the "real end".
+ * To resolve the overlaps only once, the dump is split into elementary
+ * ranges at all chunk start and end offsets. Each range is then assigned
+ * to the first chunk in the list that covers it. Finally adjacent ranges
+ * that belong to the same chunk are merged into one index entry.
  *
  * Example:
  *
  * chunk 1.:      |------|
  * chunk 2.: |---------------------|
- * off.....: ^
- * virt end:      ^
- * real end:                       ^
+ * index...: |-2--|--1---|----2----|
+ */
+static void dump_idx_build(void)
+{
+	struct dfo_chunk *dfo_chunk, **owner;
+	unsigned int i, cnt = 0, bnd_cnt = 0;
+	struct dump_idx *idx;
+	u64 *bnd, end;
+
+	bnd = zg_alloc(sizeof(*bnd) * (2 * l.dump.chunk_cnt + 1));
+	dfo_chunk_iterate(dfo_chunk) {
+		bnd[cnt++] = dfo_chunk->start;
+		if (dfo_chunk->end != U64_MAX)
+			bnd[cnt++] = dfo_chunk->end + 1;
+	}
+	qsort(bnd, cnt, sizeof(*bnd), u64_cmp_fn);
+	for (i = 0; i < cnt; i++) {
+		if (bnd_cnt == 0 || bnd[bnd_cnt - 1] != bnd[i])
+			bnd[bnd_cnt++] = bnd[i];
+	}
+	/* Elementary range "i" is [bnd[i], bnd[i + 1] - 1] */
+	owner = zg_alloc(sizeof(*owner) * (bnd_cnt + 1));
+	dfo_chunk_iterate(dfo_chunk) {
+		i = u64_vec_find(bnd, bnd_cnt, dfo_chunk->start);
+		for (; i < bnd_cnt && bnd[i] <= dfo_chunk->end; i++) {
+			if (!owner[i])
+				owner[i] = dfo_chunk;
+		}
+	}
+	zg_free(l.dump.idx);
+	l.dump.idx = zg_alloc(sizeof(*l.dump.idx) * (bnd_cnt + 1));
+	l.dump.idx_cnt = 0;
+	for (i = 0; i < bnd_cnt; i++) {
+		if (!owner[i])
+			continue;
+		end = (i + 1 < bnd_cnt) ? bnd[i + 1] - 1 : owner[i]->end;
+		idx = &l.dump.idx[l.dump.idx_cnt];
+		if (l.dump.idx_cnt && idx[-1].chunk == owner[i] &&
+		    idx[-1].end + 1 == bnd[i]) {
+			idx[-1].end = end;
+			continue;
+		}
+		idx->start = bnd[i];
+		idx->end = end;
+		idx->chunk = owner[i];
+		l.dump.idx_cnt++;
+	}
+	zg_free(owner);
+	zg_free(bnd);
+}
+
+/*
+ * Initialize output dump format
+ */
+void dfo_init(void)
+{
+	if (!l.dfo)
+		ABORT("DFO not set");
+	util_list_init(&l.dump.chunk_list, struct dfo_chunk, list);
+	l.dfo->init();
+	dump_idx_build();
+}
+
+/*
+ * Find dump chunk for offset "off"
  *
- * In this case chunk 2 will be returned and "end" is set to the start of
- * chunk 1.
+ * Do binary search on the dump chunk index. In addition to the chunk
+ * the "virtual end" of that chunk is returned. An overlapping chunk can
+ * limit the "virtual end" of an underlying chunk so that the "virtual end"
+ * of that chunk is lower than the "real end".
  */
 static struct dfo_chunk *dfo_chunk_find(u64 off, u64 *end)
 {
-	struct dfo_chunk *dfo_chunk;
+	unsigned int lo = 0, hi = l.dump.idx_cnt, mid;
 
-	*end = U64_MAX;
-	dfo_chunk_iterate(dfo_chunk) {
-		if (dfo_chunk->start <= off && dfo_chunk->end >= off) {
-			*end = MIN(*end, dfo_chunk->end);
-			return dfo_chunk;
-		} else if (dfo_chunk->start > off) {
-			*end = MIN(*end, dfo_chunk->start - 1);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (off < l.dump.idx[mid].start) {
+			hi = mid;
+		} else if (off > l.dump.idx[mid].end) {
+			lo = mid + 1;
+		} else {
+			*end = l.dump.idx[mid].end;
+			return l.dump.idx[mid].chunk;
 		}
 	}
 	return NULL;
@@ -172,29 +280,86 @@ void dfo_seek(u64 off)
 }
 
 /*
- * Read "cnt" bytes of output dump at current offest
+ * Read "cnt" bytes of output dump at offset "off"
+ *
+ * This function does not use the current offset and can be called by
+ * multiple threads concurrently.
  */
-u64 dfo_read(void *buf, u64 cnt)
+u64 dfo_pread(void *buf, u64 cnt, u64 off)
 {
 	struct dfo_chunk *dfo_chunk;
 	u64 copied = 0, end, size;
-	u64 off = l.dump.off;
 
 	while (copied != cnt) {
 		dfo_chunk = dfo_chunk_find(off, &end);
 		if (!dfo_chunk)
-			goto out;
+			break;
 		size = MIN(cnt - copied, end - off + 1);
 		dfo_chunk->read_fn(dfo_chunk, off - dfo_chunk->start,
 				    buf + copied, size);
 		copied += size;
 		off += size;
 	}
-out:
-	l.dump.off = off;
 	return copied;
 }
 
+/*
+ * Read "cnt" bytes of output dump at current offest
+ */
+u64 dfo_read(void *buf, u64 cnt)
+{
+	u64 copied;
+
+	copied = dfo_pread(buf, cnt, l.dump.off);
+	l.dump.off += copied;
+	return copied;
+}
+
+/*
+ * Find input dump file data for output dump offset "off"
+ *
+ * If the output dump at "off" is an unmodified copy of input dump file
+ * data, return the file handle and file offset of that data together with
+ * the number of bytes (at most "cnt") that are stored there contiguously.
+ * Otherwise return 0.
+ */
+u64 dfo_file_map(u64 off, u64 cnt, struct zg_fh **fh, u64 *file_off)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	struct dfo_mem_range *range;
+	struct dfo_chunk *dfo_chunk;
+	u64 end, mem_off;
+
+	dfo_chunk = dfo_chunk_find(off, &end);
+	if (!dfo_chunk)
+		return 0;
+	cnt = MIN(cnt, end - off + 1);
+	mem_off = off - dfo_chunk->start;
+	if (dfo_chunk->read_fn == dfo_chunk_mem_fn) {
+		mem_chunk = dfo_chunk->data;
+	} else if (dfo_chunk->read_fn == dfo_chunk_mem_range_fn) {
+		range = dfo_chunk->data;
+		mem_chunk = range->mem_chunk;
+		mem_off += range->off;
+	} else {
+		return 0;
+	}
+	return dfi_mem_chunk_file_map(mem_chunk, mem_off, cnt, fh, file_off);
+}
+
+/*
+ * Return number of bytes (at most "cnt") from output dump offset "off" to
+ * the end of the output dump chunk that contains "off"
+ */
+u64 dfo_chunk_left(u64 off, u64 cnt)
+{
+	u64 end;
+
+	if (!dfo_chunk_find(off, &end))
+		return 0;
+	return MIN(cnt, end - off + 1);
+}
+
 /*
  * Return output dump size
  */
@@ -27,21 +27,36 @@ struct dfo_chunk {
 	void			*data;
 };
 
+/*
+ * Memory range for dfo_chunk_mem_range_fn(): Starts at offset "off" of
+ * DFI memory chunk "mem_chunk"
+ */
+struct dfo_mem_range {
+	struct dfi_mem_chunk	*mem_chunk;
+	u64			off;
+};
+
 extern void dfo_chunk_zero_fn(struct dfo_chunk *chunk, u64 off, void *buf,
 			      u64 cnt);
 extern void dfo_chunk_buf_fn(struct dfo_chunk *chunk, u64 off, void *buf,
 			     u64 cnt);
 extern void dfo_chunk_mem_fn(struct dfo_chunk *chunk, u64 off, void *buf,
 			     u64 cnt);
+extern void dfo_chunk_mem_range_fn(struct dfo_chunk *chunk, u64 off, void *buf,
+				   u64 cnt);
 extern void dfo_chunk_add(u64 start, u64 size, void *data,
 			  dfo_chunk_read_fn read_fn);
 
 extern u64 dfo_read(void *buf, u64 cnt);
+extern u64 dfo_pread(void *buf, u64 cnt, u64 off);
 extern void dfo_seek(u64 addr);
 extern u64 dfo_size(void);
+extern u64 dfo_file_map(u64 off, u64 cnt, struct zg_fh **fh, u64 *file_off);
+extern u64 dfo_chunk_left(u64 off, u64 cnt);
 extern const char *dfo_name(void);
 extern void dfo_init(void);
 extern int dfo_set(const char *dfo_name);
+extern void *dfo_elf_notes_add(void *ptr);
 
 /*
  * DFO operations
@@ -18,13 +18,41 @@
 #define HDR_PER_CPU_SIZE	0x300
 #define HDR_PER_MEMC_SIZE	0x100
 #define HDR_BASE_SIZE		0x2000
+#define ZERO_SCAN_SIZE		MIB		/* Read size for zero scan */
+#define ZERO_RUN_MIN		(64 * KIB)	/* Minimum omitted zero run */
+#define LOAD_CNT_MAX		(PN_XNUM - 2)	/* Keep e_phnum below PN_XNUM */
+
+/*
+ * Run of zero bytes in memory chunk
+ */
+struct zero_run {
+	struct dfi_mem_chunk	*mem_chunk;
+	u64			off;	/* Offset in memory chunk */
+	u64			size;
+};
+
+/*
+ * ELF load: Part of memory chunk
+ *
+ * The first "filesz" bytes are stored in the dump, the remaining bytes up
+ * to "memsz" are zero and are omitted.
+ */
+struct load {
+	struct dfo_mem_range	range;	/* Memory chunk and offset */
+	u64			filesz;
+	u64			memsz;
+};
 
 /*
  * File local static data
  */
 static struct {
-	void	*hdr;
-	u32	hdr_size;
+	void		*hdr;
+	u32		hdr_size;
+	struct zero_run	*run_vec;
+	unsigned int	run_cnt;
+	struct load	*load_vec;
+	unsigned int	load_cnt;
 } l;
 
 /*
@@ -48,7 +76,7 @@ static void *ehdr_init(Elf64_Ehdr *ehdr)
 	ehdr->e_flags = 0;
 	ehdr->e_ehsize = sizeof(Elf64_Ehdr);
 	ehdr->e_phentsize = sizeof(Elf64_Phdr);
-	ehdr->e_phnum = dfi_mem_chunk_cnt() + 1;
+	ehdr->e_phnum = l.load_cnt + 1;
 	ehdr->e_shentsize = 0;
 	ehdr->e_shnum = 0;
 	ehdr->e_shstrndx = 0;
@@ -60,16 +88,18 @@ static void *ehdr_init(Elf64_Ehdr *ehdr)
  */
 static u64 loads_init(Elf64_Phdr *phdr, u64 loads_offset)
 {
-	struct dfi_mem_chunk *mem_chunk;
+	struct load *load;
 	u64 mem_size = 0;
+	unsigned int i;
 
-	dfi_mem_chunk_iterate(mem_chunk) {
+	for (i = 0; i < l.load_cnt; i++) {
+		load = &l.load_vec[i];
 		phdr->p_type = PT_LOAD;
 		phdr->p_offset = loads_offset;
-		phdr->p_vaddr = mem_chunk->start;
-		phdr->p_paddr = mem_chunk->start;
-		phdr->p_filesz = mem_chunk->end - mem_chunk->start + 1;
-		phdr->p_memsz = phdr->p_filesz;
+		phdr->p_vaddr = load->range.mem_chunk->start + load->range.off;
+		phdr->p_paddr = phdr->p_vaddr;
+		phdr->p_filesz = load->filesz;
+		phdr->p_memsz = load->memsz;
 		phdr->p_flags = PF_R | PF_W | PF_X;
 		phdr->p_align = PAGE_SIZE;
 		loads_offset += phdr->p_filesz;
@@ -79,6 +109,136 @@ static u64 loads_init(Elf64_Phdr *phdr, u64 loads_offset)
 	return mem_size;
 }
 
+/*
+ * Add zero run to run vector
+ */
+static void zero_run_add(struct dfi_mem_chunk *mem_chunk, u64 off, u64 size)
+{
+	struct zero_run *run;
+
+	if (size < ZERO_RUN_MIN)
+		return;
+	if (l.run_cnt % 1024 == 0)
+		l.run_vec = zg_realloc(l.run_vec, (l.run_cnt + 1024) *
+				       sizeof(*l.run_vec));
+	run = &l.run_vec[l.run_cnt++];
+	run->mem_chunk = mem_chunk;
+	run->off = off;
+	run->size = size;
+}
+
+/*
+ * Find runs of zero pages in all memory chunks
+ */
+static void zero_runs_init(void)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	u64 off, size, i, pg_size, run_off, run_size;
+	void *buf = zg_alloc(ZERO_SCAN_SIZE);
+
+	zg_progress_init("Scanning for zero pages", dfi_mem_range());
+	dfi_mem_chunk_iterate(mem_chunk) {
+		run_off = run_size = 0;
+		for (off = 0; off < mem_chunk->size; off += size) {
+			size = MIN(ZERO_SCAN_SIZE, mem_chunk->size - off);
+			mem_chunk->read_fn(mem_chunk, off, buf, size);
+			for (i = 0; i < size; i += pg_size) {
+				pg_size = MIN(PAGE_SIZE, size - i);
+				if (zg_is_zero(buf + i, pg_size)) {
+					run_size += pg_size;
+					continue;
+				}
+				zero_run_add(mem_chunk, run_off, run_size);
+				run_off = off + i + pg_size;
+				run_size = 0;
+			}
+			zg_progress(mem_chunk->start + off + size);
+		}
+		zero_run_add(mem_chunk, run_off, run_size);
+	}
+	if (g.opts.action != ZG_ACTION_MOUNT)
+		fprintf(stderr, "\n");
+	zg_free(buf);
+}
+
+/*
+ * Add load for memory chunk starting at offset "off"
+ */
+static struct load *load_add(struct dfi_mem_chunk *mem_chunk, u64 off)
+{
+	struct load *load;
+
+	if (l.load_cnt % 1024 == 0)
+		l.load_vec = zg_realloc(l.load_vec, (l.load_cnt + 1024) *
+					sizeof(*l.load_vec));
+	load = &l.load_vec[l.load_cnt++];
+	load->range.mem_chunk = mem_chunk;
+	load->range.off = off;
+	load->filesz = load->memsz = mem_chunk->size - off;
+	return load;
+}
+
+/*
+ * Create loads and omit zero runs with at least "run_min" bytes
+ *
+ * A zero run is omitted by ending the current load with it: Then the zero
+ * bytes are part of "memsz" but not of "filesz".
+ */
+static void loads_create(u64 run_min)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	unsigned int i = 0;
+	struct zero_run *run;
+	struct load *load;
+
+	l.load_cnt = 0;
+	dfi_mem_chunk_iterate(mem_chunk) {
+		load = load_add(mem_chunk, 0);
+		for (; i < l.run_cnt && l.run_vec[i].mem_chunk == mem_chunk;
+		     i++) {
+			run = &l.run_vec[i];
+			if (run->size < run_min)
+				continue;
+			load->filesz = run->off - load->range.off;
+			load->memsz = load->filesz + run->size;
+			if (run->off + run->size < mem_chunk->size)
+				load = load_add(mem_chunk,
+						run->off + run->size);
+		}
+	}
+}
+
+/*
+ * Initialize loads
+ *
+ * Without "--sparse" each memory chunk is one load. Otherwise zero runs
+ * are omitted. If this would exceed the maximum number of program headers,
+ * only larger zero runs are omitted. If even the memory chunks alone
+ * exceed the maximum, the dump cannot be written.
+ */
+static void loads_setup(void)
+{
+	u64 run_min = ZERO_RUN_MIN, run_max = 0;
+	unsigned int i;
+
+	if (g.opts.sparse)
+		zero_runs_init();
+	for (i = 0; i < l.run_cnt; i++)
+		run_max = MAX(run_max, l.run_vec[i].size);
+	while (1) {
+		loads_create(run_min);
+		if (l.load_cnt <= LOAD_CNT_MAX)
+			break;
+		if (run_min > run_max)
+			ERR_EXIT("Too many memory chunks for ELF dump (%u)",
+				 l.load_cnt);
+		run_min *= 2;
+	}
+	zg_free(l.run_vec);
+	l.run_vec = NULL;
+	l.run_cnt = 0;
+}
+
 /*
  * Initialize ELF note
  */
@@ -211,11 +371,12 @@ static void *nt_vmcoreinfo(void *ptr)
 }
 
 /*
- * Initialize notes
+ * Add notes for dump to "ptr" and return end of notes
+ *
+ * This function is also used by the kdump DFO.
  */
-static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
+void *dfo_elf_notes_add(void *ptr)
 {
-	void *ptr_start = ptr;
 	struct dfi_cpu *cpu;
 
 	ptr = nt_prpsinfo(ptr);
@@ -233,7 +394,17 @@ static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
 		ptr = nt_s390_prefix(ptr, cpu);
 	}
 out:
-	ptr = nt_vmcoreinfo(ptr);
+	return nt_vmcoreinfo(ptr);
+}
+
+/*
+ * Initialize notes
+ */
+static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
+{
+	void *ptr_start = ptr;
+
+	ptr = dfo_elf_notes_add(ptr);
 	memset(phdr, 0, sizeof(*phdr));
 	phdr->p_type = PT_NOTE;
 	phdr->p_offset = notes_offset;
@@ -246,15 +417,19 @@ out:
  */
 static void dump_chunks_init(void)
 {
-	struct dfi_mem_chunk *mem_chunk;
+	struct load *load;
+	unsigned int i;
 	u64 off = 0;
 
 	dfo_chunk_add(0, l.hdr_size, l.hdr, dfo_chunk_buf_fn);
 	off = l.hdr_size;
-	dfi_mem_chunk_iterate(mem_chunk) {
-		dfo_chunk_add(off, mem_chunk->size, mem_chunk,
-				   dfo_chunk_mem_fn);
-		off += mem_chunk->size;
+	for (i = 0; i < l.load_cnt; i++) {
+		load = &l.load_vec[i];
+		if (load->filesz == 0)
+			continue;
+		dfo_chunk_add(off, load->filesz, &load->range,
+			      dfo_chunk_mem_range_fn);
+		off += load->filesz;
 	}
 }
 
@@ -280,9 +455,10 @@ static void dfo_elf_init(void)
 	void *ptr;
 
 	ensure_s390x();
+	loads_setup();
 	alloc_size = HDR_BASE_SIZE +
 		dfi_cpu_cnt() * HDR_PER_CPU_SIZE +
-		dfi_mem_chunk_cnt() * HDR_PER_MEMC_SIZE;
+		l.load_cnt * HDR_PER_MEMC_SIZE;
 	l.hdr = zg_alloc(alloc_size);
 	/* Init elf header */
 	ptr = ehdr_init(l.hdr);
@@ -290,7 +466,7 @@ static void dfo_elf_init(void)
 	phdr_notes = ptr;
 	ptr = PTR_ADD(ptr, sizeof(Elf64_Phdr));
 	phdr_loads = ptr;
-	ptr = PTR_ADD(ptr, sizeof(Elf64_Phdr) * dfi_mem_chunk_cnt());
+	ptr = PTR_ADD(ptr, sizeof(Elf64_Phdr) * l.load_cnt);
 	/* Init notes */
 	hdr_off = PTR_DIFF(ptr, l.hdr);
 	ptr = notes_init(phdr_notes, ptr, hdr_off);
@@ -0,0 +1,535 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * kdump (makedumpfile compressed) output format
+ *
+ * The dump consists of the following parts:
+ *
+ * - Main header (one block)
+ * - Sub header with ELF notes and vmcoreinfo
+ * - Bitmap of valid pages and bitmap of dumped pages
+ * - Page descriptor for each dumped page
+ * - Page data (zlib compressed or uncompressed)
+ *
+ * Zero pages are not dumped. Because the size of the compressed pages has
+ * to be known for the page descriptors, all pages are compressed once at
+ * initialization time and only the resulting sizes are kept. The page data
+ * is compressed again when it is read.
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <zlib.h>
+#include <pthread.h>
+#include "zgetdump.h"
+
+#define BLOCK_SIZE		PAGE_SIZE
+#define DESC_BLK_CNT		64	/* Page descriptors per descriptor block */
+#define NOTES_BASE_SIZE		0x2000
+#define NOTES_PER_CPU_SIZE	0x300
+#define ZLIB_WINDOW_BITS	12	/* 4 KiB window is enough for one page */
+#define ZLIB_MEM_LEVEL		5
+#define READ_PG_CNT		256	/* Pages read at once for analysis */
+
+/*
+ * Descriptor block: Data offset and page frame number for the first of
+ * DESC_BLK_CNT page descriptors
+ */
+struct desc_blk {
+	u64	off;
+	u64	pfn;
+};
+
+/*
+ * File local static data
+ */
+static struct {
+	void		*hdr;		/* Main header and sub header */
+	u64		hdr_size;
+	u8		*bitmap;	/* Valid page and dumped page bitmap */
+	u64		bitmap_size;	/* Size of both bitmaps */
+	u64		pfn_cnt;	/* Number of page frames */
+	u64		desc_cnt;	/* Number of dumped pages */
+	u16		*size_vec;	/* Data size for each dumped page */
+	struct desc_blk	*blk_vec;	/* Descriptor blocks */
+	u64		data_off;	/* File offset of page data */
+	u64		data_size;	/* Size of page data */
+	pthread_mutex_t	lock;		/* Protects "analyze_pfn" */
+	u64		analyze_pfn;	/* Next page to be analyzed */
+	u16		*pfn_size;	/* Data size for each page during analysis */
+} l = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Test bit "nr" in "bitmap"
+ */
+static inline int bit_test(u8 *bitmap, u64 nr)
+{
+	return bitmap[nr / 8] & (1 << (nr % 8));
+}
+
+/*
+ * Set bit "nr" in "bitmap"
+ */
+static inline void bit_set(u8 *bitmap, u64 nr)
+{
+	bitmap[nr / 8] |= 1 << (nr % 8);
+}
+
+/*
+ * Return bitmap of valid pages
+ */
+static u8 *bitmap_valid(void)
+{
+	return l.bitmap;
+}
+
+/*
+ * Return bitmap of dumped pages
+ */
+static u8 *bitmap_dumped(void)
+{
+	return l.bitmap + l.bitmap_size / 2;
+}
+
+/*
+ * Return first dumped page frame number starting with "pfn"
+ */
+static u64 pfn_next(u64 pfn)
+{
+	u8 *bitmap = bitmap_dumped();
+
+	while (pfn < l.pfn_cnt) {
+		if (pfn % 8 == 0 && bitmap[pfn / 8] == 0) {
+			pfn += 8;
+			continue;
+		}
+		if (bit_test(bitmap, pfn))
+			return pfn;
+		pfn++;
+	}
+	ABORT("No dumped page found");
+}
+
+/*
+ * Initialize zlib stream for page compression
+ */
+static void zs_init(z_stream *zs)
+{
+	memset(zs, 0, sizeof(*zs));
+	if (deflateInit2(zs, Z_BEST_SPEED, Z_DEFLATED, ZLIB_WINDOW_BITS,
+			 ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+		ABORT("Could not initialize zlib");
+}
+
+/*
+ * Compress page "buf" into "cbuf" and return size of page data
+ *
+ * If the page cannot be compressed, it is copied uncompressed and
+ * PAGE_SIZE is returned.
+ */
+static u32 page_compress(z_stream *zs, void *buf, void *cbuf)
+{
+	if (deflateReset(zs) != Z_OK)
+		ABORT("Could not reset zlib");
+	zs->next_in = buf;
+	zs->avail_in = PAGE_SIZE;
+	zs->next_out = cbuf;
+	zs->avail_out = PAGE_SIZE;
+	if (deflate(zs, Z_FINISH) == Z_STREAM_END && zs->total_out < PAGE_SIZE)
+		return zs->total_out;
+	memcpy(cbuf, buf, PAGE_SIZE);
+	return PAGE_SIZE;
+}
+
+/*
+ * Read page "pfn" of input dump
+ *
+ * Parts of the page that are not contained in the dump are zero.
+ */
+static void page_read(u64 pfn, void *buf)
+{
+	u64 addr = pfn * PAGE_SIZE, end = addr + PAGE_SIZE, size;
+	struct dfi_mem_chunk *mem_chunk;
+
+	if (dfi_mem_range_valid(addr, PAGE_SIZE)) {
+		dfi_mem_read(addr, buf, PAGE_SIZE);
+		return;
+	}
+	memset(buf, 0, PAGE_SIZE);
+	while (addr < end) {
+		mem_chunk = dfi_mem_chunk_find(addr);
+		if (!mem_chunk) {
+			addr++;
+			continue;
+		}
+		size = MIN(mem_chunk->end + 1, end) - addr;
+		mem_chunk->read_fn(mem_chunk, addr - mem_chunk->start,
+				   buf + addr % PAGE_SIZE, size);
+		addr += size;
+	}
+}
+
+/*
+ * Read "cnt" pages starting with page "pfn" of input dump
+ */
+static void pages_read(u64 pfn, u64 cnt, void *buf)
+{
+	u64 i;
+
+	if (dfi_mem_range_valid(pfn * PAGE_SIZE, cnt * PAGE_SIZE)) {
+		dfi_mem_read(pfn * PAGE_SIZE, buf, cnt * PAGE_SIZE);
+		return;
+	}
+	for (i = 0; i < cnt; i++) {
+		if (bit_test(bitmap_valid(), pfn + i))
+			page_read(pfn + i, buf + i * PAGE_SIZE);
+	}
+}
+
+/*
+ * Analyze thread: Compute data size of pages in blocks of READ_PG_CNT
+ *
+ * Pages that are zero or that are not contained in the dump get size zero.
+ */
+static void *analyze_thread_fn(void *UNUSED(data))
+{
+	void *buf = zg_alloc(READ_PG_CNT * PAGE_SIZE);
+	void *cbuf = zg_alloc(PAGE_SIZE);
+	u64 pfn, cnt, i;
+	z_stream zs;
+
+	zs_init(&zs);
+	do {
+		pthread_mutex_lock(&l.lock);
+		pfn = l.analyze_pfn;
+		if (pfn < l.pfn_cnt) {
+			l.analyze_pfn += READ_PG_CNT;
+			zg_progress(pfn * PAGE_SIZE);
+		}
+		pthread_mutex_unlock(&l.lock);
+		if (pfn >= l.pfn_cnt)
+			break;
+		cnt = MIN(READ_PG_CNT, l.pfn_cnt - pfn);
+		pages_read(pfn, cnt, buf);
+		for (i = 0; i < cnt; i++) {
+			if (!bit_test(bitmap_valid(), pfn + i))
+				continue;
+			if (zg_is_zero(buf + i * PAGE_SIZE, PAGE_SIZE))
+				continue;
+			l.pfn_size[pfn + i] = page_compress(&zs, buf +
+							    i * PAGE_SIZE,
+							    cbuf);
+		}
+	} while (1);
+	deflateEnd(&zs);
+	zg_free(cbuf);
+	zg_free(buf);
+	return NULL;
+}
+
+/*
+ * Add page "pfn" with data size "size" to the dump
+ */
+static void page_add(u64 pfn, u16 size)
+{
+	struct desc_blk *blk;
+
+	bit_set(bitmap_dumped(), pfn);
+	if (l.desc_cnt % DESC_BLK_CNT == 0) {
+		blk = &l.blk_vec[l.desc_cnt / DESC_BLK_CNT];
+		blk->off = l.data_size;
+		blk->pfn = pfn;
+	}
+	l.size_vec[l.desc_cnt] = size;
+	l.data_size += size;
+	l.desc_cnt++;
+}
+
+/*
+ * Initialize bitmaps and compute size of all dumped pages
+ *
+ * Because compression is expensive, the pages are analyzed with the
+ * number of threads specified by the "--jobs" option. Input dump formats
+ * that cannot be read by several threads are analyzed with one thread.
+ */
+static void pages_analyze(void)
+{
+	unsigned int i, jobs = dfi_feat_par() ? MAX(g.opts.jobs, 1U) : 1;
+	struct dfi_mem_chunk *mem_chunk;
+	u64 pfn, valid_cnt = 0;
+	pthread_t *thread_vec;
+
+	dfi_mem_chunk_iterate(mem_chunk) {
+		for (pfn = mem_chunk->start / PAGE_SIZE;
+		     pfn <= mem_chunk->end / PAGE_SIZE; pfn++) {
+			if (bit_test(bitmap_valid(), pfn))
+				continue;
+			bit_set(bitmap_valid(), pfn);
+			valid_cnt++;
+		}
+	}
+	l.pfn_size = zg_alloc(l.pfn_cnt * sizeof(l.pfn_size[0]));
+	zg_progress_init("Analyzing dump", l.pfn_cnt * PAGE_SIZE);
+	thread_vec = zg_alloc(jobs * sizeof(*thread_vec));
+	for (i = 1; i < jobs; i++) {
+		if (pthread_create(&thread_vec[i], NULL, analyze_thread_fn,
+				   NULL))
+			ERR_EXIT("Could not create analyze thread");
+	}
+	analyze_thread_fn(NULL);
+	for (i = 1; i < jobs; i++)
+		pthread_join(thread_vec[i], NULL);
+	zg_free(thread_vec);
+	zg_progress(l.pfn_cnt * PAGE_SIZE);
+	if (g.opts.action != ZG_ACTION_MOUNT)
+		fprintf(stderr, "\n");
+
+	l.size_vec = zg_alloc(valid_cnt * sizeof(l.size_vec[0]));
+	l.blk_vec = zg_alloc((valid_cnt / DESC_BLK_CNT + 1) *
+			     sizeof(l.blk_vec[0]));
+	for (pfn = 0; pfn < l.pfn_cnt; pfn++) {
+		if (l.pfn_size[pfn])
+			page_add(pfn, l.pfn_size[pfn]);
+	}
+	zg_free(l.pfn_size);
+}
+
+/*
+ * Return offset of page data for page descriptor "nr" relative to start
+ * of page data
+ */
+static u64 desc_data_off(u64 nr)
+{
+	u64 i, off = l.blk_vec[nr / DESC_BLK_CNT].off;
+
+	for (i = nr - nr % DESC_BLK_CNT; i < nr; i++)
+		off += l.size_vec[i];
+	return off;
+}
+
+/*
+ * Dump chunk function: Copy page descriptors
+ */
+static void dfo_kdump_desc_fn(struct dfo_chunk *dfo_chunk, u64 off, void *buf,
+			      u64 cnt)
+{
+	struct df_kdump_page_desc desc;
+	u64 nr, data_off, desc_off, size, copied = 0;
+
+	(void) dfo_chunk;
+
+	nr = off / sizeof(desc);
+	desc_off = off % sizeof(desc);
+	data_off = desc_data_off(nr);
+	while (copied != cnt) {
+		memset(&desc, 0, sizeof(desc));
+		desc.offset = l.data_off + data_off;
+		desc.size = l.size_vec[nr];
+		if (desc.size < PAGE_SIZE)
+			desc.flags = DF_KDUMP_DH_COMPRESSED_ZLIB;
+		size = MIN(cnt - copied, sizeof(desc) - desc_off);
+		memcpy(buf + copied, PTR_ADD(&desc, desc_off), size);
+		copied += size;
+		data_off += l.size_vec[nr];
+		desc_off = 0;
+		nr++;
+	}
+}
+
+/*
+ * Find page descriptor for data offset "off" (relative to start of page
+ * data) and return page descriptor number, page frame number, and data
+ * offset of the page
+ */
+static u64 desc_find(u64 off, u64 *pfn, u64 *data_off)
+{
+	unsigned int lo = 0, hi = (l.desc_cnt - 1) / DESC_BLK_CNT + 1, mid;
+	u64 nr;
+
+	/* Find last descriptor block with "off" >= block offset */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (l.blk_vec[mid].off <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	nr = lo * DESC_BLK_CNT;
+	*pfn = l.blk_vec[lo].pfn;
+	*data_off = l.blk_vec[lo].off;
+	while (*data_off + l.size_vec[nr] <= off) {
+		*data_off += l.size_vec[nr];
+		*pfn = pfn_next(*pfn + 1);
+		nr++;
+	}
+	return nr;
+}
+
+/*
+ * Dump chunk function: Copy page data
+ *
+ * The pages are read from the input dump and compressed again. If the
+ * size of a page has changed since the dump has been analyzed, the output
+ * dump would be inconsistent. Therefore memory that can change (devmem)
+ * is not accepted as input.
+ */
+static void dfo_kdump_data_fn(struct dfo_chunk *dfo_chunk, u64 off, void *buf,
+			      u64 cnt)
+{
+	char pg_buf[PAGE_SIZE], cbuf[PAGE_SIZE];
+	u64 nr, pfn, data_off, pg_off, size, copied = 0;
+	z_stream zs;
+	u32 pg_size;
+
+	(void) dfo_chunk;
+
+	zs_init(&zs);
+	nr = desc_find(off, &pfn, &data_off);
+	while (1) {
+		page_read(pfn, pg_buf);
+		pg_size = page_compress(&zs, pg_buf, cbuf);
+		if (pg_size != l.size_vec[nr])
+			ERR_EXIT("Page at address 0x%llx changed while "
+				 "writing the dump",
+				 (unsigned long long) pfn * PAGE_SIZE);
+		pg_off = off + copied - data_off;
+		size = MIN(cnt - copied, pg_size - pg_off);
+		memcpy(buf + copied, cbuf + pg_off, size);
+		copied += size;
+		if (copied == cnt)
+			break;
+		data_off += pg_size;
+		pfn = pfn_next(pfn + 1);
+		nr++;
+	}
+	deflateEnd(&zs);
+}
+
+/*
+ * Initialize main header, sub header, ELF notes, and vmcoreinfo
+ */
+static void hdr_init(void)
+{
+	char *vmcoreinfo = dfi_vmcoreinfo_get();
+	struct df_kdump_sub_hdr *shdr;
+	struct df_kdump_hdr *hdr;
+	u32 alloc_size, cpu_max;
+	void *ptr, *notes;
+
+	alloc_size = BLOCK_SIZE + sizeof(*shdr) + NOTES_BASE_SIZE +
+		dfi_cpu_cnt() * NOTES_PER_CPU_SIZE;
+	if (vmcoreinfo)
+		alloc_size += strlen(vmcoreinfo);
+	alloc_size = ROUNDUP(alloc_size, BLOCK_SIZE);
+	l.hdr = zg_alloc(alloc_size);
+
+	/* Init main header */
+	hdr = l.hdr;
+	memcpy(hdr->signature, DF_KDUMP_SIGNATURE, sizeof(hdr->signature));
+	hdr->header_version = DF_KDUMP_HDR_VERSION;
+	if (dfi_attr_utsname())
+		memcpy(&hdr->utsname, dfi_attr_utsname(),
+		       sizeof(hdr->utsname));
+	if (hdr->utsname.machine[0] == 0)
+		strcpy(hdr->utsname.machine, "s390x");
+	if (dfi_attr_time())
+		hdr->timestamp = *dfi_attr_time();
+	hdr->status = DF_KDUMP_DH_COMPRESSED_ZLIB;
+	hdr->block_size = BLOCK_SIZE;
+	hdr->bitmap_blocks = l.bitmap_size / BLOCK_SIZE;
+	hdr->max_mapnr = MIN(l.pfn_cnt, U32_MAX);
+	cpu_max = (BLOCK_SIZE - sizeof(*hdr)) / sizeof(hdr->tasks[0]);
+	hdr->nr_cpus = MIN(MAX(dfi_cpu_cnt(), 1U), cpu_max);
+
+	/* Init sub header */
+	shdr = (void *) PTR_ADD(l.hdr, BLOCK_SIZE);
+	shdr->dump_level = DF_KDUMP_DL_EXCLUDE_ZERO;
+	shdr->end_pfn = MIN(l.pfn_cnt, U32_MAX);
+	shdr->end_pfn_64 = l.pfn_cnt;
+	shdr->max_mapnr_64 = l.pfn_cnt;
+	notes = shdr + 1;
+	ptr = dfo_elf_notes_add(notes);
+	shdr->offset_note = PTR_DIFF(notes, l.hdr);
+	shdr->size_note = PTR_DIFF(ptr, notes);
+	if (vmcoreinfo) {
+		shdr->offset_vmcoreinfo = PTR_DIFF(ptr, l.hdr);
+		shdr->size_vmcoreinfo = strlen(vmcoreinfo);
+		memcpy(ptr, vmcoreinfo, shdr->size_vmcoreinfo);
+		ptr = PTR_ADD(ptr, shdr->size_vmcoreinfo);
+	}
+	l.hdr_size = ROUNDUP(PTR_DIFF(ptr, l.hdr), BLOCK_SIZE);
+	if (l.hdr_size > alloc_size)
+		ABORT("hdr_size=%llu alloc_size=%u",
+		      (unsigned long long) l.hdr_size, alloc_size);
+	hdr->sub_hdr_size = l.hdr_size / BLOCK_SIZE - 1;
+}
+
+/*
+ * Setup dump chunks
+ */
+static void dump_chunks_init(void)
+{
+	u64 off, desc_size = l.desc_cnt * sizeof(struct df_kdump_page_desc);
+
+	dfo_chunk_add(0, l.hdr_size, l.hdr, dfo_chunk_buf_fn);
+	off = l.hdr_size;
+	dfo_chunk_add(off, l.bitmap_size, l.bitmap, dfo_chunk_buf_fn);
+	off += l.bitmap_size;
+	if (l.desc_cnt == 0)
+		return;
+	dfo_chunk_add(off, desc_size, NULL, dfo_kdump_desc_fn);
+	off += desc_size;
+	l.data_off = off;
+	dfo_chunk_add(off, l.data_size, NULL, dfo_kdump_data_fn);
+}
+
+/*
+ * kdump DFO is only supported for 64 bit (s390x)
+ */
+static void ensure_s390x(void)
+{
+	if (dfi_arch() != DFI_ARCH_64)
+		ERR_EXIT("Error: The kdump dump format is only supported for "
+			 "s390x source dumps");
+	df_kdump_ensure_s390x();
+}
+
+/*
+ * kdump DFO needs memory that does not change between analysis and copy
+ */
+static void ensure_not_devmem(void)
+{
+	if (strcmp(dfi_name(), "devmem") == 0)
+		ERR_EXIT("Error: The kdump dump format is not supported for "
+			 "live system memory");
+}
+
+/*
+ * Initialize kdump output dump format
+ */
+static void dfo_kdump_init(void)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	u64 mem_end = 0;
+
+	ensure_s390x();
+	ensure_not_devmem();
+	dfi_mem_chunk_iterate(mem_chunk)
+		mem_end = MAX(mem_end, mem_chunk->end + 1);
+	l.pfn_cnt = PAGE_ALIGN(mem_end) / PAGE_SIZE;
+	l.bitmap_size = 2 * ROUNDUP((l.pfn_cnt + 7) / 8, BLOCK_SIZE);
+	l.bitmap = zg_alloc(l.bitmap_size);
+	pages_analyze();
+	hdr_init();
+	dump_chunks_init();
+}
+
+/*
+ * kdump DFO operations
+ */
+struct dfo dfo_kdump = {
+	.name		= "kdump",
+	.init		= dfo_kdump_init,
+};
@@ -0,0 +1,204 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Digest manifest for copied dumps
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include "zgetdump.h"
+
+#define MANIFEST_CHUNK_SIZE	(64ULL * MIB)	/* Size of one digest chunk */
+
+/*
+ * File local static data
+ *
+ * The output dump is split into chunks of MANIFEST_CHUNK_SIZE. For each
+ * chunk and for the whole dump a SHA-256 digest is written into the
+ * manifest file.
+ */
+static struct {
+	FILE			*fh;
+	struct util_sha256	dump;	/* Digest of whole dump */
+	struct util_sha256	chunk;	/* Digest of current chunk */
+	u64			off;	/* Output dump offset */
+} l;
+
+/*
+ * Finish digest "ctx" and write it into the manifest
+ */
+static void digest_write(const char *tag, u64 off, u64 size,
+			 struct util_sha256 *ctx)
+{
+	uint8_t digest[UTIL_SHA256_SIZE];
+	char str[UTIL_SHA256_HEX_SIZE];
+
+	util_sha256_final(ctx, digest);
+	util_sha256_hex(digest, str);
+	fprintf(l.fh, "%s %llu %llu %s\n", tag, (unsigned long long) off,
+		(unsigned long long) size, str);
+}
+
+/*
+ * Convert SHA-256 context to string "STATE:LEN:BUF"
+ */
+static char *ctx_to_str(struct util_sha256 *ctx, char *str)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_ELEMENT_CNT(ctx->state); i++)
+		str += sprintf(str, "%08x", ctx->state[i]);
+	str += sprintf(str, ":%llu:", (unsigned long long) ctx->len);
+	for (i = 0; i < ctx->len % sizeof(ctx->buf); i++)
+		str += sprintf(str, "%02x", ctx->buf[i]);
+	return str;
+}
+
+/*
+ * Convert string "STATE:LEN:BUF" to SHA-256 context
+ */
+static int ctx_from_str(struct util_sha256 *ctx, const char *str)
+{
+	unsigned long long len;
+	unsigned int i, val;
+	int pos;
+
+	for (i = 0; i < ARRAY_ELEMENT_CNT(ctx->state); i++) {
+		if (sscanf(str, "%8x", &ctx->state[i]) != 1)
+			return -EINVAL;
+		str += 8;
+	}
+	if (sscanf(str, ":%llu:%n", &len, &pos) != 1)
+		return -EINVAL;
+	str += pos;
+	ctx->len = len;
+	for (i = 0; i < len % sizeof(ctx->buf); i++) {
+		if (sscanf(str, "%2x", &val) != 1)
+			return -EINVAL;
+		ctx->buf[i] = val;
+		str += 2;
+	}
+	return *str == '\0' ? 0 : -EINVAL;
+}
+
+/*
+ * Store manifest state for resuming the copy into "buf"
+ *
+ * The state consists of the manifest file size, the output dump offset,
+ * and the two digest contexts. The manifest file is synced, so that the
+ * state is valid after a system crash.
+ */
+int manifest_state(char *buf)
+{
+	long size;
+
+	if (!l.fh)
+		return -ENOENT;
+	if (fflush(l.fh) || fdatasync(fileno(l.fh)))
+		ERR_EXIT_ERRNO("Could not write manifest \"%s\"",
+			       g.opts.manifest);
+	size = ftell(l.fh);
+	buf += sprintf(buf, "%ld %llu ", size, (unsigned long long) l.off);
+	buf = ctx_to_str(&l.dump, buf);
+	*buf++ = ' ';
+	ctx_to_str(&l.chunk, buf);
+	return 0;
+}
+
+/*
+ * Restore manifest state "state" stored by manifest_state()
+ */
+static void manifest_resume(const char *state)
+{
+	char dump_str[MANIFEST_STATE_SIZE], chunk_str[MANIFEST_STATE_SIZE];
+	unsigned long long off;
+	long size;
+
+	if (sscanf(state, "%ld %llu %s %s", &size, &off, dump_str,
+		   chunk_str) != 4 ||
+	    ctx_from_str(&l.dump, dump_str) ||
+	    ctx_from_str(&l.chunk, chunk_str))
+		ERR_EXIT("Invalid manifest state in checkpoint");
+	l.off = off;
+	l.fh = fopen(g.opts.manifest, "r+");
+	if (!l.fh)
+		ERR_EXIT_ERRNO("Could not open manifest \"%s\"",
+			       g.opts.manifest);
+	/* Remove digests that have been written after the checkpoint */
+	if (ftruncate(fileno(l.fh), size) || fseek(l.fh, size, SEEK_SET))
+		ERR_EXIT_ERRNO("Could not resume manifest \"%s\"",
+			       g.opts.manifest);
+}
+
+/*
+ * Add "cnt" bytes of output dump data to the digests
+ *
+ * The data has to be passed in output dump order.
+ */
+void manifest_update(const void *buf, u64 cnt)
+{
+	u64 size;
+
+	if (!l.fh)
+		return;
+	util_sha256_update(&l.dump, buf, cnt);
+	while (cnt) {
+		size = MANIFEST_CHUNK_SIZE - l.off % MANIFEST_CHUNK_SIZE;
+		size = MIN(size, cnt);
+		util_sha256_update(&l.chunk, buf, size);
+		buf += size;
+		cnt -= size;
+		l.off += size;
+		if (l.off % MANIFEST_CHUNK_SIZE)
+			continue;
+		digest_write("chunk", l.off - MANIFEST_CHUNK_SIZE,
+			     MANIFEST_CHUNK_SIZE, &l.chunk);
+		util_sha256_init(&l.chunk);
+	}
+}
+
+/*
+ * Create manifest file, if "--manifest" has been specified
+ *
+ * If "state" is not NULL, the copy is resumed and the existing manifest
+ * file is continued.
+ */
+void manifest_init(const char *state)
+{
+	if (!g.opts.manifest)
+		return;
+	if (state) {
+		manifest_resume(state);
+		return;
+	}
+	l.fh = fopen(g.opts.manifest, "w");
+	if (!l.fh)
+		ERR_EXIT_ERRNO("Could not open manifest \"%s\"",
+			       g.opts.manifest);
+	fprintf(l.fh, "# zgetdump manifest\n");
+	fprintf(l.fh, "# source: %s\n", g.opts.device);
+	fprintf(l.fh, "# format: %s\n", dfo_name());
+	fprintf(l.fh, "# digest: sha256\n");
+	fprintf(l.fh, "# chunk_size: %llu\n", MANIFEST_CHUNK_SIZE);
+	util_sha256_init(&l.dump);
+	util_sha256_init(&l.chunk);
+}
+
+/*
+ * Write digests of last chunk and whole dump and close manifest file
+ */
+void manifest_exit(void)
+{
+	u64 size;
+
+	if (!l.fh)
+		return;
+	size = l.off % MANIFEST_CHUNK_SIZE;
+	if (size)
+		digest_write("chunk", l.off - size, size, &l.chunk);
+	digest_write("dump", 0, l.off, &l.dump);
+	if (fclose(l.fh))
+		ERR_EXIT_ERRNO("Could not write manifest \"%s\"",
+			       g.opts.manifest);
+	l.fh = NULL;
+}
@@ -14,15 +14,21 @@
 #include "zgetdump.h"
 #include "zt_common.h"
 
+#define JOBS_MAX	64
+#define AIO_DEPTH_MAX	256
+#define CACHE_SIZE_DEFAULT	64	/* Default cache size in MB */
+
 /*
  * Text for --help option
  */
 static char help_text[] =
-"Usage: zgetdump    DUMP [-s SYS] [-f FMT] > DUMP_FILE\n"
-"                -m DUMP [-s SYS] [-f FMT] DIR\n"
+"Usage: zgetdump    DUMP [-s SYS] [-f FMT] [-j JOBS] [-z] [-a DEPTH [-O]]\n"
+"                        [-M FILE] [-C FILE [-r]] [-S FILE] > DUMP_FILE\n"
+"                -m DUMP [-s SYS] [-f FMT] [-c SIZE] [-z] DIR\n"
 "                -i DUMP [-s SYS]\n"
 "                -d DUMPDEV\n"
 "                -u DIR\n"
+"                -b [DUMP] [-s SYS] [-f FMT] [-j JOBS] [-c SIZE] [-z]\n"
 "\n"
 "The zgetdump tool can read different dump formats from a dump device or from\n"
 "a dump file. You can use zgetdump to:\n"
@@ -39,9 +45,19 @@ static char help_text[] =
 "-m, --mount    Mount DUMP to mount point DIR\n"
 "-u, --umount   Unmount dump from mount point DIR\n"
 "-i, --info     Print DUMP information\n"
-"-f, --fmt      Specify target dump format FMT (\"elf\" or \"s390\")\n"
+"-f, --fmt      Specify target dump format FMT (\"elf\", \"s390\", or \"kdump\")\n"
 "-s, --select   Select system data SYS (\"kdump\", \"prod\", or \"all\")\n"
+"-j, --jobs     Use JOBS threads for reading the dump when copying\n"
+"-c, --cache    Use SIZE MB page cache for mounted dump (0 disables cache)\n"
+"-z, --sparse   Omit zero pages from ELF dumps and create sparse files\n"
+"-a, --aio      Read dump asynchronously with DEPTH requests when copying\n"
+"-O, --odirect  Bypass the page cache for asynchronous reads\n"
+"-M, --manifest Write SHA-256 digests of copied dump into manifest FILE\n"
+"-C, --checkpoint Record progress of copy in checkpoint FILE\n"
+"-r, --resume   Resume interrupted copy from checkpoint FILE\n"
+"-S, --snapshot Copy only live memory changed since snapshot FILE\n"
 "-d, --device   Print DUMPDEV (dump device) information\n"
+"-b, --benchmark Measure throughput for DUMP or for synthetic dumps\n"
 "-v, --version  Print version information, then exit\n"
 "-h, --help     Print this help, then exit\n";
 
@@ -61,6 +77,8 @@ static void init_defaults(void)
 {
 	g.prog_name = "zgetdump";
 	g.opts.action = ZG_ACTION_STDOUT;
+	g.opts.jobs = 1;
+	g.opts.cache_size = CACHE_SIZE_DEFAULT * MIB;
 #ifdef __s390x__
 	g.opts.fmt = "elf";
 #else
@@ -125,6 +143,54 @@ static void select_set(const char *select)
 	g.opts.select_specified = 1;
 }
 
+/*
+ * Set "--jobs" option
+ */
+static void jobs_set(const char *jobs)
+{
+	char *endptr;
+	long val;
+
+	val = strtol(jobs, &endptr, 10);
+	if (*jobs == '\0' || *endptr != '\0' || val < 1 || val > JOBS_MAX)
+		ERR_EXIT("Invalid jobs argument \"%s\" specified (1-%d)", jobs,
+			 JOBS_MAX);
+	g.opts.jobs = val;
+	g.opts.jobs_specified = 1;
+}
+
+/*
+ * Set "--aio" option
+ */
+static void aio_set(const char *depth)
+{
+	char *endptr;
+	long val;
+
+	val = strtol(depth, &endptr, 10);
+	if (*depth == '\0' || *endptr != '\0' || val < 1 ||
+	    val > AIO_DEPTH_MAX)
+		ERR_EXIT("Invalid aio depth \"%s\" specified (1-%d)", depth,
+			 AIO_DEPTH_MAX);
+	g.opts.aio_depth = val;
+	g.opts.aio_specified = 1;
+}
+
+/*
+ * Set "--cache" option
+ */
+static void cache_set(const char *size)
+{
+	unsigned long long val;
+	char *endptr;
+
+	val = strtoull(size, &endptr, 10);
+	if (*size == '\0' || *endptr != '\0' || val > U32_MAX)
+		ERR_EXIT("Invalid cache size \"%s\" specified", size);
+	g.opts.cache_size = val * MIB;
+	g.opts.cache_specified = 1;
+}
+
 /*
  * Set mount point
  */
@@ -164,7 +230,7 @@ static void action_set(enum zg_action action)
 {
 	if (g.opts.action_specified)
 		ERR_EXIT("Please specifiy only one of the \"-i\", \"-d\", "
-			 "\"-m\" or \"-u\" option");
+			 "\"-m\", \"-u\" or \"-b\" option");
 	g.opts.action = action;
 	g.opts.action_specified = 1;
 }
@@ -177,10 +243,44 @@ static void verify_opts(void)
 	if (g.opts.select_specified) {
 		if (g.opts.action != ZG_ACTION_MOUNT &&
 		    g.opts.action != ZG_ACTION_STDOUT &&
-		    g.opts.action != ZG_ACTION_DUMP_INFO)
+		    g.opts.action != ZG_ACTION_DUMP_INFO &&
+		    g.opts.action != ZG_ACTION_BENCHMARK)
 			ERR_EXIT("The \"--select\" option can only be "
-				 "specifed for info, mount, or copy");
+				 "specifed for info, mount, copy, or benchmark");
 	}
+	if (g.opts.jobs_specified && g.opts.action != ZG_ACTION_STDOUT &&
+	    g.opts.action != ZG_ACTION_BENCHMARK)
+		ERR_EXIT("The \"--jobs\" option can only be specified for copy "
+			 "or benchmark");
+	if (g.opts.cache_specified && g.opts.action != ZG_ACTION_MOUNT &&
+	    g.opts.action != ZG_ACTION_BENCHMARK)
+		ERR_EXIT("The \"--cache\" option can only be specified for "
+			 "mount or benchmark");
+	if (g.opts.sparse && g.opts.action != ZG_ACTION_STDOUT &&
+	    g.opts.action != ZG_ACTION_MOUNT &&
+	    g.opts.action != ZG_ACTION_BENCHMARK)
+		ERR_EXIT("The \"--sparse\" option can only be specified for "
+			 "mount, copy, or benchmark");
+	if (g.opts.aio_specified && g.opts.action != ZG_ACTION_STDOUT)
+		ERR_EXIT("The \"--aio\" option can only be specified for copy");
+	if (g.opts.manifest && g.opts.action != ZG_ACTION_STDOUT)
+		ERR_EXIT("The \"--manifest\" option can only be specified "
+			 "for copy");
+	if (g.opts.checkpoint && g.opts.action != ZG_ACTION_STDOUT)
+		ERR_EXIT("The \"--checkpoint\" option can only be specified "
+			 "for copy");
+	if (g.opts.resume && !g.opts.checkpoint)
+		ERR_EXIT("The \"--resume\" option can only be specified "
+			 "together with \"--checkpoint\"");
+	if (g.opts.snapshot && g.opts.action != ZG_ACTION_STDOUT)
+		ERR_EXIT("The \"--snapshot\" option can only be specified "
+			 "for copy");
+	if (g.opts.snapshot && g.opts.checkpoint)
+		ERR_EXIT("The \"--snapshot\" option cannot be specified "
+			 "together with \"--checkpoint\"");
+	if (g.opts.odirect && !g.opts.aio_specified)
+		ERR_EXIT("The \"--odirect\" option can only be specified "
+			 "together with \"--aio\"");
 	if (!g.opts.fmt_specified)
 		return;
 
@@ -229,6 +329,12 @@ static void parse_pos_args(char *argv[], int argc)
 			ERR_EXIT("No mount point specified");
 		mount_point_set(argv[optind]);
 		break;
+	case ZG_ACTION_BENCHMARK:
+		if (pos_args > 1)
+			ERR_EXIT("Too many positional parameters specified");
+		if (pos_args == 1)
+			device_set(argv[optind]);
+		break;
 	}
 }
 
@@ -247,10 +353,20 @@ void opts_parse(int argc, char *argv[])
 		{"umount",  no_argument,       NULL, 'u'},
 		{"fmt",     required_argument, NULL, 'f'},
 		{"select",  required_argument, NULL, 's'},
+		{"jobs",    required_argument, NULL, 'j'},
+		{"cache",   required_argument, NULL, 'c'},
+		{"sparse",  no_argument,       NULL, 'z'},
+		{"aio",     required_argument, NULL, 'a'},
+		{"odirect", no_argument,       NULL, 'O'},
+		{"manifest", required_argument, NULL, 'M'},
+		{"checkpoint", required_argument, NULL, 'C'},
+		{"resume",  no_argument,       NULL, 'r'},
+		{"snapshot", required_argument, NULL, 'S'},
+		{"benchmark", no_argument,     NULL, 'b'},
 		{"debug",   no_argument,       NULL, 'X'},
 		{NULL,      0,                 NULL,  0 }
 	};
-	static const char optstr[] = "hvidmus:f:X";
+	static const char optstr[] = "hvidmubs:f:j:c:za:OM:C:rS:X";
 
 	init_defaults();
 	while ((opt = getopt_long(argc, argv, optstr, long_opts, &idx)) != -1) {
@@ -271,12 +387,42 @@ void opts_parse(int argc, char *argv[])
 		case 'u':
 			action_set(ZG_ACTION_UMOUNT);
 			break;
+		case 'b':
+			action_set(ZG_ACTION_BENCHMARK);
+			break;
 		case 'f':
 			fmt_set(optarg);
 			break;
 		case 's':
 			select_set(optarg);
 			break;
+		case 'j':
+			jobs_set(optarg);
+			break;
+		case 'c':
+			cache_set(optarg);
+			break;
+		case 'z':
+			g.opts.sparse = 1;
+			break;
+		case 'a':
+			aio_set(optarg);
+			break;
+		case 'O':
+			g.opts.odirect = 1;
+			break;
+		case 'M':
+			g.opts.manifest = optarg;
+			break;
+		case 'C':
+			g.opts.checkpoint = optarg;
+			break;
+		case 'r':
+			g.opts.resume = 1;
+			break;
+		case 'S':
+			g.opts.snapshot = optarg;
+			break;
 		case 'X':
 			g.opts.debug_specified = 1;
 			break;
@@ -0,0 +1,367 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Incremental snapshots of live system memory
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <pthread.h>
+#include <limits.h>
+#include "zgetdump.h"
+
+#define SNAPSHOT_BLK_SIZE	(1ULL * MIB)	/* Size of one digest block */
+
+/*
+ * Constants for block digest "zg64"
+ *
+ * The digest uses the primes and round functions of xxHash64, but it
+ * loads words in native byte order and has no 4 byte tail step. It is
+ * only compared with digests of the same zgetdump, so it is not
+ * compatible with XXH64.
+ */
+#define PRIME1	0x9e3779b185ebca87ULL
+#define PRIME2	0xc2b2ae3d27d4eb4fULL
+#define PRIME3	0x165667b19e3779f9ULL
+#define PRIME4	0x85ebca77c2b2ae63ULL
+#define PRIME5	0x27d4eb2f165667c5ULL
+
+/*
+ * Memory block with digest
+ */
+struct snap_blk {
+	u64	addr;
+	u64	size;
+	u64	digest;
+};
+
+/*
+ * File local static data
+ *
+ * The dump memory is split into blocks that are aligned to
+ * SNAPSHOT_BLK_SIZE. A block that is not contained in the previous
+ * snapshot or that has a different digest is changed.
+ */
+static struct {
+	struct snap_blk	*blk_vec;	/* Blocks of current memory */
+	unsigned long	blk_cnt;
+	struct snap_blk	*prev_vec;	/* Blocks of previous snapshot */
+	unsigned long	prev_cnt;
+	unsigned long	blk_next;	/* Next block to be hashed */
+	pthread_mutex_t	lock;
+} l;
+
+/*
+ * Rotate 64 bit value left
+ */
+static inline u64 rotl64(u64 val, unsigned int bits)
+{
+	return (val << bits) | (val >> (64 - bits));
+}
+
+/*
+ * Process one 64 bit word for block digest
+ */
+static inline u64 digest_round(u64 acc, u64 val)
+{
+	acc += val * PRIME2;
+	return rotl64(acc, 31) * PRIME1;
+}
+
+/*
+ * Merge accumulator into block digest
+ */
+static inline u64 digest_merge(u64 h, u64 acc)
+{
+	h ^= digest_round(0, acc);
+	return h * PRIME1 + PRIME4;
+}
+
+/*
+ * Compute 64 bit digest for "size" bytes of "buf"
+ *
+ * Four independent accumulators are used so that the CPU can process
+ * multiple words in parallel.
+ */
+static u64 digest_compute(const void *buf, u64 size)
+{
+	u64 v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = -PRIME1;
+	const unsigned char *ptr = buf, *end = ptr + size;
+	u64 h, val[4];
+
+	if (size >= 32) {
+		do {
+			memcpy(val, ptr, sizeof(val));
+			v1 = digest_round(v1, val[0]);
+			v2 = digest_round(v2, val[1]);
+			v3 = digest_round(v3, val[2]);
+			v4 = digest_round(v4, val[3]);
+			ptr += sizeof(val);
+		} while (ptr + sizeof(val) <= end);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) +
+			rotl64(v4, 18);
+		h = digest_merge(h, v1);
+		h = digest_merge(h, v2);
+		h = digest_merge(h, v3);
+		h = digest_merge(h, v4);
+	} else {
+		h = PRIME5;
+	}
+	h += size;
+	while (ptr + sizeof(val[0]) <= end) {
+		memcpy(val, ptr, sizeof(val[0]));
+		h ^= digest_round(0, val[0]);
+		h = rotl64(h, 27) * PRIME1 + PRIME4;
+		ptr += sizeof(val[0]);
+	}
+	while (ptr < end) {
+		h ^= *ptr * PRIME5;
+		h = rotl64(h, 11) * PRIME1;
+		ptr++;
+	}
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * Split dump memory into blocks
+ *
+ * Blocks do not cross memory chunk boundaries.
+ */
+static void blk_vec_init(void)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	u64 addr, size;
+	int fill;
+
+	for (fill = 0; fill < 2; fill++) {
+		if (fill)
+			l.blk_vec = zg_alloc(l.blk_cnt * sizeof(*l.blk_vec));
+		l.blk_cnt = 0;
+		dfi_mem_chunk_iterate(mem_chunk) {
+			addr = mem_chunk->start;
+			do {
+				size = SNAPSHOT_BLK_SIZE -
+					addr % SNAPSHOT_BLK_SIZE;
+				size = MIN(size, mem_chunk->end - addr + 1);
+				if (fill) {
+					l.blk_vec[l.blk_cnt].addr = addr;
+					l.blk_vec[l.blk_cnt].size = size;
+				}
+				l.blk_cnt++;
+				addr += size;
+			} while (addr - 1 < mem_chunk->end);
+		}
+	}
+}
+
+/*
+ * Thread function that computes the digests of memory blocks
+ */
+static void *blk_hash_thread(void *UNUSED(data))
+{
+	void *buf = zg_alloc(SNAPSHOT_BLK_SIZE);
+	struct snap_blk *blk;
+	unsigned long i;
+
+	while (1) {
+		pthread_mutex_lock(&l.lock);
+		i = l.blk_next++;
+		pthread_mutex_unlock(&l.lock);
+		if (i >= l.blk_cnt)
+			break;
+		blk = &l.blk_vec[i];
+		dfi_mem_read(blk->addr, buf, blk->size);
+		blk->digest = digest_compute(buf, blk->size);
+	}
+	zg_free(buf);
+	return NULL;
+}
+
+/*
+ * Compute digests of all memory blocks with "--jobs" threads
+ */
+static void blk_hash(void)
+{
+	pthread_t *thread_vec;
+	unsigned int i;
+
+	pthread_mutex_init(&l.lock, NULL);
+	thread_vec = zg_alloc(g.opts.jobs * sizeof(*thread_vec));
+	for (i = 0; i < g.opts.jobs; i++) {
+		if (pthread_create(&thread_vec[i], NULL, blk_hash_thread, NULL))
+			ERR_EXIT("Could not create hash thread");
+	}
+	for (i = 0; i < g.opts.jobs; i++)
+		pthread_join(thread_vec[i], NULL);
+	zg_free(thread_vec);
+	pthread_mutex_destroy(&l.lock);
+}
+
+/*
+ * Read block digests of previous snapshot
+ *
+ * Return -ENOENT if the snapshot file does not exist.
+ */
+static int prev_read(void)
+{
+	unsigned long long addr, size, digest, blk_size = 0;
+	unsigned long alloc = 0;
+	char line[256];
+	FILE *fh;
+
+	fh = fopen(g.opts.snapshot, "r");
+	if (!fh) {
+		if (errno == ENOENT)
+			return -ENOENT;
+		ERR_EXIT_ERRNO("Could not open snapshot \"%s\"",
+			       g.opts.snapshot);
+	}
+	while (fgets(line, sizeof(line), fh)) {
+		if (sscanf(line, "# block_size: %llu", &blk_size) == 1)
+			continue;
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "block %llx %llx %llx", &addr, &size,
+			   &digest) != 3)
+			ERR_EXIT("Snapshot \"%s\" is invalid",
+				 g.opts.snapshot);
+		if (l.prev_cnt == alloc) {
+			alloc = MAX(alloc * 2, 1024);
+			l.prev_vec = zg_realloc(l.prev_vec,
+						alloc * sizeof(*l.prev_vec));
+		}
+		l.prev_vec[l.prev_cnt].addr = addr;
+		l.prev_vec[l.prev_cnt].size = size;
+		l.prev_vec[l.prev_cnt].digest = digest;
+		l.prev_cnt++;
+	}
+	fclose(fh);
+	if (blk_size != SNAPSHOT_BLK_SIZE)
+		ERR_EXIT("Snapshot \"%s\" has unsupported block size",
+			 g.opts.snapshot);
+	return 0;
+}
+
+/*
+ * Block compare function for bsearch
+ */
+static int blk_cmp_fn(const void *a, const void *b)
+{
+	const struct snap_blk *blk1 = a, *blk2 = b;
+
+	if (blk1->addr == blk2->addr)
+		return 0;
+	return blk1->addr < blk2->addr ? -1 : 1;
+}
+
+/*
+ * Check if block has changed since previous snapshot
+ */
+static int blk_changed(struct snap_blk *blk)
+{
+	struct snap_blk *prev;
+
+	prev = bsearch(blk, l.prev_vec, l.prev_cnt, sizeof(*l.prev_vec),
+		       blk_cmp_fn);
+	if (!prev)
+		return 1;
+	return prev->size != blk->size || prev->digest != blk->digest;
+}
+
+/*
+ * Restrict dump memory to changed blocks
+ */
+static void mem_restrict(void)
+{
+	struct dfi_mem_range *range_vec, *range = NULL;
+	unsigned long i, range_cnt = 0;
+	u64 changed = 0, total = 0;
+	struct snap_blk *blk;
+
+	range_vec = zg_alloc(l.blk_cnt * sizeof(*range_vec));
+	for (i = 0; i < l.blk_cnt; i++) {
+		blk = &l.blk_vec[i];
+		total += blk->size;
+		if (!blk_changed(blk))
+			continue;
+		changed += blk->size;
+		if (range && range->start + range->size == blk->addr) {
+			range->size += blk->size;
+			continue;
+		}
+		range = &range_vec[range_cnt++];
+		range->start = blk->addr;
+		range->size = blk->size;
+	}
+	STDERR("Snapshot: %llu of %llu MB have changed\n", TO_MIB(changed),
+	       TO_MIB(total));
+	if (range_cnt == 0)
+		ERR_EXIT("Memory has not changed since snapshot \"%s\"",
+			 g.opts.snapshot);
+	dfi_mem_restrict(range_vec, range_cnt);
+	zg_free(range_vec);
+}
+
+/*
+ * Compute block digests of live dump, if "--snapshot" has been specified
+ *
+ * If the snapshot file of a previous run exists, the dump memory is
+ * restricted to the blocks that have changed since then. Otherwise the
+ * complete memory is dumped.
+ */
+void snapshot_init(void)
+{
+	if (!g.opts.snapshot)
+		return;
+	if (strcmp(dfi_name(), "devmem") != 0)
+		ERR_EXIT("Snapshots are only possible for live dumps");
+	blk_vec_init();
+	blk_hash();
+	if (prev_read() == 0)
+		mem_restrict();
+}
+
+/*
+ * Replace snapshot file with block digests of current dump
+ *
+ * The output file is synced before, so that the snapshot file never
+ * refers to data that has not been written.
+ */
+void snapshot_exit(void)
+{
+	char tmp_path[PATH_MAX];
+	unsigned long i;
+	FILE *fh;
+
+	if (!g.opts.snapshot)
+		return;
+	if (fdatasync(STDOUT_FILENO) == -1 && errno != EINVAL)
+		ERR_EXIT_ERRNO("Could not sync output file");
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g.opts.snapshot) >=
+	    (int) sizeof(tmp_path))
+		ERR_EXIT("Path name for snapshot \"%s\" is too long",
+			 g.opts.snapshot);
+	fh = fopen(tmp_path, "w");
+	if (!fh)
+		ERR_EXIT_ERRNO("Could not create snapshot \"%s\"", tmp_path);
+	fprintf(fh, "# zgetdump snapshot\n");
+	fprintf(fh, "# source: %s\n", g.opts.device);
+	fprintf(fh, "# digest: zg64\n");
+	fprintf(fh, "# block_size: %llu\n", SNAPSHOT_BLK_SIZE);
+	for (i = 0; i < l.blk_cnt; i++) {
+		fprintf(fh, "block %llx %llx %016llx\n",
+			(unsigned long long) l.blk_vec[i].addr,
+			(unsigned long long) l.blk_vec[i].size,
+			(unsigned long long) l.blk_vec[i].digest);
+	}
+	if (fflush(fh) || fsync(fileno(fh)) || fclose(fh))
+		ERR_EXIT_ERRNO("Could not write snapshot \"%s\"", tmp_path);
+	if (rename(tmp_path, g.opts.snapshot) == -1)
+		ERR_EXIT_ERRNO("Could not create snapshot \"%s\"",
+			       g.opts.snapshot);
+}
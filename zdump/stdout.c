@@ -7,31 +7,710 @@
  * Author(s): Michael Holzheu <holzheu@linux.vnet.ibm.com>
  */
 
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <fcntl.h>
 #include "zgetdump.h"
 
-int stdout_write_dump(void)
+#define PAR_BLK_SIZE	(4 * MIB)	/* Size of one parallel read block */
+#define PAR_BLK_PER_JOB	2		/* Buffers per reader thread */
+#define SEQ_DIRECT_SIZE	(64 * MIB)	/* Size of one sequential direct copy */
+#define PIPE_SIZE	MIB		/* Pipe size for splice() */
+
+/*
+ * Block buffer for parallel copy
+ */
+struct par_blk {
+	void	*buf;		/* Page aligned buffer */
+	u64	cnt;		/* Number of valid bytes in buffer */
+	int	ready;		/* Buffer has been filled by reader thread */
+	int	direct;		/* Block has to be copied with direct_copy() */
+};
+
+/*
+ * Output dump range for per-volume copy
+ *
+ * "fh" is the input dump file that contains the data of the range
+ * unmodified or NULL, if the data has to be read with dfo_pread().
+ */
+struct vol_range {
+	struct zg_fh	*fh;
+	u64		off;
+	u64		cnt;
+};
+
+/*
+ * Methods for copying input dump file data to stdout in the kernel
+ */
+enum direct_mode {
+	DIRECT_NONE,		/* Data has to be copied via user space */
+	DIRECT_CFR,		/* Use copy_file_range() */
+	DIRECT_SPLICE,		/* Use splice() via pipe */
+	DIRECT_SPLICE_OUT,	/* Use splice() to stdout pipe */
+};
+
+/*
+ * File local static data
+ *
+ * For sparse output "hole_size" is the number of zero bytes that have been
+ * skipped and not yet been followed by data.
+ *
+ * Output dump data that is an unmodified copy of the input dump file is
+ * copied with "direct_mode". If a method is not supported, the next one
+ * is tried. Once a method has succeeded, errors are fatal.
+ *
+ * For parallel copy the output dump is split into blocks of PAR_BLK_SIZE.
+ * Block "nr" is read into ring buffer slot "nr % blk_cnt". The reader
+ * threads claim the blocks in ascending order and the main thread writes
+ * them in the same order. A reader thread has to wait until its slot has
+ * been written before it can refill it.
+ *
+ * For per-volume copy the output dump is split into ranges that are
+ * stored in the same input file. Each reader thread claims one input file,
+ * for example one volume of a multi-volume dump, and writes all of its
+ * ranges at their offsets in the output file.
+ */
+static struct {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	struct par_blk	*blk_vec;	/* Ring buffer of blocks */
+	unsigned int	blk_cnt;	/* Number of blocks in ring buffer */
+	u64		blk_start;	/* Output dump offset of block 0 */
+	u64		blk_total;	/* Number of blocks in dump */
+	u64		blk_next;	/* Next block to be claimed by reader */
+	u64		blk_written;	/* Number of written blocks */
+	int		sparse;		/* Skip zero pages in output file */
+	u64		hole_size;	/* Pending hole in output file */
+	enum direct_mode direct_mode;	/* Method for direct copy */
+	int		direct_ok;	/* Direct copy has succeeded */
+	int		pipe_fd[2];	/* Pipe for DIRECT_SPLICE */
+	struct vol_range *range_vec;	/* Ranges for per-volume copy */
+	unsigned int	range_cnt;	/* Number of ranges */
+	struct zg_fh	**fh_vec;	/* Input files for per-volume copy */
+	unsigned int	fh_cnt;		/* Number of input files */
+	unsigned int	fh_next;	/* Next input file to be claimed */
+	off_t		out_off;	/* Offset of dump in output file */
+	u64		vol_written;	/* Bytes written by per-volume copy */
+} l = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Write "cnt" bytes of "buf" to stdout after pending hole
+ */
+static void write_data(void *buf, u64 cnt)
 {
-	u64 cnt, written = 0;
+	ssize_t rc;
+
+	if (cnt == 0)
+		return;
+	if (l.hole_size) {
+		if (lseek(STDOUT_FILENO, l.hole_size, SEEK_CUR) == -1)
+			ERR_EXIT_ERRNO("Error: Seek failed");
+		l.hole_size = 0;
+	}
+	rc = write(STDOUT_FILENO, buf, cnt);
+	if (rc == -1)
+		ERR_EXIT_ERRNO("Error: Write failed");
+	if (rc != (ssize_t) cnt)
+		ERR_EXIT("Error: Could not write full block");
+}
+
+/*
+ * Write "cnt" bytes of "buf" to stdout
+ *
+ * For sparse output zero pages are not written. Instead the file offset is
+ * moved so that they become holes in the output file.
+ */
+static void write_buf(void *buf, u64 cnt)
+{
+	u64 i, pg_size, data_off = 0;
+
+	manifest_update(buf, cnt);
+	if (!l.sparse) {
+		write_data(buf, cnt);
+		return;
+	}
+	for (i = 0; i < cnt; i += pg_size) {
+		pg_size = MIN(PAGE_SIZE, cnt - i);
+		if (!zg_is_zero(buf + i, pg_size))
+			continue;
+		write_data(buf + data_off, i - data_off);
+		l.hole_size += pg_size;
+		data_off = i + pg_size;
+	}
+	write_data(buf + data_off, cnt - data_off);
+}
+
+/*
+ * Enable sparse output if stdout is a regular file
+ *
+ * Holes can only be used if all skipped bytes are beyond the end of the
+ * file. Otherwise old file content would remain in place of zero pages.
+ */
+static void sparse_init(void)
+{
+	struct stat sb;
+	off_t off;
+	int flags;
+
+	if (!g.opts.sparse)
+		return;
+	if (fstat(STDOUT_FILENO, &sb) || !S_ISREG(sb.st_mode))
+		return;
+	flags = fcntl(STDOUT_FILENO, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return;
+	off = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	if (off == -1 || off < sb.st_size)
+		return;
+	l.sparse = 1;
+}
+
+/*
+ * Extend output file if it ends with a hole
+ */
+static void sparse_exit(void)
+{
+	off_t off;
+
+	if (l.hole_size == 0)
+		return;
+	off = lseek(STDOUT_FILENO, l.hole_size, SEEK_CUR);
+	if (off == -1)
+		ERR_EXIT_ERRNO("Error: Seek failed");
+	if (ftruncate(STDOUT_FILENO, off))
+		ERR_EXIT_ERRNO("Error: Could not set size of output file");
+	l.hole_size = 0;
+}
+
+/*
+ * Select direct copy method for stdout
+ *
+ * Direct copy is not used for sparse output because the data has to be
+ * checked for zero pages. It is also not used with asynchronous reads,
+ * because they are done by zg_pread(), and for the manifest, because the
+ * data has to be passed to the digests.
+ */
+static void direct_init(void)
+{
+	struct stat sb;
+	int flags;
+
+	l.direct_mode = DIRECT_NONE;
+	if (l.sparse || g.opts.aio_depth || g.opts.manifest ||
+	    fstat(STDOUT_FILENO, &sb))
+		return;
+	flags = fcntl(STDOUT_FILENO, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return;
+	if (S_ISREG(sb.st_mode))
+		l.direct_mode = DIRECT_CFR;
+	else if (S_ISFIFO(sb.st_mode))
+		l.direct_mode = DIRECT_SPLICE_OUT;
+}
+
+/*
+ * Switch to next direct copy method after current one is not supported
+ *
+ * Only the main thread changes "direct_mode". The lock is taken because
+ * parallel reader threads check it.
+ */
+static void direct_next(void)
+{
+	enum direct_mode mode = DIRECT_NONE;
+
+	if (l.direct_mode == DIRECT_CFR && pipe(l.pipe_fd) == 0) {
+		/* A larger pipe reduces the number of system calls */
+		fcntl(l.pipe_fd[1], F_SETPIPE_SZ, PIPE_SIZE);
+		mode = DIRECT_SPLICE;
+	}
+	pthread_mutex_lock(&l.lock);
+	l.direct_mode = mode;
+	pthread_mutex_unlock(&l.lock);
+}
+
+/*
+ * Move "cnt" bytes from "fd" at offset "off" to stdout with splice()
+ */
+static ssize_t direct_splice(int fd, u64 off, u64 cnt)
+{
+	loff_t off_in = off;
+	ssize_t rc, done, size;
+
+	if (l.direct_mode == DIRECT_SPLICE_OUT)
+		return splice(fd, &off_in, STDOUT_FILENO, NULL, cnt, 0);
+	rc = splice(fd, &off_in, l.pipe_fd[1], NULL, MIN(cnt, PIPE_SIZE), 0);
+	if (rc <= 0)
+		return rc;
+	for (done = 0; done < rc; done += size) {
+		size = splice(l.pipe_fd[0], NULL, STDOUT_FILENO, NULL,
+			      rc - done, 0);
+		if (size <= 0)
+			ERR_EXIT_ERRNO("Error: Write failed");
+	}
+	return rc;
+}
+
+/*
+ * Copy "cnt" bytes of output dump at offset "off" to stdout in the kernel
+ *
+ * Return the number of copied bytes. The copy stops at the first byte that
+ * is not stored unmodified in the input dump file or when no direct copy
+ * method is supported. The rest has to be copied via user space.
+ */
+static u64 direct_copy(u64 off, u64 cnt)
+{
+	u64 file_off, size, copied = 0;
+	struct zg_fh *fh;
+	loff_t off_in;
+	ssize_t rc;
+
+	while (copied < cnt && l.direct_mode != DIRECT_NONE) {
+		size = dfo_file_map(off + copied, cnt - copied, &fh, &file_off);
+		if (size == 0)
+			break;
+		off_in = file_off;
+		if (l.direct_mode == DIRECT_CFR)
+			rc = copy_file_range(fh->fh, &off_in, STDOUT_FILENO,
+					     NULL, size, 0);
+		else
+			rc = direct_splice(fh->fh, file_off, size);
+		if (rc > 0) {
+			copied += rc;
+			l.direct_ok = 1;
+		} else if (rc == 0) {
+			/* End of input file: Let the caller report the error */
+			break;
+		} else if (l.direct_ok) {
+			ERR_EXIT_ERRNO("Error: Copy failed");
+		} else {
+			direct_next();
+		}
+	}
+	return copied;
+}
+
+/*
+ * Print progress and write checkpoint after "written" bytes
+ */
+static void progress(u64 written)
+{
+	zg_progress(written);
+	if (!checkpoint_due(written))
+		return;
+	/* The checkpoint covers pending holes of sparse output */
+	sparse_exit();
+	checkpoint_write(written);
+}
+
+/*
+ * Copy dump sequentially with one thread starting at offset "start"
+ */
+static void copy_seq(u64 start)
+{
+	u64 cnt, written = start;
 	char buf[32768];
+
+	dfo_seek(start);
+	while (written != dfo_size()) {
+		cnt = direct_copy(written, MIN(SEQ_DIRECT_SIZE,
+					       dfo_size() - written));
+		if (cnt) {
+			dfo_seek(written + cnt);
+		} else {
+			cnt = dfo_read(buf, sizeof(buf));
+			if (cnt == 0)
+				ERR_EXIT("Error: Could not read dump data");
+			write_buf(buf, cnt);
+		}
+		written += cnt;
+		progress(written);
+	}
+}
+
+/*
+ * Reader thread: Fill ring buffer blocks via dfo_pread()
+ */
+static void *par_reader_fn(void *UNUSED(data))
+{
+	u64 nr, off, size, file_off;
+	struct par_blk *blk;
+	struct zg_fh *fh;
+	int direct;
+
+	pthread_mutex_lock(&l.lock);
+	while (l.blk_next < l.blk_total) {
+		nr = l.blk_next++;
+		blk = &l.blk_vec[nr % l.blk_cnt];
+		while (nr >= l.blk_written + l.blk_cnt)
+			pthread_cond_wait(&l.cond, &l.lock);
+		direct = l.direct_mode != DIRECT_NONE;
+		pthread_mutex_unlock(&l.lock);
+
+		off = l.blk_start + nr * PAR_BLK_SIZE;
+		size = MIN(PAR_BLK_SIZE, dfo_size() - off);
+		/* Blocks of input file data are copied by the main thread */
+		if (direct && dfo_file_map(off, size, &fh, &file_off) == size) {
+			blk->cnt = size;
+			blk->direct = 1;
+		} else {
+			blk->cnt = dfo_pread(blk->buf, size, off);
+			blk->direct = 0;
+		}
+
+		pthread_mutex_lock(&l.lock);
+		blk->ready = 1;
+		pthread_cond_broadcast(&l.cond);
+	}
+	pthread_mutex_unlock(&l.lock);
+	return NULL;
+}
+
+/*
+ * Write block "blk" at offset "off" that has not been read by a reader thread
+ */
+static void par_blk_direct(struct par_blk *blk, u64 off)
+{
+	u64 copied;
+
+	copied = direct_copy(off, blk->cnt);
+	if (copied == blk->cnt)
+		return;
+	/* Direct copy not possible: Read and write rest of block */
+	dfo_pread(blk->buf, blk->cnt - copied, off + copied);
+	write_buf(blk->buf, blk->cnt - copied);
+}
+
+/*
+ * Copy dump with "jobs" reader threads starting at offset "start" and
+ * write it in order
+ */
+static void copy_par(unsigned int jobs, u64 start)
+{
+	pthread_t *thread_vec;
+	struct par_blk *blk;
+	u64 written = start;
+	unsigned int i;
+
+	l.blk_cnt = jobs * PAR_BLK_PER_JOB;
+	l.blk_start = start;
+	l.blk_total = (dfo_size() - start + PAR_BLK_SIZE - 1) / PAR_BLK_SIZE;
+	l.blk_vec = zg_alloc(l.blk_cnt * sizeof(*l.blk_vec));
+	for (i = 0; i < l.blk_cnt; i++) {
+		if (posix_memalign(&l.blk_vec[i].buf, PAGE_SIZE, PAR_BLK_SIZE))
+			ERR_EXIT("Alloc: Out of memory (%i KiB)",
+				 TO_KIB(PAR_BLK_SIZE));
+	}
+	thread_vec = zg_alloc(jobs * sizeof(*thread_vec));
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&thread_vec[i], NULL, par_reader_fn, NULL))
+			ERR_EXIT("Could not create reader thread");
+	}
+	while (l.blk_written < l.blk_total) {
+		blk = &l.blk_vec[l.blk_written % l.blk_cnt];
+		pthread_mutex_lock(&l.lock);
+		while (!blk->ready)
+			pthread_cond_wait(&l.cond, &l.lock);
+		pthread_mutex_unlock(&l.lock);
+
+		if (blk->direct)
+			par_blk_direct(blk, written);
+		else
+			write_buf(blk->buf, blk->cnt);
+		written += blk->cnt;
+		progress(written);
+
+		pthread_mutex_lock(&l.lock);
+		blk->ready = 0;
+		l.blk_written++;
+		pthread_cond_broadcast(&l.cond);
+		pthread_mutex_unlock(&l.lock);
+	}
+	for (i = 0; i < jobs; i++)
+		pthread_join(thread_vec[i], NULL);
+	for (i = 0; i < l.blk_cnt; i++)
+		free(l.blk_vec[i].buf);
+	zg_free(l.blk_vec);
+	zg_free(thread_vec);
+}
+
+/*
+ * Add output dump range that is stored in input file "fh"
+ */
+static void vol_range_add(struct zg_fh *fh, u64 off, u64 cnt)
+{
+	struct vol_range *range = NULL;
+	unsigned int i;
+
+	if (l.range_cnt)
+		range = &l.range_vec[l.range_cnt - 1];
+	if (range && range->fh == fh && range->off + range->cnt == off) {
+		range->cnt += cnt;
+		return;
+	}
+	l.range_vec = zg_realloc(l.range_vec, (l.range_cnt + 1) *
+				 sizeof(*l.range_vec));
+	range = &l.range_vec[l.range_cnt++];
+	range->fh = fh;
+	range->off = off;
+	range->cnt = cnt;
+	if (!fh)
+		return;
+	for (i = 0; i < l.fh_cnt; i++) {
+		if (l.fh_vec[i] == fh)
+			return;
+	}
+	l.fh_vec = zg_realloc(l.fh_vec, (l.fh_cnt + 1) * sizeof(*l.fh_vec));
+	l.fh_vec[l.fh_cnt++] = fh;
+}
+
+/*
+ * Free output dump ranges
+ */
+static void vol_exit(void)
+{
+	zg_free(l.range_vec);
+	zg_free(l.fh_vec);
+	l.range_vec = NULL;
+	l.fh_vec = NULL;
+	l.range_cnt = l.fh_cnt = 0;
+}
+
+/*
+ * Split output dump into ranges and check if per-volume copy can be used
+ *
+ * This requires more than one input file and a regular output file,
+ * because the ranges are written at their offsets in parallel. The digests
+ * for the manifest and the checkpoints need the data in order, so they
+ * cannot be used.
+ */
+static int vol_init(void)
+{
+	u64 off, cnt, file_off;
+	struct zg_fh *fh;
+	struct stat sb;
+	int flags;
+
+	if (g.opts.manifest || g.opts.checkpoint)
+		return -1;
+	if (fstat(STDOUT_FILENO, &sb) || !S_ISREG(sb.st_mode))
+		return -1;
+	flags = fcntl(STDOUT_FILENO, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return -1;
+	l.out_off = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	if (l.out_off == -1)
+		return -1;
+	for (off = 0; off < dfo_size(); off += cnt) {
+		cnt = dfo_file_map(off, dfo_size() - off, &fh, &file_off);
+		if (cnt == 0) {
+			fh = NULL;
+			cnt = dfo_chunk_left(off, dfo_size() - off);
+		}
+		if (cnt == 0)
+			break;
+		vol_range_add(fh, off, cnt);
+	}
+	if (off == dfo_size() && l.fh_cnt > 1)
+		return 0;
+	vol_exit();
+	return -1;
+}
+
+/*
+ * Write "cnt" bytes of "buf" at output dump offset "off"
+ */
+static void vol_pwrite(void *buf, u64 cnt, u64 off)
+{
 	ssize_t rc;
 
+	if (cnt == 0)
+		return;
+	rc = pwrite(STDOUT_FILENO, buf, cnt, l.out_off + off);
+	if (rc == -1)
+		ERR_EXIT_ERRNO("Error: Write failed");
+	if (rc != (ssize_t) cnt)
+		ERR_EXIT("Error: Could not write full block");
+}
+
+/*
+ * Write "cnt" bytes of "buf" at output dump offset "off"
+ *
+ * For sparse output zero pages are not written and become holes.
+ */
+static void vol_write(void *buf, u64 cnt, u64 off)
+{
+	u64 i, pg_size, data_off = 0;
+
+	if (!l.sparse) {
+		vol_pwrite(buf, cnt, off);
+		return;
+	}
+	for (i = 0; i < cnt; i += pg_size) {
+		pg_size = MIN(PAGE_SIZE, cnt - i);
+		if (!zg_is_zero(buf + i, pg_size))
+			continue;
+		vol_pwrite(buf + data_off, i - data_off, off + data_off);
+		data_off = i + pg_size;
+	}
+	vol_pwrite(buf + data_off, cnt - data_off, off + data_off);
+}
+
+/*
+ * Copy "cnt" bytes at output dump offset "off" with copy_file_range()
+ *
+ * Return the number of copied bytes. If copy_file_range() is not
+ * supported, direct copy is disabled for all threads.
+ */
+static u64 vol_direct_copy(u64 off, u64 cnt)
+{
+	u64 file_off, size, copied = 0;
+	loff_t off_in, off_out;
+	struct zg_fh *fh;
+	ssize_t rc;
+
+	while (copied < cnt) {
+		size = dfo_file_map(off + copied, cnt - copied, &fh, &file_off);
+		if (size == 0)
+			break;
+		off_in = file_off;
+		off_out = l.out_off + off + copied;
+		rc = copy_file_range(fh->fh, &off_in, STDOUT_FILENO, &off_out,
+				     size, 0);
+		if (rc == -1 && l.direct_ok)
+			ERR_EXIT_ERRNO("Error: Copy failed");
+		pthread_mutex_lock(&l.lock);
+		if (rc > 0)
+			l.direct_ok = 1;
+		else if (rc == -1)
+			l.direct_mode = DIRECT_NONE;
+		pthread_mutex_unlock(&l.lock);
+		if (rc <= 0)
+			break;
+		copied += rc;
+	}
+	return copied;
+}
+
+/*
+ * Copy output dump range using buffer "buf" of PAR_BLK_SIZE bytes
+ */
+static void vol_copy_range(struct vol_range *range, void *buf)
+{
+	u64 off, size, copied, end = range->off + range->cnt;
+	int direct;
+
+	for (off = range->off; off < end; off += size) {
+		size = MIN(PAR_BLK_SIZE, end - off);
+		pthread_mutex_lock(&l.lock);
+		direct = l.direct_mode == DIRECT_CFR;
+		pthread_mutex_unlock(&l.lock);
+		copied = direct ? vol_direct_copy(off, size) : 0;
+		if (copied != size) {
+			dfo_pread(buf, size - copied, off + copied);
+			vol_write(buf, size - copied, off + copied);
+		}
+		pthread_mutex_lock(&l.lock);
+		l.vol_written += size;
+		zg_progress(l.vol_written);
+		pthread_mutex_unlock(&l.lock);
+	}
+}
+
+/*
+ * Reader thread: Copy all ranges of claimed input files
+ */
+static void *vol_reader_fn(void *UNUSED(data))
+{
+	void *buf = zg_alloc(PAR_BLK_SIZE);
+	struct zg_fh *fh;
+	unsigned int i;
+
+	pthread_mutex_lock(&l.lock);
+	while (l.fh_next < l.fh_cnt) {
+		fh = l.fh_vec[l.fh_next++];
+		pthread_mutex_unlock(&l.lock);
+		for (i = 0; i < l.range_cnt; i++) {
+			if (l.range_vec[i].fh == fh)
+				vol_copy_range(&l.range_vec[i], buf);
+		}
+		pthread_mutex_lock(&l.lock);
+	}
+	pthread_mutex_unlock(&l.lock);
+	zg_free(buf);
+	return NULL;
+}
+
+/*
+ * Copy dump with one reader thread per input file (at most "jobs")
+ *
+ * The ranges that are not stored in input files, e.g. dump headers, are
+ * written by the main thread.
+ */
+static void copy_vol(unsigned int jobs)
+{
+	void *buf = zg_alloc(PAR_BLK_SIZE);
+	pthread_t *thread_vec;
+	unsigned int i;
+	off_t off;
+
+	jobs = MIN(jobs, l.fh_cnt);
+	thread_vec = zg_alloc(jobs * sizeof(*thread_vec));
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&thread_vec[i], NULL, vol_reader_fn, NULL))
+			ERR_EXIT("Could not create reader thread");
+	}
+	for (i = 0; i < l.range_cnt; i++) {
+		if (!l.range_vec[i].fh)
+			vol_copy_range(&l.range_vec[i], buf);
+	}
+	for (i = 0; i < jobs; i++)
+		pthread_join(thread_vec[i], NULL);
+	/* Set file size for trailing holes and file position after dump */
+	off = l.out_off + dfo_size();
+	if (l.sparse && ftruncate(STDOUT_FILENO, off))
+		ERR_EXIT_ERRNO("Error: Could not set size of output file");
+	if (lseek(STDOUT_FILENO, off, SEEK_SET) == -1)
+		ERR_EXIT_ERRNO("Error: Seek failed");
+	zg_free(thread_vec);
+	zg_free(buf);
+	vol_exit();
+}
+
+int stdout_write_dump(void)
+{
+	u64 start;
+
 	if (!dfi_feat_copy())
 		ERR_EXIT("Copying not possible for %s dumps", dfi_name());
 	STDERR("Format Info:\n");
 	STDERR("  Source: %s\n", dfi_name());
 	STDERR("  Target: %s\n", dfo_name());
 	STDERR("\n");
+	if (g.opts.aio_depth &&
+	    dfi_mem_aio_start(g.opts.aio_depth, g.opts.odirect) != 0)
+		STDERR("Asynchronous I/O not available, using synchronous "
+		       "reads\n\n");
+	start = checkpoint_init();
+	sparse_init();
+	direct_init();
+	manifest_init(checkpoint_manifest());
+	checkpoint_write(start);
 	zg_progress_init("Copying dump", dfo_size());
-	do {
-		cnt = dfo_read(buf, sizeof(buf));
-		rc = write(STDOUT_FILENO, buf, cnt);
-		if (rc == -1)
-			ERR_EXIT_ERRNO("Error: Write failed");
-		if (rc != (ssize_t) cnt)
-			ERR_EXIT("Error: Could not write full block");
-		written += cnt;
-		zg_progress(written);
-	} while (written != dfo_size());
+	/* Parallel reads require a source dump that is read with pread() */
+	if (g.opts.jobs > 1 && dfi_feat_par()) {
+		if (vol_init() == 0)
+			copy_vol(g.opts.jobs);
+		else
+			copy_par(g.opts.jobs, start);
+	} else {
+		copy_seq(start);
+	}
+	sparse_exit();
+	manifest_exit();
+	checkpoint_exit();
 	STDERR("\n");
 	STDERR("Success: Dump has been copied\n");
 	return 0;
@@ -22,6 +22,8 @@
 #include "zgetdump.h"
 
 #define DUMP_PATH_MAX	100
+#define STATS_PATH	"/stats"
+#define STATS_SIZE_MAX	1024
 
 /*
  * File local static data
@@ -30,6 +32,7 @@ static struct {
 	char		path[DUMP_PATH_MAX];
 	struct stat	stat_root;
 	struct stat	stat_dump;
+	struct stat	stat_stats;
 } l;
 
 /*
@@ -73,11 +76,23 @@ static void stat_dump_init(void)
 	l.stat_dump.st_blocks = l.stat_dump.st_size / 4096;
 }
 
+/*
+ * Initialize stat buffer for cache statistics file
+ */
+static void stat_stats_init(void)
+{
+	stat_default_init(&l.stat_stats);
+	l.stat_stats.st_mode = S_IFREG | 0400;
+	l.stat_stats.st_nlink = 1;
+}
+
 /*
  * FUSE callback: Getattr
  */
 static int zfuse_getattr(const char *path, struct stat *stat)
 {
+	char buf[STATS_SIZE_MAX];
+
 	if (strcmp(path, "/") == 0) {
 		*stat = l.stat_root;
 		return 0;
@@ -86,6 +101,11 @@ static int zfuse_getattr(const char *path, struct stat *stat)
 		*stat = l.stat_dump;
 		return 0;
 	}
+	if (strcmp(path, STATS_PATH) == 0) {
+		*stat = l.stat_stats;
+		stat->st_size = zfuse_cache_stats(buf, sizeof(buf));
+		return 0;
+	}
 	return -ENOENT;
 }
 
@@ -104,6 +124,7 @@ static int zfuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 	filler(buf, ".", NULL, 0);
 	filler(buf, "..", NULL, 0);
 	filler(buf, &l.path[1], NULL, 0);
+	filler(buf, &STATS_PATH[1], NULL, 0);
 	return 0;
 }
 
@@ -112,14 +133,35 @@ static int zfuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
  */
 static int zfuse_open(const char *path, struct fuse_file_info *fi)
 {
-	if (strcmp(path, l.path) != 0)
-		return -ENOENT;
 	if ((fi->flags & 3) != O_RDONLY)
 		return -EACCES;
+	if (strcmp(path, STATS_PATH) == 0) {
+		/* Statistics change with every read - bypass page cache */
+		fi->direct_io = 1;
+		return 0;
+	}
+	if (strcmp(path, l.path) != 0)
+		return -ENOENT;
 	l.stat_dump.st_atime = time(NULL);
 	return 0;
 }
 
+/*
+ * Read cache statistics file
+ */
+static int stats_read(char *buf, size_t size, off_t offset)
+{
+	char stats[STATS_SIZE_MAX];
+	int len;
+
+	len = zfuse_cache_stats(stats, sizeof(stats));
+	if (offset >= len)
+		return 0;
+	size = MIN(size, (size_t) (len - offset));
+	memcpy(buf, &stats[offset], size);
+	return size;
+}
+
 /*
  * FUSE callback: Read
  */
@@ -128,11 +170,11 @@ static int zfuse_read(const char *path, char *buf, size_t size, off_t offset,
 {
 	(void) fi;
 
+	if (strcmp(path, STATS_PATH) == 0)
+		return stats_read(buf, size, offset);
 	if (strcmp(path, l.path) != 0)
 		return -ENOENT;
-	dfo_seek(offset);
-	dfo_read(buf, size);
-	return size;
+	return zfuse_cache_read(buf, size, offset);
 }
 
 /*
@@ -145,7 +187,7 @@ static int zfuse_statfs(const char *path, struct statvfs *buf)
 	buf->f_bsize = buf->f_frsize = 4096;
 	buf->f_blocks = dfo_size() / 4096;
 	buf->f_bfree = buf->f_bavail = 0;
-	buf->f_files = 1;
+	buf->f_files = 2;
 	buf->f_ffree = 0;
 	buf->f_namemax = strlen(l.path) + 1;
 	return 0;
@@ -183,10 +225,11 @@ static void add_argv_fuse(struct fuse_args *args)
  * Mount dump
  *
  * Add additional FUSE options:
- * - s....................: Disable multi-threaded operation
  * - o fsname.............: File system name (used for umount)
  * - o ro.................: Read only
  * - o default_permissions: Enable permission checking by kernel
+ * - s....................: Disable multi-threaded operation for dumps that
+ *                          cannot be read by several threads
  */
 int zfuse_mount_dump(void)
 {
@@ -196,15 +239,18 @@ int zfuse_mount_dump(void)
 	if (!dfi_feat_seek())
 		ERR_EXIT("Mounting not possible for %s dumps", dfi_name());
 	fuse_opt_add_arg(&args, "zgetdump");
-	fuse_opt_add_arg(&args, "-s");
 	snprintf(tmp_str, sizeof(tmp_str),
 		 "-ofsname=%s,ro,default_permissions,nonempty",
 		 g.opts.device);
 	fuse_opt_add_arg(&args, tmp_str);
 	fuse_opt_add_arg(&args, g.opts.mount_point);
+	if (!dfi_feat_par())
+		fuse_opt_add_arg(&args, "-s");
 	add_argv_fuse(&args);
 	stat_root_init();
 	stat_dump_init();
+	stat_stats_init();
+	zfuse_cache_init(g.opts.cache_size);
 	snprintf(l.path, sizeof(l.path), "/dump.%s", dfo_name());
 	return fuse_main(args.argc, args.argv, &zfuse_ops);
 }
@@ -0,0 +1,292 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Page cache with read-ahead for mounted dumps
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#include <pthread.h>
+#include "zgetdump.h"
+
+#define CACHE_RA_MIN	(64 * KIB)	/* Initial read-ahead window */
+#define CACHE_RA_MAX	(2 * MIB)	/* Maximum read-ahead window */
+#define CACHE_HASH_MIN	1024		/* Minimum hash table size */
+
+/*
+ * Cached page of the output dump
+ */
+struct cache_pg {
+	struct util_list_node	list;		/* LRU list */
+	struct cache_pg		*hash_next;	/* Hash bucket chain */
+	u64			pg_nr;		/* Page number in output dump */
+	char			data[PAGE_SIZE];
+};
+
+/*
+ * Read-ahead buffer
+ */
+struct cache_buf {
+	struct cache_buf	*next;
+	char			data[CACHE_RA_MAX];
+};
+
+/*
+ * Cache statistics
+ */
+struct cache_stats {
+	u64	hits;		/* Pages found in cache */
+	u64	misses;		/* Pages not found in cache */
+	u64	ra_pgs;		/* Pages read in advance */
+	u64	evictions;	/* Pages removed from cache */
+};
+
+/*
+ * File local static data
+ *
+ * The LRU list contains the least recently used page at the start and the
+ * most recently used page at the end. All cache data is protected by "lock".
+ * The lock is released while pages are read from the dump, so that
+ * multiple FUSE threads can read from the dump in parallel.
+ */
+static struct {
+	pthread_mutex_t		lock;
+	struct util_list	lru;
+	struct cache_pg		**hash_vec;
+	unsigned int		hash_cnt;
+	unsigned int		pg_cnt;		/* Pages in cache */
+	unsigned int		pg_max;		/* Maximum pages in cache */
+	u64			seq_next;	/* Expected next sequential offset */
+	u64			ra_size;	/* Current read-ahead window */
+	struct cache_buf	*buf_free;	/* Unused read-ahead buffers */
+	struct cache_stats	stats;
+} l = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Return hash bucket for page number
+ */
+static struct cache_pg **hash_bucket(u64 pg_nr)
+{
+	return &l.hash_vec[pg_nr % l.hash_cnt];
+}
+
+/*
+ * Find page in cache
+ */
+static struct cache_pg *pg_find(u64 pg_nr)
+{
+	struct cache_pg *pg;
+
+	for (pg = *hash_bucket(pg_nr); pg; pg = pg->hash_next) {
+		if (pg->pg_nr == pg_nr)
+			return pg;
+	}
+	return NULL;
+}
+
+/*
+ * Remove page from hash bucket chain
+ */
+static void pg_hash_remove(struct cache_pg *pg)
+{
+	struct cache_pg **ptr = hash_bucket(pg->pg_nr);
+
+	while (*ptr != pg)
+		ptr = &(*ptr)->hash_next;
+	*ptr = pg->hash_next;
+}
+
+/*
+ * Get free page: Allocate new page or evict least recently used page
+ */
+static struct cache_pg *pg_get_free(void)
+{
+	struct cache_pg *pg;
+
+	if (l.pg_cnt < l.pg_max) {
+		l.pg_cnt++;
+		return zg_alloc(sizeof(*pg));
+	}
+	pg = util_list_start(&l.lru);
+	util_list_remove(&l.lru, pg);
+	pg_hash_remove(pg);
+	l.stats.evictions++;
+	return pg;
+}
+
+/*
+ * Add page with content "data" to cache
+ */
+static void pg_add(u64 pg_nr, void *data)
+{
+	struct cache_pg *pg = pg_get_free();
+	struct cache_pg **bucket = hash_bucket(pg_nr);
+
+	pg->pg_nr = pg_nr;
+	memcpy(pg->data, data, PAGE_SIZE);
+	pg->hash_next = *bucket;
+	*bucket = pg;
+	util_list_add_tail(&l.lru, pg);
+}
+
+/*
+ * Mark page as most recently used
+ */
+static void pg_touch(struct cache_pg *pg)
+{
+	util_list_remove(&l.lru, pg);
+	util_list_add_tail(&l.lru, pg);
+}
+
+/*
+ * Update read-ahead window: Double it for sequential streams and disable
+ * it for random access
+ */
+static void ra_update(u64 off, u64 cnt)
+{
+	if (off == l.seq_next && off != 0) {
+		if (l.ra_size == 0)
+			l.ra_size = CACHE_RA_MIN;
+		else
+			l.ra_size = MIN(l.ra_size * 2, CACHE_RA_MAX);
+	} else {
+		l.ra_size = 0;
+	}
+	l.seq_next = off + cnt;
+}
+
+/*
+ * Get read-ahead buffer (called with lock held)
+ */
+static struct cache_buf *buf_get(void)
+{
+	struct cache_buf *buf = l.buf_free;
+
+	if (!buf)
+		return zg_alloc(sizeof(*buf));
+	l.buf_free = buf->next;
+	return buf;
+}
+
+/*
+ * Return read-ahead buffer (called with lock held)
+ */
+static void buf_put(struct cache_buf *buf)
+{
+	buf->next = l.buf_free;
+	l.buf_free = buf;
+}
+
+/*
+ * Read pages starting with page "pg_nr" into the cache
+ *
+ * At least "pg_req" pages are read. For sequential streams the current
+ * read-ahead window is read in addition. Pages that are already cached
+ * are not replaced. The function is called with lock held and drops the
+ * lock while reading the dump.
+ */
+static void pg_fill(u64 pg_nr, u64 pg_req)
+{
+	u64 i, pg_cnt, cnt, off = pg_nr * PAGE_SIZE;
+	struct cache_buf *buf;
+	struct cache_pg *pg;
+
+	pg_cnt = MAX(pg_req, l.ra_size / PAGE_SIZE);
+	pg_cnt = MIN(pg_cnt, CACHE_RA_MAX / PAGE_SIZE);
+	pg_cnt = MIN(pg_cnt, (dfo_size() - off + PAGE_SIZE - 1) / PAGE_SIZE);
+	buf = buf_get();
+	pthread_mutex_unlock(&l.lock);
+	cnt = dfo_pread(buf->data, pg_cnt * PAGE_SIZE, off);
+	memset(buf->data + cnt, 0, pg_cnt * PAGE_SIZE - cnt);
+	pthread_mutex_lock(&l.lock);
+	for (i = 0; i < pg_cnt; i++) {
+		/* Pages may have been added by other threads in the meantime */
+		pg = pg_find(pg_nr + i);
+		if (pg) {
+			pg_touch(pg);
+			continue;
+		}
+		pg_add(pg_nr + i, buf->data + i * PAGE_SIZE);
+		if (i >= pg_req)
+			l.stats.ra_pgs++;
+	}
+	buf_put(buf);
+}
+
+/*
+ * Read "cnt" bytes of the output dump at offset "off" via the cache
+ */
+u64 zfuse_cache_read(void *buf, u64 cnt, u64 off)
+{
+	u64 copied = 0, pg_nr, pg_off, pg_end, size;
+	struct cache_pg *pg;
+
+	if (l.pg_max == 0)
+		return dfo_pread(buf, cnt, off);
+	if (off >= dfo_size())
+		return 0;
+	cnt = MIN(cnt, dfo_size() - off);
+	pthread_mutex_lock(&l.lock);
+	ra_update(off, cnt);
+	pg_end = (off + cnt + PAGE_SIZE - 1) / PAGE_SIZE;
+	while (copied != cnt) {
+		pg_nr = (off + copied) / PAGE_SIZE;
+		pg_off = (off + copied) % PAGE_SIZE;
+		pg = pg_find(pg_nr);
+		if (pg) {
+			l.stats.hits++;
+			pg_touch(pg);
+		} else {
+			l.stats.misses++;
+			pg_fill(pg_nr, pg_end - pg_nr);
+			pg = pg_find(pg_nr);
+		}
+		size = MIN(cnt - copied, PAGE_SIZE - pg_off);
+		memcpy(buf + copied, pg->data + pg_off, size);
+		copied += size;
+	}
+	pthread_mutex_unlock(&l.lock);
+	return copied;
+}
+
+/*
+ * Write cache statistics as text into "buf" and return length of text
+ */
+int zfuse_cache_stats(char *buf, size_t size)
+{
+	int len;
+
+	pthread_mutex_lock(&l.lock);
+	len = snprintf(buf, size,
+			"cache_size_kb:  %llu\n"
+			"cache_pages:    %u\n"
+			"hits:           %llu\n"
+			"misses:         %llu\n"
+			"readahead:      %llu\n"
+			"evictions:      %llu\n",
+			(unsigned long long) l.pg_max * PAGE_SIZE / KIB,
+			l.pg_cnt,
+			(unsigned long long) l.stats.hits,
+			(unsigned long long) l.stats.misses,
+			(unsigned long long) l.stats.ra_pgs,
+			(unsigned long long) l.stats.evictions);
+	pthread_mutex_unlock(&l.lock);
+	return len;
+}
+
+/*
+ * Initialize cache with maximum size "size" in bytes (0 disables cache)
+ */
+void zfuse_cache_init(u64 size)
+{
+	util_list_init(&l.lru, struct cache_pg, list);
+	/* Read-ahead must not evict pages of the current request */
+	l.pg_max = size / PAGE_SIZE;
+	if (l.pg_max == 0)
+		return;
+	l.pg_max = MAX(l.pg_max, 2 * CACHE_RA_MAX / PAGE_SIZE);
+	l.hash_cnt = MAX(l.pg_max, CACHE_HASH_MIN);
+	l.hash_vec = zg_alloc(l.hash_cnt * sizeof(*l.hash_vec));
+}
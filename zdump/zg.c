@@ -42,11 +42,43 @@ struct devnode {
  * File local static data
  */
 static struct {
-	struct atexit	atexit;
-	struct prog	prog;
-	struct devnode	devnode;
+	struct atexit		atexit;
+	struct prog		prog;
+	struct devnode		devnode;
+	struct zg_io_stats	io_stats;
 } l;
 
+/*
+ * Account read system call with return code "rc"
+ *
+ * Reads can be done by multiple threads, therefore atomic operations
+ * are used.
+ */
+static void io_stats_read(ssize_t rc)
+{
+	__sync_fetch_and_add(&l.io_stats.read_cnt, 1);
+	if (rc > 0)
+		__sync_fetch_and_add(&l.io_stats.read_bytes, rc);
+}
+
+/*
+ * Account seek system call
+ */
+static void io_stats_seek(void)
+{
+	__sync_fetch_and_add(&l.io_stats.seek_cnt, 1);
+}
+
+/*
+ * Get I/O system call statistics
+ */
+void zg_io_stats(struct zg_io_stats *stats)
+{
+	stats->read_cnt = __sync_fetch_and_add(&l.io_stats.read_cnt, 0);
+	stats->read_bytes = __sync_fetch_and_add(&l.io_stats.read_bytes, 0);
+	stats->seek_cnt = __sync_fetch_and_add(&l.io_stats.seek_cnt, 0);
+}
+
 /*
  * Call all registered exit handlers
  */
@@ -113,6 +145,27 @@ char *zg_strdup(const char *str)
 	return new_str;
 }
 
+/*
+ * Check if buffer contains only zeroes
+ *
+ * After checking the first bytes directly, the buffer is compared with
+ * itself shifted by that many bytes. This way the vectorized memcmp() of
+ * the C library does the work.
+ */
+int zg_is_zero(const void *buf, u64 cnt)
+{
+	const char *ptr = buf;
+	u64 i;
+
+	for (i = 0; i < MIN(cnt, 16); i++) {
+		if (ptr[i])
+			return 0;
+	}
+	if (cnt <= 16)
+		return 1;
+	return memcmp(ptr, ptr + 16, cnt - 16) == 0;
+}
+
 /*
  * Free memory
  */
@@ -176,6 +229,7 @@ fail:
  */
 void zg_close(struct zg_fh *zg_fh)
 {
+	zg_aio_stop(zg_fh);
 	close(zg_fh->fh);
 	free(zg_fh);
 }
@@ -190,6 +244,44 @@ ssize_t zg_read(struct zg_fh *zg_fh, void *buf, size_t cnt, enum zg_check check)
 
 	do {
 		rc = read(zg_fh->fh, buf + copied, cnt - copied);
+		io_stats_read(rc);
+		if (rc == -1) {
+			if (check == ZG_CHECK_NONE)
+				return rc;
+			ERR_EXIT_ERRNO("Could not read \"%s\"", zg_fh->path);
+		}
+		if (rc == 0) {
+			if (check != ZG_CHECK)
+				return copied;
+			ERR_EXIT("Unexpected end of file for \"%s\"",
+				 zg_fh->path);
+		}
+		copied += rc;
+	} while (copied != cnt);
+	return copied;
+}
+
+/*
+ * Read file at offset "off" without changing the file position
+ *
+ * In contrast to zg_read() this function can be used by multiple threads
+ * concurrently on the same file handle. If a read-ahead stream has been
+ * started for the file, the data is taken from the stream if possible.
+ */
+ssize_t zg_pread(struct zg_fh *zg_fh, void *buf, size_t cnt, off_t off,
+		 enum zg_check check)
+{
+	size_t copied = 0;
+	ssize_t rc;
+
+	if (zg_fh->aio) {
+		copied = zg_aio_pread(zg_fh->aio, buf, cnt, off);
+		if (copied && copied == cnt)
+			return copied;
+	}
+	do {
+		rc = pread(zg_fh->fh, buf + copied, cnt - copied, off + copied);
+		io_stats_read(rc);
 		if (rc == -1) {
 			if (check == ZG_CHECK_NONE)
 				return rc;
@@ -219,6 +311,7 @@ ssize_t zg_gets(struct zg_fh *zg_fh, void *ptr, size_t cnt, enum zg_check check)
 		return 0;
 	do {
 		rc = read(zg_fh->fh, &buf[copied], 1);
+		io_stats_read(rc);
 		if (rc == -1) {
 			if (check == ZG_CHECK_NONE)
 				return rc;
@@ -248,6 +341,7 @@ off_t zg_tell(struct zg_fh *zg_fh, enum zg_check check)
 	off_t rc;
 
 	rc = lseek(zg_fh->fh, 0, SEEK_CUR);
+	io_stats_seek();
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not get file position for \"%s\"",
 			       zg_fh->path);
@@ -262,6 +356,7 @@ off_t zg_seek_end(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 	off_t rc;
 
 	rc = lseek(zg_fh->fh, off, SEEK_END);
+	io_stats_seek();
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	return rc;
@@ -275,6 +370,7 @@ off_t zg_seek(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 	off_t rc;
 
 	rc = lseek(zg_fh->fh, off, SEEK_SET);
+	io_stats_seek();
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	if (rc != off && check == ZG_CHECK)
@@ -290,6 +386,7 @@ off_t zg_seek_cur(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 	off_t rc;
 
 	rc = lseek(zg_fh->fh, off, SEEK_CUR);
+	io_stats_seek();
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	return rc;
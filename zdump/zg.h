@@ -45,6 +45,7 @@ extern void *zg_alloc(unsigned int size);
 extern void *zg_realloc(void *ptr, unsigned int size);
 extern void zg_free(void *ptr);
 extern char *zg_strdup(const char *str);
+extern int zg_is_zero(const void *buf, u64 cnt);
 
 /*
  * At exit functions
@@ -148,10 +149,13 @@ static inline u32 zg_csum_partial(const void *buf, int len, u32 sum)
 /*
  * File functions
  */
+struct zg_aio;
+
 struct zg_fh {
 	const char	*path;
 	int		fh;
 	struct stat	sb;
+	struct zg_aio	*aio;
 };
 
 enum zg_type {
@@ -174,6 +178,8 @@ extern struct zg_fh *zg_open(const char *path, int flags, enum zg_check check);
 extern void zg_close(struct zg_fh *zg_fh);
 extern ssize_t zg_read(struct zg_fh *zg_fh, void *buf, size_t cnt,
 		       enum zg_check check);
+extern ssize_t zg_pread(struct zg_fh *zg_fh, void *buf, size_t cnt, off_t off,
+			enum zg_check check);
 extern ssize_t zg_gets(struct zg_fh *zg_fh, void *buf, size_t cnt,
 		       enum zg_check check);
 extern u64 zg_size(struct zg_fh *zg_fh);
@@ -185,6 +191,25 @@ extern int zg_ioctl(struct zg_fh *zg_fh, int rq, void *data, const char *op,
 		    enum zg_check check);
 extern enum zg_type zg_type(struct zg_fh *zg_fh);
 
+/*
+ * Asynchronous read-ahead
+ */
+extern int zg_aio_start(struct zg_fh *zg_fh, u64 off, u64 size,
+			unsigned int depth, int odirect);
+extern void zg_aio_stop(struct zg_fh *zg_fh);
+extern size_t zg_aio_pread(struct zg_aio *aio, void *buf, size_t cnt, u64 off);
+
+/*
+ * I/O system call statistics
+ */
+struct zg_io_stats {
+	u64	read_cnt;	/* Number of read() and pread() calls */
+	u64	read_bytes;	/* Number of bytes read */
+	u64	seek_cnt;	/* Number of lseek() calls */
+};
+
+extern void zg_io_stats(struct zg_io_stats *stats);
+
 /*
  * zgetdump actions
  */
@@ -194,6 +219,7 @@ enum zg_action {
 	ZG_ACTION_DEVICE_INFO,
 	ZG_ACTION_MOUNT,
 	ZG_ACTION_UMOUNT,
+	ZG_ACTION_BENCHMARK,
 };
 
 #endif /* ZG_H */
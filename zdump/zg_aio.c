@@ -0,0 +1,288 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Asynchronous read-ahead for dump files
+ *
+ * Copyright IBM Corp. 2013
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#include "zgetdump.h"
+
+#define AIO_BLK_SIZE	(256 * KIB)	/* Size of one read request */
+#define AIO_ALIGN	PAGE_SIZE	/* Buffer and offset alignment */
+
+/*
+ * State of read-ahead block
+ */
+enum blk_state {
+	BLK_IDLE,	/* Block is beyond end of stream */
+	BLK_BUSY,	/* Read request has been submitted */
+	BLK_DONE,	/* Read request has completed */
+};
+
+/*
+ * Read-ahead block
+ */
+struct aio_blk {
+	struct iocb	iocb;
+	void		*buf;		/* Aligned buffer */
+	u64		off;		/* File offset of buffer */
+	s64		res;		/* Bytes read or negative errno */
+	enum blk_state	state;
+};
+
+/*
+ * Read-ahead stream for file region
+ *
+ * The stream has "blk_cnt" read requests in flight. The blocks are a ring
+ * buffer with "head" being the block that contains "pos". A block that has
+ * been consumed is submitted again for the next region after the last
+ * submitted block ("submit_off").
+ */
+struct zg_aio {
+	pthread_mutex_t	lock;
+	aio_context_t	ctx;
+	int		fd;
+	struct aio_blk	*blk_vec;
+	unsigned int	blk_cnt;
+	unsigned int	head;
+	u64		pos;		/* Next file offset to be returned */
+	u64		submit_off;	/* File offset for next request */
+	u64		end;		/* End of stream */
+	int		failed;		/* Stream has been disabled */
+};
+
+/*
+ * Linux AIO system calls
+ */
+static int io_setup(unsigned int nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+
+/*
+ * Submit read request for block "blk" at offset "submit_off"
+ *
+ * Blocks beyond the end of the stream are not submitted.
+ */
+static void blk_submit(struct zg_aio *aio, struct aio_blk *blk)
+{
+	struct iocb *iocb = &blk->iocb;
+	u64 size;
+
+	blk->off = aio->submit_off;
+	if (blk->off >= aio->end || aio->failed) {
+		blk->state = BLK_IDLE;
+		return;
+	}
+	size = MIN(AIO_BLK_SIZE, ALIGN(aio->end, AIO_ALIGN) - blk->off);
+	aio->submit_off += size;
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_data = (unsigned long) blk;
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_fildes = aio->fd;
+	iocb->aio_buf = (unsigned long) blk->buf;
+	iocb->aio_nbytes = size;
+	iocb->aio_offset = blk->off;
+	blk->state = BLK_BUSY;
+	if (io_submit(aio->ctx, 1, &iocb) == 1)
+		return;
+	/* Let the synchronous reads report errors */
+	blk->state = BLK_IDLE;
+	aio->failed = 1;
+}
+
+/*
+ * Wait until read request for block "blk" has completed
+ */
+static void blk_wait(struct zg_aio *aio, struct aio_blk *blk)
+{
+	struct io_event events[16];
+	struct aio_blk *blk_done;
+	int i, rc;
+
+	while (blk->state == BLK_BUSY) {
+		rc = io_getevents(aio->ctx, 1, ARRAY_ELEMENT_CNT(events),
+				  events);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1)
+			ERR_EXIT_ERRNO("Could not get AIO events");
+		for (i = 0; i < rc; i++) {
+			blk_done = (struct aio_blk *) (unsigned long)
+				events[i].data;
+			blk_done->res = events[i].res;
+			blk_done->state = BLK_DONE;
+		}
+	}
+}
+
+/*
+ * Wait for all submitted read requests
+ */
+static void blk_wait_all(struct zg_aio *aio)
+{
+	unsigned int i;
+
+	for (i = 0; i < aio->blk_cnt; i++)
+		blk_wait(aio, &aio->blk_vec[i]);
+}
+
+/*
+ * Restart stream at offset "off" after all requests have completed
+ */
+static void aio_restart(struct zg_aio *aio, u64 off)
+{
+	unsigned int i;
+
+	blk_wait_all(aio);
+	aio->head = 0;
+	aio->pos = off;
+	aio->submit_off = off & ~((u64) AIO_ALIGN - 1);
+	for (i = 0; i < aio->blk_cnt; i++)
+		blk_submit(aio, &aio->blk_vec[i]);
+}
+
+/*
+ * Submit the head block again and advance head to the next block
+ */
+static void aio_head_next(struct zg_aio *aio)
+{
+	blk_submit(aio, &aio->blk_vec[aio->head]);
+	aio->head = (aio->head + 1) % aio->blk_cnt;
+}
+
+/*
+ * Read "cnt" bytes at offset "off" from read-ahead stream
+ *
+ * Return the number of bytes that could be copied from the stream. The
+ * remaining bytes have to be read synchronously. Requests behind the
+ * current stream position are not served. For requests after the stream
+ * position the data in between is skipped.
+ */
+size_t zg_aio_pread(struct zg_aio *aio, void *buf, size_t cnt, u64 off)
+{
+	u64 size, blk_off, blk_end;
+	struct aio_blk *blk;
+	size_t copied = 0;
+
+	pthread_mutex_lock(&aio->lock);
+	if (aio->failed || off < aio->pos || off >= aio->end)
+		goto out;
+	if (off >= aio->submit_off)
+		aio_restart(aio, off);
+	aio->pos = off;
+	while (copied < cnt && !aio->failed) {
+		blk = &aio->blk_vec[aio->head];
+		if (blk->state == BLK_IDLE)
+			break;
+		blk_wait(aio, blk);
+		if (blk->res < 0) {
+			aio->failed = 1;
+			break;
+		}
+		blk_end = blk->off + blk->iocb.aio_nbytes;
+		if (aio->pos >= blk_end) {
+			/* Skip block that is before requested data */
+			aio_head_next(aio);
+			continue;
+		}
+		blk_off = aio->pos - blk->off;
+		if (blk_off >= (u64) blk->res)
+			break; /* End of file */
+		size = MIN(cnt - copied, blk->res - blk_off);
+		memcpy(buf + copied, blk->buf + blk_off, size);
+		copied += size;
+		aio->pos += size;
+		if (aio->pos == blk_end)
+			aio_head_next(aio);
+	}
+out:
+	pthread_mutex_unlock(&aio->lock);
+	return copied;
+}
+
+/*
+ * Start read-ahead stream for "size" bytes at offset "off" of file
+ *
+ * The stream keeps "depth" requests in flight and is used by zg_pread().
+ * If "odirect" is set, the file is read with O_DIRECT to bypass the page
+ * cache. Return -1 if asynchronous I/O is not available.
+ */
+int zg_aio_start(struct zg_fh *zg_fh, u64 off, u64 size, unsigned int depth,
+		 int odirect)
+{
+	struct zg_aio *aio = zg_alloc(sizeof(*aio));
+	unsigned int i;
+
+	aio->fd = -1;
+	if (odirect)
+		aio->fd = open(zg_path(zg_fh), O_RDONLY | O_DIRECT);
+	if (aio->fd == -1)
+		aio->fd = open(zg_path(zg_fh), O_RDONLY);
+	if (aio->fd == -1)
+		goto fail_free;
+	if (io_setup(depth, &aio->ctx) == -1)
+		goto fail_close;
+	pthread_mutex_init(&aio->lock, NULL);
+	aio->end = off + size;
+	aio->blk_cnt = depth;
+	aio->blk_vec = zg_alloc(depth * sizeof(*aio->blk_vec));
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign(&aio->blk_vec[i].buf, AIO_ALIGN,
+				   AIO_BLK_SIZE))
+			ERR_EXIT("Alloc: Out of memory (%i KiB)",
+				 TO_KIB(AIO_BLK_SIZE));
+	}
+	aio_restart(aio, off);
+	zg_fh->aio = aio;
+	return 0;
+
+fail_close:
+	close(aio->fd);
+fail_free:
+	zg_free(aio);
+	return -1;
+}
+
+/*
+ * Stop read-ahead stream of file
+ */
+void zg_aio_stop(struct zg_fh *zg_fh)
+{
+	struct zg_aio *aio = zg_fh->aio;
+	unsigned int i;
+
+	if (!aio)
+		return;
+	zg_fh->aio = NULL;
+	blk_wait_all(aio);
+	io_destroy(aio->ctx);
+	close(aio->fd);
+	for (i = 0; i < aio->blk_cnt; i++)
+		free(aio->blk_vec[i].buf);
+	zg_free(aio->blk_vec);
+	pthread_mutex_destroy(&aio->lock);
+	zg_free(aio);
+}
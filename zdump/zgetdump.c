@@ -159,13 +159,23 @@ static int do_stdout(void)
 
 	if (dfi_init() != 0)
 		ERR_EXIT("Dump cannot be processed (is not complete)");
+	snapshot_init();
 	dfo_init();
 	kdump_select_check();
 	rc = stdout_write_dump();
+	snapshot_exit();
 	dfi_exit();
 	return rc;
 }
 
+/*
+ * Run "--benchmark" action
+ */
+static int do_benchmark(void)
+{
+	return bench_run();
+}
+
 /*
  * The zgetdump main function
  */
@@ -185,6 +195,8 @@ int main(int argc, char *argv[])
 		return do_mount();
 	case ZG_ACTION_UMOUNT:
 		return do_umount();
+	case ZG_ACTION_BENCHMARK:
+		return do_benchmark();
 	}
 	ABORT("Invalid action: %i", g.opts.action);
 }
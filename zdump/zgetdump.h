@@ -20,6 +20,8 @@
 #include "df_s390.h"
 #include "df_elf.h"
 #include "df_lkcd.h"
+#include "df_kdump.h"
+#include "df_compact.h"
 
 /*
  * zgetdump options
@@ -36,6 +38,18 @@ struct options {
 	int		argc_fuse;
 	const char	*select;
 	int		select_specified;
+	int		jobs_specified;
+	unsigned int	jobs;
+	int		cache_specified;
+	u64		cache_size;
+	int		sparse;
+	int		aio_specified;
+	unsigned int	aio_depth;
+	int		odirect;
+	const char	*manifest;
+	const char	*checkpoint;
+	int		resume;
+	const char	*snapshot;
 };
 
 extern const char *OPTS_SELECT_KDUMP;
@@ -56,10 +70,33 @@ extern struct zgetdump_globals {
  */
 extern void opts_parse(int argc, char *argv[]);
 extern int stdout_write_dump(void);
+extern int bench_run(void);
+
+/*
+ * Manifest, checkpoint, and snapshot functions
+ */
+#define MANIFEST_STATE_SIZE	512
+
+extern void manifest_init(const char *state);
+extern void manifest_update(const void *buf, u64 cnt);
+extern int manifest_state(char *buf);
+extern void manifest_exit(void);
+
+extern u64 checkpoint_init(void);
+extern const char *checkpoint_manifest(void);
+extern int checkpoint_due(u64 written);
+extern void checkpoint_write(u64 written);
+extern void checkpoint_exit(void);
+
+extern void snapshot_init(void);
+extern void snapshot_exit(void);
 
 #ifndef WITHOUT_FUSE
 extern int zfuse_mount_dump(void);
 extern void zfuse_umount(void);
+extern void zfuse_cache_init(u64 size);
+extern u64 zfuse_cache_read(void *buf, u64 cnt, u64 off);
+extern int zfuse_cache_stats(char *buf, size_t size);
 #else
 static inline int zfuse_mount_dump(void)
 {
@@ -79,6 +116,7 @@ extern struct dfi dfi_s390mv;
 extern struct dfi dfi_s390;
 extern struct dfi dfi_lkcd;
 extern struct dfi dfi_elf;
+extern struct dfi dfi_compact;
 extern struct dfi dfi_kdump;
 extern struct dfi dfi_kdump_flat;
 extern struct dfi dfi_devmem;
@@ -88,6 +126,7 @@ extern struct dfi dfi_devmem;
  */
 extern struct dfo dfo_s390;
 extern struct dfo dfo_elf;
+extern struct dfo dfo_kdump;
 
 /*
  * Supported s390 dumpers
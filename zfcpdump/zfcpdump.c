@@ -93,6 +93,26 @@ static int parse_parameter(char *parameter)
 				g.parm_debug = PARM_DEBUG_DFLT;
 			}
 		}
+	} else if (strcmp(token, PARM_MODE) == 0) {
+		/* Dump mode */
+		char *s = strtok(NULL, "=");
+		if (s && strcmp(s, "elf") == 0) {
+			g.parm_mode = PARM_MODE_ELF;
+		} else if (s && strcmp(s, "compact") == 0) {
+			g.parm_mode = PARM_MODE_COMPACT;
+		} else if (s && strcmp(s, "compressed") == 0) {
+#ifdef GZIP_SUPPORT
+			g.parm_mode = PARM_MODE_COMPRESSED;
+#else
+			PRINT_WARN("Compression is not supported\n");
+			g.parm_mode = PARM_MODE_COMPACT;
+#endif
+		} else {
+			PRINT_WARN("Invalid value for %s parameter "
+				   "specified (allowed values are elf, compact, "
+				   "and compressed)\n", PARM_MODE);
+			PRINT_WARN("Using default: elf\n");
+		}
 	}
 	return 0;
 }
@@ -110,6 +130,7 @@ static int parse_parmline(void)
 
 	/* setting defaults */
 	g.parm_debug    = PARM_DEBUG_DFLT;
+	g.parm_mode     = PARM_MODE_ELF;
 
 	fh = open(PROC_CMDLINE, O_RDONLY);
 	if (fh == -1) {
@@ -142,6 +163,7 @@ static int parse_parmline(void)
 		}
 	}
 	PRINT_TRACE("dump debug: %d\n", g.parm_debug);
+	PRINT_TRACE("dump mode: %d\n", g.parm_mode);
 	close(fh);
 	return 0;
 }
@@ -62,6 +62,7 @@ struct globals {
 	char	start_time_str[128];
 	struct timeval start_time;
 	unsigned long vmcore_size;
+	int	parm_mode;
 };
 
 extern struct globals g;
@@ -72,6 +73,9 @@ extern struct globals g;
 #ifndef MAX
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #endif
+#ifndef ROUNDUP
+#define ROUNDUP(x, y) ((((x) + ((y) - 1)) / (y)) * (y))
+#endif
 
 #define PROC_CMDLINE	"/proc/cmdline"
 #define DEV_ZCORE	"/sys/kernel/debug/zcore/mem"
@@ -90,6 +94,11 @@ extern struct globals g;
 #define PARM_DEBUG_MIN	1
 #define PARM_DEBUG_MAX	6
 
+#define PARM_MODE		"dump_mode"
+#define PARM_MODE_ELF		0	/* Copy of /proc/vmcore */
+#define PARM_MODE_COMPACT	1	/* Zero pages omitted */
+#define PARM_MODE_COMPRESSED	2	/* Zero pages omitted, compressed */
+
 #define WAIT_TIME_END		3 /* seconds */
 #define WAIT_TIME_ONLINE	2 /* seconds */
 
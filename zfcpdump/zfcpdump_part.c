@@ -33,11 +33,17 @@
 #include <elf.h>
 #include <sys/mman.h>
 #include <linux/hdreg.h>
+#include <pthread.h>
+#ifdef GZIP_SUPPORT
+#include <zlib.h>
+#endif
 
 #include "zt_common.h"
+#include "df_compact.h"
 #include "zfcpdump.h"
 
-#define COPY_BUF_SIZE		0x10000
+#define COPY_BUF_SIZE		DF_COMPACT_BLK_SIZE	/* One compact block */
+#define COPY_BUF_COUNT		4
 #define COPY_TABLE_ENTRY_COUNT	4
 
 /*
@@ -48,6 +54,58 @@ struct copy_table_entry {
 	unsigned long off;
 };
 
+#define COMPACT_IDX_CNT		(PAGE_SIZE / sizeof(struct df_compact_blk))
+
+/*
+ * Copy buffer that is filled by the reader thread and written by the
+ * main thread
+ */
+struct copy_buf {
+	void		*data;		/* Page aligned buffer */
+	void		*zdata;		/* Buffer for compressed data */
+	unsigned long	off;		/* Offset in /proc/vmcore */
+	unsigned long	size;		/* Size in /proc/vmcore */
+	unsigned long	len;		/* Size of data to be written */
+	int		full;		/* Buffer contains data to be written */
+	int		rc;		/* Read result */
+	struct df_compact_blk blk;	/* Index entry for compact dumps */
+};
+
+/*
+ * Double buffered copy state
+ *
+ * The reader thread maps COPY_BUF_SIZE windows of /proc/vmcore and copies
+ * them into the ring of COPY_BUF_COUNT buffers, while the main thread
+ * writes the previously filled buffers to the dump partition. Page aligned
+ * parts are written with O_DIRECT, which avoids filling the page cache of
+ * the small zfcpdump system.
+ *
+ * For compact dumps ("dump_mode=compact" or "dump_mode=compressed") the
+ * reader thread also removes the zero pages from the buffers and optionally
+ * compresses them. The main thread appends the remaining data to the dump
+ * and writes one index entry per buffer.
+ */
+static struct {
+	struct copy_buf		buf_vec[COPY_BUF_COUNT];
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	int			fdin;
+	int			fdout;
+	int			fdout_direct;	/* -1 if no O_DIRECT */
+	int			abort;		/* Writer has failed */
+	struct copy_table_entry	*entry;		/* Entry for reader thread */
+	struct timeval		time_read;	/* Time spent for reading */
+	struct timeval		time_write;	/* Time spent for writing */
+	int			compact;	/* Write compact dump */
+	unsigned long		dump_off;	/* Dump offset on partition */
+	unsigned long		dump_end;	/* End of dump space */
+	unsigned long		data_off;	/* Next block data offset */
+	struct df_compact_blk	*idx_vec;	/* One page of index entries */
+	unsigned long		idx_cnt;	/* Entries in "idx_vec" */
+	unsigned long		idx_off;	/* Offset for "idx_vec" */
+	struct df_compact_hdr	hdr;
+} copy;
+
 /*
  * Single volume SCSI dump superblock
  */
@@ -105,6 +163,7 @@ struct scsi_mbr {
 static const char *module_list[] = {"zfcp", "sd_mod", "zcore_mod", NULL};
 static struct scsi_dump_sb dump_sb;
 static struct scsi_mbr mbr;
+static const char *mode_str[] = {"elf", "compact", "compressed"};
 
 /*
  * Read file at given offset
@@ -243,41 +302,408 @@ static int copy_table_init(int fd, struct copy_table_entry *table)
 	return -1;
 }
 
+/*
+ * Add time elapsed since "start" to "sum"
+ */
+static void time_add(struct timeval *sum, struct timeval *start)
+{
+	struct timeval now, diff;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, start, &diff);
+	timeradd(sum, &diff, sum);
+}
+
+/*
+ * Read one window of /proc/vmcore into copy buffer
+ */
+static int copy_buf_read(struct copy_buf *buf)
+{
+	struct timeval start;
+	void *map;
+
+	gettimeofday(&start, NULL);
+	map = mmap(0, buf->size, PROT_READ, MAP_SHARED, copy.fdin, buf->off);
+	if (map == (void *)-1) {
+		PRINT_PERR("Mapping failed\n");
+		return -1;
+	}
+	memcpy(buf->data, map, buf->size);
+	munmap(map, buf->size);
+	buf->len = buf->size;
+	time_add(&copy.time_read, &start);
+	return 0;
+}
+
+/*
+ * Check if buffer contains only zeroes
+ */
+static int is_zero(const void *buf, unsigned long size)
+{
+	const uint64_t *ptr = buf;
+	unsigned long i;
+
+	if (size % sizeof(*ptr))
+		return 0;
+	for (i = 0; i < size / sizeof(*ptr); i++) {
+		if (ptr[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Remove zero pages from copy buffer and compress remaining data
+ *
+ * The index entry "blk" of the buffer records which pages are stored. The
+ * stored data is padded with zeroes to full pages.
+ */
+static void copy_buf_compact(struct copy_buf *buf)
+{
+	unsigned long pg, pg_cnt, len, size = 0;
+	struct df_compact_blk *blk = &buf->blk;
+#ifdef GZIP_SUPPORT
+	uLongf zsize;
+	void *tmp;
+#endif
+
+	memset(blk, 0, sizeof(*blk));
+	blk->off = buf->off;
+	blk->size = buf->size;
+	pg_cnt = (buf->size + PAGE_SIZE - 1) / PAGE_SIZE;
+	for (pg = 0; pg < pg_cnt; pg++) {
+		len = MIN(PAGE_SIZE, buf->size - pg * PAGE_SIZE);
+		if (is_zero(buf->data + pg * PAGE_SIZE, len))
+			continue;
+		memmove(buf->data + size, buf->data + pg * PAGE_SIZE, len);
+		blk->page_map[pg / 8] |= 1 << (pg % 8);
+		size += len;
+	}
+	blk->data_size = size;
+#ifdef GZIP_SUPPORT
+	/* Compressed data is only used if it is smaller */
+	zsize = size;
+	if (size && g.parm_mode == PARM_MODE_COMPRESSED &&
+	    compress2(buf->zdata, &zsize, buf->data, size, 1) == Z_OK &&
+	    zsize < size) {
+		tmp = buf->data;
+		buf->data = buf->zdata;
+		buf->zdata = tmp;
+		blk->flags |= DF_COMPACT_BLK_ZLIB;
+		blk->data_size = zsize;
+	}
+#endif
+	buf->len = ROUNDUP(blk->data_size, PAGE_SIZE);
+	memset(buf->data + blk->data_size, 0, buf->len - blk->data_size);
+}
+
+/*
+ * Reader thread: Fill copy buffers for current copy table entry
+ */
+static void *copy_reader_fn(void *UNUSED(data))
+{
+	struct copy_table_entry *entry = copy.entry;
+	unsigned long off = entry->off, i = 0;
+	struct copy_buf *buf;
+	int rc, abort;
+
+	while (off < entry->off + entry->size) {
+		buf = &copy.buf_vec[i++ % COPY_BUF_COUNT];
+		pthread_mutex_lock(&copy.lock);
+		while (buf->full && !copy.abort)
+			pthread_cond_wait(&copy.cond, &copy.lock);
+		abort = copy.abort;
+		pthread_mutex_unlock(&copy.lock);
+		if (abort)
+			break;
+		buf->off = off;
+		buf->size = MIN(COPY_BUF_SIZE, entry->off + entry->size - off);
+		rc = copy_buf_read(buf);
+		if (rc == 0 && copy.compact)
+			copy_buf_compact(buf);
+		pthread_mutex_lock(&copy.lock);
+		buf->rc = rc;
+		buf->full = 1;
+		pthread_cond_broadcast(&copy.cond);
+		pthread_mutex_unlock(&copy.lock);
+		if (rc)
+			break;
+		off += buf->size;
+	}
+	return NULL;
+}
+
+/*
+ * Write "len" bytes of "data" to dump partition at offset "off"
+ *
+ * Use O_DIRECT, if offset and size of the data are page aligned.
+ */
+static int copy_write(void *data, unsigned long len, unsigned long off)
+{
+	struct timeval start;
+	ssize_t rc;
+	int fd;
+
+	fd = copy.fdout_direct;
+	if (fd == -1 || off % PAGE_SIZE || len % PAGE_SIZE)
+		fd = copy.fdout;
+	gettimeofday(&start, NULL);
+	rc = pwrite(fd, data, len, off);
+	if (rc != (ssize_t) len) {
+		if (rc >= 0)
+			errno = EIO;
+		PRINT_PERR("Write to partition failed\n");
+		return -1;
+	}
+	time_add(&copy.time_write, &start);
+	return 0;
+}
+
+/*
+ * Write collected index entries of compact dump
+ */
+static int compact_idx_flush(void)
+{
+	unsigned long len = copy.idx_cnt * sizeof(struct df_compact_blk);
+
+	if (copy.idx_cnt == 0)
+		return 0;
+	if (copy_write(copy.idx_vec, len, copy.dump_off + copy.idx_off))
+		return -1;
+	copy.idx_off += len;
+	copy.hdr.blk_cnt += copy.idx_cnt;
+	copy.idx_cnt = 0;
+	return 0;
+}
+
+/*
+ * Append data of copy buffer to compact dump and add index entry
+ */
+static int compact_buf_write(struct copy_buf *buf)
+{
+	if (copy.dump_off + copy.data_off + buf->len > copy.dump_end) {
+		PRINT_ERR("Dump partition too small for compact dump\n");
+		return -1;
+	}
+	if (copy_write(buf->data, buf->len, copy.dump_off + copy.data_off))
+		return -1;
+	buf->blk.data_off = copy.data_off;
+	copy.data_off += buf->len;
+	copy.idx_vec[copy.idx_cnt++] = buf->blk;
+	if (copy.idx_cnt == COMPACT_IDX_CNT)
+		return compact_idx_flush();
+	return 0;
+}
+
+/*
+ * Write copy buffer to dump partition
+ */
+static int copy_buf_write(struct copy_buf *buf, unsigned long offset)
+{
+	if (copy.compact)
+		return compact_buf_write(buf);
+	return copy_write(buf->data, buf->len, offset + buf->off);
+}
+
 /*
  * Copy one copy table entry form /proc/vmcore to dump partition
+ *
+ * The reader thread fills the copy buffers while this function writes
+ * them. When the function returns, all data of the entry has been written.
  */
-static int copy_table_entry_write(int fdin, int fdout,
-				  struct copy_table_entry *entry,
+static int copy_table_entry_write(struct copy_table_entry *entry,
 				  unsigned long offset)
 {
-	unsigned long buf_size, bytes_left, off;
-	void *map;
+	unsigned long off, i = 0;
+	struct copy_buf *buf;
+	pthread_t thread;
+	int rc = 0;
 
 	if (entry->size == 0)
 		return 0;
-	off = entry->off;
-	bytes_left = entry->size;
-	if (lseek(fdout, entry->off + offset, SEEK_SET) < 0)
-		return -1;
-	while (bytes_left > 0) {
-		buf_size = MIN(COPY_BUF_SIZE, bytes_left);
-		map = mmap(0, buf_size, PROT_READ, MAP_SHARED, fdin, off);
-		if (map == (void *)-1) {
-			PRINT_PERR("Mapping failed\n");
+	copy.entry = entry;
+	copy.abort = 0;
+	for (i = 0; i < COPY_BUF_COUNT; i++)
+		copy.buf_vec[i].full = 0;
+	if (pthread_create(&thread, NULL, copy_reader_fn, NULL)) {
+		PRINT_PERR("Could not create reader thread\n");
+		return -1;
+	}
+	for (off = 0, i = 0; off < entry->size; i++) {
+		buf = &copy.buf_vec[i % COPY_BUF_COUNT];
+		pthread_mutex_lock(&copy.lock);
+		while (!buf->full)
+			pthread_cond_wait(&copy.cond, &copy.lock);
+		pthread_mutex_unlock(&copy.lock);
+		rc = buf->rc ? buf->rc : copy_buf_write(buf, offset);
+		if (rc)
+			break;
+		off += buf->size;
+		pthread_mutex_lock(&copy.lock);
+		buf->full = 0;
+		pthread_cond_broadcast(&copy.cond);
+		pthread_mutex_unlock(&copy.lock);
+		show_progress(buf->size);
+	}
+	pthread_mutex_lock(&copy.lock);
+	copy.abort = 1;
+	pthread_cond_broadcast(&copy.cond);
+	pthread_mutex_unlock(&copy.lock);
+	pthread_join(thread, NULL);
+	return rc;
+}
+
+/*
+ * Allocate copy buffers and open dump partition for O_DIRECT writes
+ */
+static int copy_init(int fdin, int fdout, const char *out,
+		     unsigned long offset)
+{
+	int i;
+
+	copy.fdin = fdin;
+	copy.fdout = fdout;
+	copy.fdout_direct = -1;
+	for (i = 0; i < COPY_BUF_COUNT; i++) {
+		if (posix_memalign(&copy.buf_vec[i].data, PAGE_SIZE,
+				   COPY_BUF_SIZE)) {
+			PRINT_ERR("Could not allocate copy buffer\n");
 			return -1;
 		}
-		if (write(fdout, map, buf_size) < 0) {
-			PRINT_PERR("Write to partition failed\n");
+	}
+#ifdef GZIP_SUPPORT
+	for (i = 0; g.parm_mode == PARM_MODE_COMPRESSED &&
+	     i < COPY_BUF_COUNT; i++) {
+		if (posix_memalign(&copy.buf_vec[i].zdata, PAGE_SIZE,
+				   COPY_BUF_SIZE)) {
+			PRINT_ERR("Could not allocate copy buffer\n");
 			return -1;
 		}
-		munmap(map, buf_size);
-		bytes_left -= buf_size;
-		off += buf_size;
-		show_progress(buf_size);
 	}
+#endif
+	copy.compact = (g.parm_mode != PARM_MODE_ELF);
+	pthread_mutex_init(&copy.lock, NULL);
+	pthread_cond_init(&copy.cond, NULL);
+	/* The table entries are page aligned relative to the dump start */
+	if (offset % PAGE_SIZE == 0)
+		copy.fdout_direct = open(out, O_WRONLY | O_DIRECT);
+	if (copy.fdout_direct == -1)
+		PRINT_TRACE("Writing dump without O_DIRECT\n");
 	return 0;
 }
 
+/*
+ * Initialize compact dump and write ELF header and notes
+ *
+ * The compact dump starts with the compact dump header page, followed by
+ * a copy of the ELF header and notes, the block index, and the block data.
+ * The ELF header and notes end where the HSA memory starts.
+ */
+static int compact_init(struct copy_table_entry *table, unsigned long offset)
+{
+	unsigned long blk_cnt, hdr_size = table[0].off;
+	void *buf;
+	int rc;
+
+	blk_cnt = (ROUNDUP(table[0].size, DF_COMPACT_BLK_SIZE) +
+		   ROUNDUP(table[2].size, DF_COMPACT_BLK_SIZE)) /
+		DF_COMPACT_BLK_SIZE;
+	copy.hdr.magic = DF_COMPACT_MAGIC;
+	copy.hdr.version = DF_COMPACT_VERSION;
+	copy.hdr.blk_size = DF_COMPACT_BLK_SIZE;
+	copy.hdr.elf_size = g.vmcore_size;
+	copy.hdr.elf_hdr_off = PAGE_SIZE;
+	copy.hdr.elf_hdr_size = hdr_size;
+	copy.hdr.idx_off = PAGE_SIZE + ROUNDUP(hdr_size, PAGE_SIZE);
+	copy.idx_off = copy.hdr.idx_off;
+	copy.data_off = copy.hdr.idx_off +
+		ROUNDUP(blk_cnt * sizeof(struct df_compact_blk), PAGE_SIZE);
+	copy.dump_off = offset;
+	copy.dump_end = offset + dump_sb.dump_size;
+	if (copy.dump_off + copy.data_off > copy.dump_end) {
+		PRINT_ERR("Dump partition too small for compact dump\n");
+		return -1;
+	}
+	if (posix_memalign((void **) &copy.idx_vec, PAGE_SIZE, PAGE_SIZE) ||
+	    posix_memalign(&buf, PAGE_SIZE, ROUNDUP(hdr_size, PAGE_SIZE))) {
+		PRINT_ERR("Could not allocate compact dump buffer\n");
+		return -1;
+	}
+	memset(buf, 0, ROUNDUP(hdr_size, PAGE_SIZE));
+	if (pread(copy.fdin, buf, hdr_size, 0) != (ssize_t) hdr_size) {
+		PRINT_PERR("Reading ELF header failed\n");
+		free(buf);
+		return -1;
+	}
+	rc = copy_write(buf, ROUNDUP(hdr_size, PAGE_SIZE),
+			offset + copy.hdr.elf_hdr_off);
+	free(buf);
+	return rc;
+}
+
+/*
+ * Write remaining index entries and header of compact dump
+ *
+ * The written data is synced before the header is written. This ensures
+ * that the compact dump stays invalid until all data is written.
+ */
+static int compact_exit(void)
+{
+	if (compact_idx_flush())
+		return -1;
+	copy.hdr.dump_size = copy.data_off;
+	if (fsync(copy.fdout)) {
+		PRINT_PERR("Sync of partition failed\n");
+		return -1;
+	}
+	memset(copy.idx_vec, 0, PAGE_SIZE);
+	memcpy(copy.idx_vec, &copy.hdr, sizeof(copy.hdr));
+	return copy_write(copy.idx_vec, PAGE_SIZE, copy.dump_off);
+}
+
+/*
+ * Print throughput of dump copy that has been started at "start"
+ */
+static void copy_stats_print(struct timeval *start)
+{
+	struct timeval now, total;
+	unsigned long usecs;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, start, &total);
+	usecs = MAX(total.tv_sec * 1000000UL + total.tv_usec, 1UL);
+	PRINT(" Copied %llu MB in %lu.%01lu sec (%llu MB/s)\n",
+	      TO_MIB(g.vmcore_size), (unsigned long) total.tv_sec,
+	      (unsigned long) total.tv_usec / 100000,
+	      TO_MIB(g.vmcore_size * 1000000ULL / usecs));
+	PRINT(" Read.....: %lu.%01lu sec\n",
+	      (unsigned long) copy.time_read.tv_sec,
+	      (unsigned long) copy.time_read.tv_usec / 100000);
+	PRINT(" Write....: %lu.%01lu sec\n",
+	      (unsigned long) copy.time_write.tv_sec,
+	      (unsigned long) copy.time_write.tv_usec / 100000);
+	if (copy.compact)
+		PRINT(" Written..: %llu MB\n", TO_MIB(copy.data_off));
+}
+
+/*
+ * Free copy buffers
+ */
+static void copy_exit(void)
+{
+	int i;
+
+	if (copy.fdout_direct != -1)
+		close(copy.fdout_direct);
+	for (i = 0; i < COPY_BUF_COUNT; i++) {
+		free(copy.buf_vec[i].data);
+		free(copy.buf_vec[i].zdata);
+	}
+	free(copy.idx_vec);
+	pthread_cond_destroy(&copy.cond);
+	pthread_mutex_destroy(&copy.lock);
+}
+
 /*
  * Copy dump using mmap (copy HSA first)
  */
@@ -286,6 +712,7 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 	struct copy_table_entry table[COPY_TABLE_ENTRY_COUNT];
 	char busy_str[] = "zfcpdump busy";
 	int fdout, fdin, i, rc = -1;
+	struct timeval start;
 
 	fdin = open(in, O_RDONLY);
 	if (fdin < 0) {
@@ -294,7 +721,8 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 	}
 	g.vmcore_size = lseek(fdin, (off_t) 0, SEEK_END);
 	lseek(fdin, 0L, SEEK_SET);
-	if (g.vmcore_size > dump_sb.dump_size) {
+	/* Compact dumps check the size while writing */
+	if (g.parm_mode == PARM_MODE_ELF && g.vmcore_size > dump_sb.dump_size) {
 		PRINT_ERR("Disk too small: dump=%lldMB (diskspace=%lldMB)\n",
 			  TO_MIB(g.vmcore_size), TO_MIB(dump_sb.dump_size));
 		goto out_close_fdin;
@@ -313,15 +741,29 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 		goto out_close_fdin;
 	if (copy_table_init(fdin, table))
 		goto out_close_fdin;
+	if (copy_init(fdin, fdout, out, offset))
+		goto out_close_fdin;
+	gettimeofday(&start, NULL);
+	if (copy.compact && compact_init(table, offset))
+		goto out_copy_exit;
 	show_progress(0);
 	for (i = 0; i < COPY_TABLE_ENTRY_COUNT; i++) {
-		if (copy_table_entry_write(fdin, fdout, &table[i], offset))
-			goto out_close_fdout;
+		/* ELF header and notes of compact dumps are already written */
+		if (copy.compact && (i == 1 || i == 3)) {
+			show_progress(table[i].size);
+			continue;
+		}
+		if (copy_table_entry_write(&table[i], offset))
+			goto out_copy_exit;
 		if (i == 0) /* 0 is the HSA */
 			release_hsa();
 	}
+	if (copy.compact && compact_exit())
+		goto out_copy_exit;
+	copy_stats_print(&start);
 	rc = 0;
-out_close_fdout:
+out_copy_exit:
+	copy_exit();
 	if (csum_update(fdout))
 		rc = -1;
 	fsync(fdout);
@@ -446,6 +888,7 @@ int main(int UNUSED(argc), char *UNUSED(argv[]))
 	PRINT(" wwpn.....: %s\n", g.dump_wwpn);
 	PRINT(" lun......: %s\n", g.dump_lun);
 	PRINT(" conf.....: %s\n", g.dump_bootprog);
+	PRINT(" mode.....: %s\n", mode_str[g.parm_mode]);
 	if (get_scsi_dump_params())
 		return terminate(1);
 	print_newline();